@@ -68,9 +68,7 @@ const T *Array<T>::data(void) const
 template<typename T>
 void Array<T>::append(const T &value, int n)
 {
-	this->reserve(this->size()+n);
-	for(int i=0; i<n; ++i)
-		this->push_back(value);
+	this->insert(this->end(), n, value);	// keeps geometric growth
 }
 
 template<typename T>
@@ -29,29 +29,48 @@ namespace pla
 {
 
 BinarySerializer::BinarySerializer(Stream *stream) :
-	mStream(stream)
+	mStream(stream),
+	mData(NULL),
+	mSize(0),
+	mPosition(0)
 {
 	Assert(stream);
 }
 
+BinarySerializer::BinarySerializer(const char *data, size_t size) :
+	mStream(NULL),
+	mData(data ? data : ""),
+	mSize(data ? size : 0),
+	mPosition(0)
+{
+
+}
+
 BinarySerializer::~BinarySerializer(void)
 {
 
 }
 
+size_t BinarySerializer::left(void) const
+{
+	return mSize - mPosition;
+}
+
 bool BinarySerializer::read(std::string &str)
 {
 	uint32_t size;
 	if(!read(size)) return false;
 
-	str.clear();
-	str.reserve(size);
-
-	while(size--)
+	// Read in bulk
+	if(mData)
 	{
-		uint8_t c;
-		AssertIO(read(c));
-		str+= char(c);
+		AssertIO(mSize - mPosition >= size);
+		str.assign(mData + mPosition, size);
+		mPosition+= size;
+	}
+	else {
+		str.resize(size);
+		if(size) AssertIO(mStream->readBinary(&str[0], size) == int64_t(size));
 	}
 
 	return true;
@@ -60,9 +79,7 @@ bool BinarySerializer::read(std::string &str)
 void BinarySerializer::write(const std::string &str)
 {
 	write(uint32_t(str.size()));
-
-	for(int i=0; i<str.size(); ++i)
-		write(uint8_t(str[i]));
+	stream()->writeBinary(str.data(), str.size());
 }
 
 bool BinarySerializer::read(bool &b)
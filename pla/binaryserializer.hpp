@@ -24,6 +24,9 @@
 
 #include "pla/serializer.hpp"
 #include "pla/stream.hpp"
+#include "pla/exception.hpp"
+
+#include <cstring>
 
 namespace pla
 {
@@ -31,35 +34,38 @@ namespace pla
 class BinarySerializer : public Serializer
 {
 public:
-	BinarySerializer(Stream *stream);	// stream WON'T be destroyed
+	BinarySerializer(Stream *stream);			// stream WON'T be destroyed
+	BinarySerializer(const char *data, size_t size);	// read-only contiguous buffer, data is NOT copied
 	~BinarySerializer(void);
 	
+	size_t left(void) const;	// data left in contiguous buffer
+	
 private:
 	bool		read(std::string &str);
 	bool		read(bool &b);
-	inline bool	read(int8_t &i)		{ return mStream->readBinary(i); }
-	inline bool	read(int16_t &i)	{ return mStream->readBinary(i); }
-	inline bool	read(int32_t &i)	{ return mStream->readBinary(i); }
-	inline bool	read(int64_t &i)	{ return mStream->readBinary(i); }
-	inline bool	read(uint8_t &i)	{ return mStream->readBinary(i); }
-	inline bool	read(uint16_t &i)	{ return mStream->readBinary(i); }
-	inline bool	read(uint32_t &i)	{ return mStream->readBinary(i); }
-	inline bool	read(uint64_t &i)	{ return mStream->readBinary(i); }
-	inline bool	read(float &f)		{ return mStream->readBinary(f); }
-	inline bool	read(double &f)		{ return mStream->readBinary(f); }
+	inline bool	read(int8_t &i)		{ uint8_t u; if(!read(u)) return false; i = int8_t(u); return true; }
+	inline bool	read(int16_t &i)	{ uint16_t u; if(!read(u)) return false; i = int16_t(u); return true; }
+	inline bool	read(int32_t &i)	{ uint32_t u; if(!read(u)) return false; i = int32_t(u); return true; }
+	inline bool	read(int64_t &i)	{ uint64_t u; if(!read(u)) return false; i = int64_t(u); return true; }
+	inline bool	read(uint8_t &i)	{ return mData ? readBuffer(i) : mStream->readBinary(i); }
+	inline bool	read(uint16_t &i)	{ return mData ? readBuffer(i) : mStream->readBinary(i); }
+	inline bool	read(uint32_t &i)	{ return mData ? readBuffer(i) : mStream->readBinary(i); }
+	inline bool	read(uint64_t &i)	{ return mData ? readBuffer(i) : mStream->readBinary(i); }
+	inline bool	read(float &f)		{ return mData ? readBuffer(f) : mStream->readBinary(f); }
+	inline bool	read(double &f)		{ return mData ? readBuffer(f) : mStream->readBinary(f); }
 	
 	void		write(const std::string &str);
 	void		write(bool b);
-	inline void	write(int8_t i)		{ mStream->writeBinary(i); }
-	inline void	write(int16_t i)	{ mStream->writeBinary(i); }
-	inline void	write(int32_t i)	{ mStream->writeBinary(i); }
-	inline void	write(int64_t i)	{ mStream->writeBinary(i); }
-	inline void	write(uint8_t i)	{ mStream->writeBinary(i); }
-	inline void	write(uint16_t i)	{ mStream->writeBinary(i); }
-	inline void	write(uint32_t i)	{ mStream->writeBinary(i); }
-	inline void	write(uint64_t i)	{ mStream->writeBinary(i); }
-	inline void	write(float f)		{ mStream->writeBinary(f); }
-	inline void	write(double f)		{ mStream->writeBinary(f); }
+	inline void	write(int8_t i)		{ stream()->writeBinary(i); }
+	inline void	write(int16_t i)	{ stream()->writeBinary(i); }
+	inline void	write(int32_t i)	{ stream()->writeBinary(i); }
+	inline void	write(int64_t i)	{ stream()->writeBinary(i); }
+	inline void	write(uint8_t i)	{ stream()->writeBinary(i); }
+	inline void	write(uint16_t i)	{ stream()->writeBinary(i); }
+	inline void	write(uint32_t i)	{ stream()->writeBinary(i); }
+	inline void	write(uint64_t i)	{ stream()->writeBinary(i); }
+	inline void	write(float f)		{ stream()->writeBinary(f); }
+	inline void	write(double f)		{ stream()->writeBinary(f); }
 	
 	bool	readArrayBegin(void);
 	bool	readArrayNext(void);
@@ -69,10 +75,55 @@ private:
 	void	writeArrayBegin(size_t size);
 	void	writeMapBegin(size_t size);
 	
+	// Contiguous buffer decoding, values are big-endian
+	template<typename T> bool readBuffer(T &value);
+	bool readBuffer(float &f);
+	bool readBuffer(double &f);
+	Stream *stream(void);	// throws if there is no stream
+	
   	Stream *mStream;
+	const char *mData;
+	size_t mSize, mPosition;
 	Stack<uint32_t> mLeft;
 };
 
+template<typename T>
+inline bool BinarySerializer::readBuffer(T &value)
+{
+	if(mSize - mPosition < sizeof(T)) return false;
+	
+	const uint8_t *p = reinterpret_cast<const uint8_t*>(mData + mPosition);
+	T v = 0;
+	for(size_t i = 0; i < sizeof(T); ++i)
+		v = T(v << 8) | T(p[i]);
+	
+	value = v;
+	mPosition+= sizeof(T);
+	return true;
+}
+
+inline bool BinarySerializer::readBuffer(float &f)
+{
+	if(mSize - mPosition < sizeof(f)) return false;
+	std::memcpy(&f, mData + mPosition, sizeof(f));	// written in native order
+	mPosition+= sizeof(f);
+	return true;
+}
+
+inline bool BinarySerializer::readBuffer(double &f)
+{
+	if(mSize - mPosition < sizeof(f)) return false;
+	std::memcpy(&f, mData + mPosition, sizeof(f));	// written in native order
+	mPosition+= sizeof(f);
+	return true;
+}
+
+inline Stream *BinarySerializer::stream(void)
+{
+	if(!mStream) throw Unsupported("Writing to read-only BinarySerializer");
+	return mStream;
+}
+
 }
 
 #endif
@@ -0,0 +1,146 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2013 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "pla/buffer.hpp"
+#include "pla/exception.hpp"
+
+namespace pla
+{
+
+Buffer::Buffer(void)
+{
+
+}
+
+Buffer::Buffer(const BinaryString &str) :
+	mData(std::make_shared<BinaryString>(str)),
+	mBegin(0),
+	mEnd(str.size())
+{
+
+}
+
+Buffer::Buffer(BinaryString &&str) :
+	mBegin(0),
+	mEnd(str.size())
+{
+	mData = std::make_shared<BinaryString>(std::move(str));
+}
+
+Buffer::Buffer(const char *data, size_t size) :
+	mData(std::make_shared<BinaryString>(data, size)),
+	mBegin(0),
+	mEnd(size)
+{
+
+}
+
+Buffer::Buffer(const Buffer &buffer) :
+	Stream(),
+	mData(buffer.mData),
+	mBegin(buffer.mBegin),
+	mEnd(buffer.mEnd)
+{
+
+}
+
+Buffer::Buffer(const Buffer &buffer, size_t offset, size_t size) :
+	mData(buffer.mData)
+{
+	offset = std::min(offset, buffer.size());
+	size = std::min(size, buffer.size() - offset);
+	mBegin = buffer.mBegin + offset;
+	mEnd = mBegin + size;
+}
+
+Buffer::~Buffer(void)
+{
+
+}
+
+Buffer &Buffer::operator=(const Buffer &buffer)
+{
+	mData = buffer.mData;
+	mBegin = buffer.mBegin;
+	mEnd = buffer.mEnd;
+	return *this;
+}
+
+const char *Buffer::data(void) const
+{
+	if(!mData) return NULL;
+	return mData->data() + mBegin;
+}
+
+const byte *Buffer::bytes(void) const
+{
+	return reinterpret_cast<const byte*>(data());
+}
+
+size_t Buffer::size(void) const
+{
+	return mEnd - mBegin;
+}
+
+bool Buffer::empty(void) const
+{
+	return mEnd == mBegin;
+}
+
+Buffer Buffer::slice(size_t offset, size_t size) const
+{
+	return Buffer(*this, offset, size);
+}
+
+BinaryString Buffer::toBinary(void) const
+{
+	if(empty()) return BinaryString();
+	return BinaryString(data(), size());
+}
+
+size_t Buffer::readData(char *buffer, size_t size)
+{
+	size = std::min(size, this->size());
+	if(!size) return 0;
+	std::copy(data(), data() + size, buffer);
+	mBegin+= size;
+	return size;
+}
+
+void Buffer::writeData(const char *data, size_t size)
+{
+	throw Unsupported("Writing to read-only buffer");
+}
+
+bool Buffer::ignore(size_t size)
+{
+	const size_t left = this->size();
+	mBegin+= std::min(size, left);
+	return size <= left;
+}
+
+void Buffer::clear(void)
+{
+	mData.reset();
+	mBegin = mEnd = 0;
+}
+
+}
@@ -0,0 +1,70 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2013 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef PLA_BUFFER_H
+#define PLA_BUFFER_H
+
+#include "pla/include.hpp"
+#include "pla/stream.hpp"
+#include "pla/binarystring.hpp"
+
+namespace pla
+{
+
+// Reference-counted buffer over immutable data, with a read cursor
+// Copies and slices share the data but each has its own cursor,
+// so reading only advances this instance and never modifies shared bytes
+class Buffer : public Stream
+{
+public:
+	Buffer(void);
+	Buffer(const BinaryString &str);		// data is copied once
+	Buffer(BinaryString &&str);			// data is moved
+	Buffer(const char *data, size_t size);	// data is copied once
+	Buffer(const Buffer &buffer);			// data is NOT copied
+	Buffer(const Buffer &buffer, size_t offset, size_t size = std::string::npos);	// slice, data is NOT copied
+	virtual ~Buffer(void);
+
+	Buffer &operator=(const Buffer &buffer);
+
+	const char *data(void) const;		// reading position
+	const byte *bytes(void) const;		// reading position
+	size_t size(void) const;		// data left
+	bool empty(void) const;
+
+	Buffer slice(size_t offset, size_t size = std::string::npos) const;
+	BinaryString toBinary(void) const;	// data is copied
+
+	// Stream
+	size_t readData(char *buffer, size_t size);
+	void writeData(const char *data, size_t size);	// throws, buffer is read-only
+	bool ignore(size_t size = 1);
+	void clear(void);
+
+private:
+	sptr<const BinaryString> mData;
+	size_t mBegin = 0;
+	size_t mEnd   = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "pla/bufferedstream.hpp"
+#include "pla/exception.hpp"
+
+namespace pla
+{
+
+BufferedStream::BufferedStream(Stream *stream, size_t bufferSize) :
+	mStream(stream),
+	mBufferSize(bufferSize),
+	mInputPos(0),
+	mInputEnd(0)
+{
+	Assert(mBufferSize > 0);
+}
+
+BufferedStream::~BufferedStream(void)
+{
+
+}
+
+void BufferedStream::reset(Stream *stream)
+{
+	mStream = stream;
+	mInputPos = mInputEnd = 0;
+	mOutput.clear();
+}
+
+size_t BufferedStream::readData(char *buffer, size_t size)
+{
+	Assert(mStream);
+
+	if(mInputPos == mInputEnd)
+	{
+		// The other end might be waiting for our output before sending more
+		flush();
+
+		// Large reads bypass the buffer
+		if(size >= mBufferSize)
+			return mStream->readData(buffer, size);
+
+		mInput.resize(mBufferSize);	// no-op once allocated
+		mInputEnd = mStream->readData(&mInput[0], mBufferSize);
+		mInputPos = 0;
+	}
+
+	size = std::min(size, mInputEnd - mInputPos);
+	std::memcpy(buffer, mInput.data() + mInputPos, size);
+	mInputPos+= size;
+	return size;
+}
+
+void BufferedStream::writeData(const char *data, size_t size)
+{
+	Assert(mStream);
+
+	if(mOutput.size() + size > mBufferSize)
+	{
+		flush();
+
+		// Large writes bypass the buffer
+		if(size >= mBufferSize)
+		{
+			mStream->writeData(data, size);
+			return;
+		}
+	}
+
+	mOutput.append(data, size);
+}
+
+bool BufferedStream::waitData(duration timeout)
+{
+	Assert(mStream);
+	if(mInputPos < mInputEnd) return true;
+	flush();
+	return mStream->waitData(timeout);
+}
+
+void BufferedStream::flush(void)
+{
+	Assert(mStream);
+	if(!mOutput.empty())
+	{
+		mStream->writeData(mOutput.data(), mOutput.size());
+		mOutput.clear();
+	}
+
+	mStream->flush();
+}
+
+void BufferedStream::close(void)
+{
+	Assert(mStream);
+	flush();
+	mStream->close();
+}
+
+}
@@ -0,0 +1,62 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef PLA_BUFFEREDSTREAM_H
+#define PLA_BUFFEREDSTREAM_H
+
+#include "pla/include.hpp"
+#include "pla/stream.hpp"
+
+namespace pla
+{
+
+// Read and write buffering over another stream
+// Output is held until flush(), until the buffer is full, or until more input is needed.
+// Buffers are kept across reset() so one instance can serve successive connections.
+class BufferedStream : public Stream
+{
+public:
+	static const size_t DefaultBufferSize = 16*1024;
+
+	BufferedStream(Stream *stream = NULL, size_t bufferSize = DefaultBufferSize);	// stream WON'T be destroyed
+	~BufferedStream(void);	// pending output is dropped, call flush() first
+
+	void reset(Stream *stream);	// pending data is dropped, memory is kept
+	Stream *stream(void) const	{ return mStream; }
+
+	// Stream
+	size_t readData(char *buffer, size_t size);
+	void writeData(const char *data, size_t size);
+	bool waitData(duration timeout);
+	void flush(void);
+	void close(void);
+
+private:
+	Stream *mStream;
+	size_t mBufferSize;
+	std::string mInput;
+	size_t mInputPos, mInputEnd;
+	std::string mOutput;
+};
+
+}
+
+#endif
@@ -286,6 +286,8 @@ void Sha512::pbkdf2_hmac(const BinaryString &secret, const BinaryString &salt, B
 		iterations);
 }
 
+const size_t Cipher::StagingSize = 64*1024;	// 64 KiB
+
 Cipher::Cipher(Stream *stream, bool mustDelete) :
 	mStream(stream),
 	mMustDelete(mustDelete),
@@ -293,6 +295,7 @@ Cipher::Cipher(Stream *stream, bool mustDelete) :
 	mWriteBlock(NULL),
 	mReadBlockSize(0),
 	mWriteBlockSize(0),
+	mReadBlockOffset(0),
 	mReadPosition(0),
 	mWritePosition(0)
 {
@@ -301,8 +304,8 @@ Cipher::Cipher(Stream *stream, bool mustDelete) :
 
 Cipher::~Cipher(void)
 {
-	delete mReadBlock;
-	delete mWriteBlock;
+	delete[] mReadBlock;
+	delete[] mWriteBlock;
 
 	if(mMustDelete)
 		delete mStream;
@@ -310,37 +313,51 @@ Cipher::~Cipher(void)
 
 size_t Cipher::readData(char *buffer, size_t size)
 {
-	if(!mReadBlock)
-		mReadBlock = new char[blockSize()];
-
-	if(!mReadBlockSize)
+	if(mReadBlockOffset == mReadBlockSize)
 	{
-		mReadBlockSize = mStream->readBinary(mReadBlock, blockSize());
+		mReadBlockSize = 0;
+		mReadBlockOffset = 0;
+
+		// Large reads are decrypted in place in the caller's buffer
+		if(size >= stagingSize())
+		{
+			size_t direct = size - size % blockSize();
+			size = size_t(mStream->readBinary(buffer, direct));
+			decryptBlock(buffer, size);
+			mReadPosition+= size;
+			return size;
+		}
+
+		if(!mReadBlock)
+			mReadBlock = new char[stagingSize()];
+
+		mReadBlockSize = size_t(mStream->readBinary(mReadBlock, stagingSize()));
 		if(!mReadBlockSize) return 0;
 		decryptBlock(mReadBlock, mReadBlockSize);
 	}
 
-	size = std::min(size, mReadBlockSize);
-	std::memcpy(buffer, mReadBlock, size);
-	mReadBlockSize-= size;
-	std::memmove(mReadBlock, mReadBlock+size, mReadBlockSize);
+	size = std::min(size, mReadBlockSize - mReadBlockOffset);
+	std::memcpy(buffer, mReadBlock + mReadBlockOffset, size);
+	mReadBlockOffset+= size;
+	mReadPosition+= size;
 	return size;
 }
 
 void Cipher::writeData(const char *data, size_t size)
 {
 	if(!mWriteBlock)
-		mWriteBlock = new char[blockSize()];
+		mWriteBlock = new char[stagingSize()];
 
+	mWritePosition+= size;
 	while(size)
 	{
-		 size_t len = std::min(blockSize() - mWriteBlockSize, size);
+		 size_t len = std::min(stagingSize() - mWriteBlockSize, size);
 		 std::memcpy(mWriteBlock + mWriteBlockSize, data, len);
 		 mWriteBlockSize+= len;
 		 data+= len;
 		 size-= len;
 
-		 if(mWriteBlockSize == blockSize())
+		 if(mWriteBlockSize == stagingSize())
 		 {
 		 	encryptBlock(mWriteBlock, mWriteBlockSize);
 		 	mStream->writeBinary(mWriteBlock, mWriteBlockSize);
@@ -369,6 +386,12 @@ int64_t Cipher::tellWrite(void) const
 	return mWritePosition;
 }
 
+size_t Cipher::stagingSize(void) const
+{
+	// Spans must stay aligned on cipher blocks
+	return std::max(StagingSize - StagingSize % blockSize(), blockSize());
+}
+
 void Cipher::close(void)
 {
 	// Finish encryption
@@ -473,16 +496,29 @@ size_t AesGcm::blockSize(void) const
 
 void AesGcm::encryptBlock(char *block, size_t size)
 {
+	// Authenticated data is interleaved block by block, keep it so for compatibility
 	uint8_t *ptr = reinterpret_cast<uint8_t*>(block);
-	gcm_aes_update (&mCtx, size, ptr);
-	gcm_aes_encrypt(&mCtx, size, ptr, ptr);
+	while(size)
+	{
+		size_t len = std::min(size, size_t(GCM_BLOCK_SIZE));
+		gcm_aes_update (&mCtx, len, ptr);
+		gcm_aes_encrypt(&mCtx, len, ptr, ptr);
+		ptr+= len;
+		size-= len;
+	}
 }
 
 void AesGcm::decryptBlock(char *block, size_t size)
 {
 	uint8_t *ptr = reinterpret_cast<uint8_t*>(block);
-	gcm_aes_update(&mCtx, size, ptr);
-	gcm_aes_decrypt(&mCtx, size, ptr, ptr);
+	while(size)
+	{
+		size_t len = std::min(size, size_t(GCM_BLOCK_SIZE));
+		gcm_aes_update(&mCtx, len, ptr);
+		gcm_aes_decrypt(&mCtx, len, ptr, ptr);
+		ptr+= len;
+		size-= len;
+	}
 }
 
 Rsa::PublicKey::PublicKey(void)
@@ -137,6 +137,8 @@ private:
 class Cipher : public Stream
 {
 public:
+	static const size_t StagingSize;	// data is transformed in spans of this size
+
 	Cipher(Stream *stream, bool mustDelete = false);
 	virtual ~Cipher(void);
 
@@ -155,16 +157,21 @@ public:
 	void close(void);
 
 protected:
+	// encryptBlock() and decryptBlock() transform in place any multiple of blockSize(),
+	// or a shorter final span at the end of the stream
 	virtual size_t blockSize(void) const = 0;
 	virtual void encryptBlock(char *block, size_t size) = 0;
 	virtual void decryptBlock(char *block, size_t size) = 0;
 
 private:
+	size_t stagingSize(void) const;
+
 	Stream *mStream;
 	bool mMustDelete;
 
 	char *mReadBlock, *mWriteBlock;
 	size_t mReadBlockSize, mWriteBlockSize;
+	size_t mReadBlockOffset;
 	uint64_t mReadPosition, mWritePosition;
 };
 
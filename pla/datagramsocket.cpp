@@ -23,27 +23,42 @@
 #include "pla/exception.hpp"
 #include "pla/string.hpp"
 #include "pla/time.hpp"
+#include "pla/poller.hpp"
 
 namespace pla
 {
 
 const size_t DatagramSocket::MaxDatagramSize = 1500;
+const int DatagramSocket::RecvBatchSize = 32;
+const int DatagramSocket::MaxPendingSize = 256;
+std::atomic<int> DatagramSocket::ReceiveBufferSize(4*1024*1024);	// 4 MiB
 
 DatagramSocket::DatagramSocket(int port, bool broadcast) :
-		mSock(INVALID_SOCKET)
+		mSock(INVALID_SOCKET),
+		mDroppedCount(0)
 {
+	initRing();
 	bind(port, broadcast);
 }
 
 DatagramSocket::DatagramSocket(const Address &local, bool broadcast) :
-		mSock(INVALID_SOCKET)
+		mSock(INVALID_SOCKET),
+		mDroppedCount(0)
 {
+	initRing();
 	bind(local, broadcast);
 }
 
 DatagramSocket::~DatagramSocket(void)
 {
 	NOEXCEPTION(close());
+
+#ifdef LINUX
+	delete[] mRingBuffer;
+	delete[] mRingHeaders;
+	delete[] mRingIovecs;
+	delete[] mRingAddrs;
+#endif
 }
 
 Address DatagramSocket::getBindAddress(void) const
@@ -258,6 +273,8 @@ void DatagramSocket::bind(int port, bool broadcast, int family)
 		int disabled = 0;
 		setsockopt(mSock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char*>(&enabled), sizeof(enabled));
 		if(broadcast) setsockopt(mSock, SOL_SOCKET, SO_BROADCAST, reinterpret_cast<char*>(&enabled), sizeof(enabled));
+		int bufferSize = ReceiveBufferSize;
+		setsockopt(mSock, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<char*>(&bufferSize), sizeof(bufferSize));
 		if(ai->ai_family == AF_INET6)
 			setsockopt(mSock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<char*>(&disabled), sizeof(disabled));
 
@@ -305,6 +322,8 @@ void DatagramSocket::bind(const Address &local, bool broadcast)
 		int enabled = 1;
 		setsockopt(mSock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char*>(&enabled), sizeof(enabled));
 		if(broadcast) setsockopt(mSock, SOL_SOCKET, SO_BROADCAST, reinterpret_cast<char*>(&enabled), sizeof(enabled));
+		int bufferSize = ReceiveBufferSize;
+		setsockopt(mSock, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<char*>(&bufferSize), sizeof(bufferSize));
 
 		// Bind it
 		if(::bind(mSock, local.addr(), local.addrLen()) != 0)
@@ -339,6 +358,7 @@ void DatagramSocket::close(void)
 		}
 
 	mStreams.clear();
+	mPending.clear();
 
 	if(mSock != INVALID_SOCKET)
 	{
@@ -395,15 +415,12 @@ void DatagramSocket::write(Stream &stream, const Address &receiver)
 
 bool DatagramSocket::wait(duration timeout)
 {
-	fd_set readfds;
-	FD_ZERO(&readfds);
-	FD_SET(mSock, &readfds);
+	return (Poller::Wait(mSock, Poller::Read, timeout) != 0);
+}
 
-	struct timeval tv;
-	durationToStruct(timeout, tv);
-	int ret = ::select(SOCK_TO_INT(mSock)+1, &readfds, NULL, NULL, &tv);
-	if (ret < 0) throw Exception("Unable to wait on socket");
-	return (ret > 0);
+uint64_t DatagramSocket::droppedCount(void) const
+{
+	return mDroppedCount;
 }
 
 int DatagramSocket::recv(char *buffer, size_t size, Address &sender, duration timeout, int flags)
@@ -414,47 +431,124 @@ int DatagramSocket::recv(char *buffer, size_t size, Address &sender, duration ti
 	else end = std::chrono::time_point<clock>::max();
 
 	do {
-		duration left = end - std::chrono::steady_clock::now();
+		{
+			// Datagrams from unmapped senders are kept pending for read() and peek()
+			std::unique_lock<std::mutex> lock(mStreamsMutex);
+			if(!mPending.empty())
+			{
+				auto &front = mPending.front();
+				sender = front.first;
+				size = std::min(size, size_t(front.second.size()));
+				std::memcpy(buffer, front.second.data(), size);
+
+				if(!(flags & MSG_PEEK))
+					mPending.pop_front();
+				return int(size);
+			}
+		}
+
+		duration left = std::max(duration(end - std::chrono::steady_clock::now()), duration::zero());
 		if(!wait(left)) break;
 
+#ifdef LINUX
+		// Fast path: receive a whole batch in one syscall and demultiplex it in a single pass
+		std::unique_lock<std::mutex> ringLock(mRingMutex);
+
+		for(int i = 0; i < RecvBatchSize; ++i)
+			mRingHeaders[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+
+		int count = ::recvmmsg(mSock, mRingHeaders, RecvBatchSize, MSG_DONTWAIT, NULL);
+		if(count < 0)
+		{
+			if(sockerrno == SEAGAIN || sockerrno == SEWOULDBLOCK || sockerrno == EINTR) continue;
+			throw NetException("Unable to read from socket (error " + String::number(sockerrno) + ")");
+		}
+
+		std::unique_lock<std::mutex> lock(mStreamsMutex);
+		for(int i = 0; i < count; ++i)
+		{
+			Address source(reinterpret_cast<sockaddr*>(&mRingAddrs[i]), mRingHeaders[i].msg_hdr.msg_namelen);
+			dispatch(source, mRingBuffer + i*MaxDatagramSize, size_t(mRingHeaders[i].msg_len));
+		}
+#else
 		char datagramBuffer[MaxDatagramSize];
 		sockaddr_storage sa;
 		socklen_t sl = sizeof(sa);
-		int result = ::recvfrom(mSock, datagramBuffer, MaxDatagramSize, flags | MSG_PEEK, reinterpret_cast<sockaddr*>(&sa), &sl);
+		int result = ::recvfrom(mSock, datagramBuffer, MaxDatagramSize, 0, reinterpret_cast<sockaddr*>(&sa), &sl);
 		if(result < 0) throw NetException("Unable to read from socket (error " + String::number(sockerrno) + ")");
-		sender.set(reinterpret_cast<sockaddr*>(&sa),sl);
 
 		std::unique_lock<std::mutex> lock(mStreamsMutex);
-		auto it = mStreams.find(sender.unmap());
-		if(it == mStreams.end())
-		{
-			size = std::min(result, int(size));
-			std::memcpy(buffer, datagramBuffer, size);
+		dispatch(Address(reinterpret_cast<sockaddr*>(&sa), sl), datagramBuffer, size_t(result));
+#endif
+	}
+	while(std::chrono::steady_clock::now() <= end);
 
-			if(!(flags & MSG_PEEK))
-				::recvfrom(mSock, datagramBuffer, MaxDatagramSize, flags, reinterpret_cast<sockaddr*>(&sa), &sl);
-			return size;
-		}
+	return -1;
+}
 
-		BinaryString tmp(datagramBuffer, size_t(result));
-		for(auto jt = it->second.begin(); jt != it->second.end(); ++jt)
-		{
-			DatagramStream *stream = *jt;
-			Assert(stream);
-			std::unique_lock<std::mutex> lock(stream->mMutex);
+void DatagramSocket::dispatch(const Address &sender, const char *data, size_t size)
+{
+	auto it = mStreams.find(sender.unmap());
+	if(it == mStreams.end())
+	{
+		if(mPending.size() < size_t(MaxPendingSize))
+			mPending.push_back(std::make_pair(sender, BinaryString(data, size)));
+		else drop();
+		return;
+	}
 
-			if(stream->mIncoming.size() < DatagramStream::MaxQueueSize)
-				stream->mIncoming.push(tmp);
+	BinaryString tmp(data, size);
+	for(auto jt = it->second.begin(); jt != it->second.end(); ++jt)
+	{
+		DatagramStream *stream = *jt;
+		Assert(stream);
+		std::unique_lock<std::mutex> lock(stream->mMutex);
 
-			lock.unlock();
-			stream->mCondition.notify_all();
+		// Drop the datagram if the stream is lagging too far behind
+		if(stream->mQueuedSize + size > DatagramStream::MaxQueueSize)
+		{
+			drop();
+			continue;
 		}
 
-		::recvfrom(mSock, datagramBuffer, MaxDatagramSize, flags & ~MSG_PEEK, reinterpret_cast<sockaddr*>(&sa), &sl);
+		// Readers only wait on an empty queue, so only the first datagram needs a wakeup
+		bool wasEmpty = stream->mIncoming.empty();
+		stream->mQueuedSize+= size;
+		if(std::next(jt) == it->second.end()) stream->mIncoming.push(std::move(tmp));
+		else stream->mIncoming.push(tmp);
+
+		lock.unlock();
+		if(wasEmpty) stream->mCondition.notify_all();
 	}
-	while(std::chrono::steady_clock::now() <= end);
+}
 
-	return -1;
+void DatagramSocket::drop(void)
+{
+	// Log the first drop, then every 1024 so overload stays visible without flooding
+	uint64_t count = ++mDroppedCount;
+	if(count == 1 || count % 1024 == 0)
+		LogWarn("DatagramSocket", "Dropped " + String::number(count) + " datagrams");
+}
+
+void DatagramSocket::initRing(void)
+{
+#ifdef LINUX
+	mRingBuffer = new char[RecvBatchSize*MaxDatagramSize];
+	mRingHeaders = new struct mmsghdr[RecvBatchSize];
+	mRingIovecs = new struct iovec[RecvBatchSize];
+	mRingAddrs = new sockaddr_storage[RecvBatchSize];
+
+	std::memset(mRingHeaders, 0, RecvBatchSize*sizeof(struct mmsghdr));
+	for(int i = 0; i < RecvBatchSize; ++i)
+	{
+		mRingIovecs[i].iov_base = mRingBuffer + i*MaxDatagramSize;
+		mRingIovecs[i].iov_len = MaxDatagramSize;
+		mRingHeaders[i].msg_hdr.msg_iov = &mRingIovecs[i];
+		mRingHeaders[i].msg_hdr.msg_iovlen = 1;
+		mRingHeaders[i].msg_hdr.msg_name = &mRingAddrs[i];
+		mRingHeaders[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+	}
+#endif
 }
 
 void DatagramSocket::send(const char *buffer, size_t size, const Address &receiver, int flags)
@@ -483,6 +577,26 @@ void DatagramSocket::registerStream(DatagramStream *stream)
 
 	std::unique_lock<std::mutex> lock(mStreamsMutex);
 	mStreams[addr].insert(stream);
+
+	// Hand over datagrams received before the stream was mapped
+	std::unique_lock<std::mutex> streamLock(stream->mMutex);
+	auto it = mPending.begin();
+	while(it != mPending.end())
+	{
+		if(it->first.unmap() == addr)
+		{
+			if(stream->mQueuedSize + it->second.size() <= DatagramStream::MaxQueueSize)
+			{
+				stream->mQueuedSize+= it->second.size();
+				stream->mIncoming.push(std::move(it->second));
+			}
+			else drop();
+			it = mPending.erase(it);
+		}
+		else ++it;
+	}
+	streamLock.unlock();
+	stream->mCondition.notify_all();
 }
 
 void DatagramSocket::unregisterStream(DatagramStream *stream)
@@ -497,10 +611,12 @@ void DatagramSocket::unregisterStream(DatagramStream *stream)
 }
 
 duration DatagramStream::DefaultTimeout = seconds(60.); // 1 min
-int DatagramStream::MaxQueueSize = 100;
+std::atomic<size_t> DatagramStream::MaxQueueSize(4*1024*1024);	// 4 MiB
 
 DatagramStream::DatagramStream(void) :
 	mSock(NULL),
+	mShutdown(false),
+	mQueuedSize(0),
 	mOffset(0),
 	mTimeout(DefaultTimeout)
 {
@@ -509,7 +625,9 @@ DatagramStream::DatagramStream(void) :
 
 DatagramStream::DatagramStream(DatagramSocket *sock, const Address &addr) :
 	mSock(sock),
+	mShutdown(false),
 	mAddr(addr),
+	mQueuedSize(0),
 	mOffset(0),
 	mTimeout(DefaultTimeout)
 {
@@ -557,7 +675,7 @@ void DatagramStream::writeData(const char *data, size_t size)
 {
 	std::unique_lock<std::mutex> lock(mMutex);
 
-	if(!mSock) throw NetException("Datagram stream closed");
+	if(!mSock || mShutdown) throw NetException("Datagram stream closed");
 	mBuffer.writeData(data, size);
 }
 
@@ -565,14 +683,14 @@ bool DatagramStream::waitData(duration timeout)
 {
 	std::unique_lock<std::mutex> lock(mMutex);
 
-	if(mSock && mIncoming.empty())
+	if(mSock && !mShutdown && mIncoming.empty())
 	{
 		this->mCondition.wait_for(lock, timeout, [this]() {
-			return (!mSock || !this->mIncoming.empty());
+			return (!mSock || mShutdown || !this->mIncoming.empty());
 		});
 	}
 
-	return (!mSock || !mIncoming.empty());
+	return (!mSock || mShutdown || !mIncoming.empty());
 }
 
 bool DatagramStream::nextRead(void)
@@ -580,6 +698,7 @@ bool DatagramStream::nextRead(void)
 	std::unique_lock<std::mutex> lock(mMutex);
 
 	if(mIncoming.empty()) return false;
+	mQueuedSize-= mIncoming.front().size();
 	mIncoming.pop();
 	mOffset = 0;
 	return true;
@@ -587,8 +706,21 @@ bool DatagramStream::nextRead(void)
 
 bool DatagramStream::nextWrite(void)
 {
-	mSock->write(mBuffer.data(), mBuffer.size(), mAddr);
-	mBuffer.clear();
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	if(!mSock || mShutdown)
+	{
+		mBuffer.clear();
+		throw NetException("Datagram stream closed");
+	}
+
+	// The socket outlives its streams, so it can be used without the lock
+	DatagramSocket *sock = mSock;
+	BinaryString buffer;
+	std::swap(buffer, mBuffer);
+	lock.unlock();
+
+	sock->write(buffer.data(), buffer.size(), mAddr);
 	return true;
 }
 
@@ -599,6 +731,7 @@ void DatagramStream::close(void)
 	if(mSock)
 	{
 		while(!mIncoming.empty()) mIncoming.pop();
+		mQueuedSize = 0;
 		mSock->unregisterStream(this);
 		mSock = NULL;
 	}
@@ -606,6 +739,16 @@ void DatagramStream::close(void)
 	mCondition.notify_all();
 }
 
+void DatagramStream::shutdown(void)
+{
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mShutdown = true;
+	}
+
+	mCondition.notify_all();
+}
+
 bool DatagramStream::isDatagram(void) const
 {
 	return true;
@@ -27,6 +27,9 @@
 #include "pla/stream.hpp"
 #include "pla/set.hpp"
 #include "pla/map.hpp"
+#include "pla/binarystring.hpp"
+
+#include <atomic>
 
 namespace pla
 {
@@ -37,6 +40,9 @@ class DatagramSocket
 {
 public:
 	static const size_t MaxDatagramSize;
+	static const int RecvBatchSize;
+	static const int MaxPendingSize;
+	static std::atomic<int> ReceiveBufferSize;	// SO_RCVBUF, applied on bind
 
 	DatagramSocket(int port = 0, bool broadcast = false);
 	DatagramSocket(const Address &local, bool broadcast = false);
@@ -59,6 +65,7 @@ public:
 	void write(Stream &stream, const Address &receiver);
 
 	bool wait(duration timeout);
+	uint64_t droppedCount(void) const;
 
 	void accept(DatagramStream &stream);
 	void registerStream(DatagramStream *stream);
@@ -67,20 +74,34 @@ public:
 private:
 	int recv(char *buffer, size_t size, Address &sender, duration timeout, int flags);
 	void send(const char *buffer, size_t size, const Address &receiver, int flags);
+	void dispatch(const Address &sender, const char *data, size_t size);	// mStreamsMutex must be locked
+	void drop(void);
+	void initRing(void);
 
 	socket_t mSock;
 	int mPort;
 
 	// Mapped streams
 	Map<Address, Set<DatagramStream*> > mStreams;
+	std::list<std::pair<Address, BinaryString> > mPending;	// datagrams for unmapped senders
 	std::mutex mStreamsMutex;
+	std::atomic<uint64_t> mDroppedCount;
+
+#ifdef LINUX
+	// Pre-allocated ring for recvmmsg()
+	char *mRingBuffer;
+	struct mmsghdr *mRingHeaders;
+	struct iovec *mRingIovecs;
+	sockaddr_storage *mRingAddrs;
+	std::mutex mRingMutex;
+#endif
 };
 
 class DatagramStream : public Stream
 {
 public:
 	static duration DefaultTimeout;
-	static int MaxQueueSize;
+	static std::atomic<size_t> MaxQueueSize;	// bytes queued per stream before dropping
 
 	DatagramStream(void);
 	DatagramStream(DatagramSocket *sock, const Address &addr);
@@ -98,13 +119,16 @@ public:
 	bool nextRead(void);
 	bool nextWrite(void);
 	void close(void);
+	void shutdown(void);
 	bool isDatagram(void) const;
 
 private:
 	DatagramSocket *mSock;
+	bool mShutdown;
 	Address mAddr;
 	BinaryString mBuffer;
 	Queue<BinaryString> mIncoming;
+	size_t mQueuedSize;
 	size_t mOffset;
 	duration mTimeout;
 
@@ -0,0 +1,83 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2016 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "pla/digest.hpp"
+#include "pla/string.hpp"
+#include "pla/exception.hpp"
+
+namespace pla
+{
+
+static_assert(std::is_trivially_copyable<Digest>::value && sizeof(Digest) == Digest::Size, "Digest must be a plain 32-byte value");
+
+const Digest Digest::Empty;
+
+Digest::Digest(const BinaryString &str) :
+	Digest(str.data(), str.size())
+{
+
+}
+
+Digest::Digest(const char *data, size_t size) :
+	Digest()
+{
+	if(size == 0) return;
+	if(size != Size) throw InvalidData("Invalid digest size: " + String::number(unsigned(size)));
+
+	const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+	for(int i=0; i<4; ++i)
+	{
+		uint64_t w = 0;
+		for(int j=0; j<8; ++j)
+			w = (w << 8) | bytes[i*8 + j];
+		mWords[i] = w;
+	}
+}
+
+void Digest::copy(char *data) const
+{
+	uint8_t *bytes = reinterpret_cast<uint8_t*>(data);
+	for(int i=0; i<4; ++i)
+	{
+		uint64_t w = mWords[i];
+		for(int j=7; j>=0; --j)
+		{
+			bytes[i*8 + j] = uint8_t(w);
+			w>>= 8;
+		}
+	}
+}
+
+BinaryString Digest::toBinary(void) const
+{
+	if(empty()) return BinaryString();
+
+	BinaryString result(Size, '\0');
+	copy(result.ptr());
+	return result;
+}
+
+String Digest::toString(void) const
+{
+	return toBinary().toString();
+}
+
+}
@@ -0,0 +1,102 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2016 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef PLA_DIGEST_H
+#define PLA_DIGEST_H
+
+#include "pla/include.hpp"
+#include "pla/binarystring.hpp"
+
+#include <functional>
+
+namespace pla
+{
+
+class String;
+
+// Fixed-size 256-bit identifier, used for node identifiers and digests.
+// Bytes are held as four big-endian words so that word-wise comparison
+// matches the byte order of the equivalent BinaryString.
+// A null identifier stands for an empty BinaryString.
+class Digest
+{
+public:
+	static const size_t Size = 32;
+	static const Digest Empty;
+
+	constexpr Digest(void) : mWords{0, 0, 0, 0} {}
+	explicit Digest(const BinaryString &str);	// throws InvalidData if size is not 0 or Size
+	Digest(const char *data, size_t size);
+
+	constexpr bool empty(void) const { return !(mWords[0] | mWords[1] | mWords[2] | mWords[3]); }
+	constexpr size_t hash(void) const { return size_t(mWords[0] ^ mWords[1] ^ mWords[2] ^ mWords[3]); }
+
+	void copy(char *data) const;	// writes Size bytes
+	BinaryString toBinary(void) const;
+	String toString(void) const;
+	explicit operator BinaryString(void) const { return toBinary(); }
+
+	friend constexpr bool operator == (const Digest &a, const Digest &b)
+	{
+		return a.mWords[0] == b.mWords[0] && a.mWords[1] == b.mWords[1]
+			&& a.mWords[2] == b.mWords[2] && a.mWords[3] == b.mWords[3];
+	}
+
+	friend constexpr bool operator != (const Digest &a, const Digest &b) { return !(a == b); }
+	friend constexpr bool operator <  (const Digest &a, const Digest &b) { return Compare(a, b) < 0; }
+	friend constexpr bool operator >  (const Digest &a, const Digest &b) { return Compare(a, b) > 0; }
+	friend constexpr bool operator <= (const Digest &a, const Digest &b) { return Compare(a, b) <= 0; }
+	friend constexpr bool operator >= (const Digest &a, const Digest &b) { return Compare(a, b) >= 0; }
+
+	// XOR distance
+	friend constexpr Digest operator ^ (const Digest &a, const Digest &b)
+	{
+		return Digest(a.mWords[0] ^ b.mWords[0], a.mWords[1] ^ b.mWords[1],
+			a.mWords[2] ^ b.mWords[2], a.mWords[3] ^ b.mWords[3]);
+	}
+
+private:
+	constexpr Digest(uint64_t w0, uint64_t w1, uint64_t w2, uint64_t w3) : mWords{w0, w1, w2, w3} {}
+
+	static constexpr int Compare(const Digest &a, const Digest &b, int i = 0)
+	{
+		return i == 4 ? 0
+			: a.mWords[i] < b.mWords[i] ? -1
+			: a.mWords[i] > b.mWords[i] ? 1
+			: Compare(a, b, i + 1);
+	}
+
+	uint64_t mWords[4];
+};
+
+}
+
+namespace std
+{
+
+template<> struct hash<pla::Digest>
+{
+	size_t operator()(const pla::Digest &d) const { return d.hash(); }	// digests are uniformly distributed
+};
+
+}
+
+#endif
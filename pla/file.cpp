@@ -78,6 +78,13 @@ pla::Time File::Time(const String &filename)
 	return pla::Time(st.st_mtime);
 }
 
+uint64_t File::Inode(const String &filename)
+{
+	stat_t st;
+	if(pla::stat(filename.pathEncode().c_str(), &st)) throw Exception("File does not exist: "+filename);
+	return uint64_t(st.st_ino);
+}
+
 String File::TempName(void)
 {
 	String tempPath = TempPath();
@@ -45,6 +45,7 @@ public:
 	static void Rename(const String &source, const String &destination);
 	static uint64_t Size(const String &filename);
 	static pla::Time Time(const String &filename);
+	static uint64_t Inode(const String &filename);	// throws if the file does not exist, 0 if the filesystem has no inode numbers
 	static String TempName(void);
 	static void CleanTemp(void);
 	
@@ -0,0 +1,174 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2016 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef PLA_HASHMAP_H
+#define PLA_HASHMAP_H
+
+#include "pla/include.hpp"
+#include "pla/exception.hpp"
+#include "pla/hashtable.hpp"
+
+#include <vector>
+#include <list>
+#include <set>
+
+namespace pla
+{
+
+template<typename K, typename V>
+struct HashMapKeyOf
+{
+	const K &operator()(const std::pair<const K, V> &p) const { return p.first; }
+};
+
+// Unordered counterpart of Map, for lookup tables which are never iterated in order
+template<typename K, typename V, typename H = KeyHash, typename E = KeyEqual>
+class HashMap : public HashTable<K, std::pair<const K, V>, HashMapKeyOf<K, V>, H, E>
+{
+public:
+	typedef HashTable<K, std::pair<const K, V>, HashMapKeyOf<K, V>, H, E> Table;
+	typedef V mapped_type;
+	typedef typename Table::iterator iterator;
+	typedef typename Table::const_iterator const_iterator;
+
+	using Table::insert;
+	iterator insert(const K &key, const V &value);
+	template<typename Q> V &operator[](const Q &key);
+	template<typename Q> bool get(const Q &key, V &value) const;
+	template<typename Q> const V &get(const Q &key) const;
+	template<typename Q> V &get(const Q &key);
+	template<typename Q> const V &getOrDefault(const Q &key, const V &defaultValue) const;
+
+	int getKeys(std::set<K> &set) const;
+	int getKeys(std::vector<K> &array) const;
+	int getKeys(std::list<K> &list) const;
+	int getValues(std::vector<V> &array) const;
+	int getValues(std::list<V> &list) const;
+};
+
+template<typename K, typename V, typename H, typename E>
+typename HashMap<K,V,H,E>::iterator HashMap<K,V,H,E>::insert(const K &key, const V &value)
+{
+	// Same semantics as Map::insert, an existing value is kept
+	return this->emplace(key, key, value).first;
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+V &HashMap<K,V,H,E>::operator[](const Q &key)
+{
+	iterator it = this->find(key);
+	if(it != this->end()) return it->second;
+	return this->emplace(key, K(key), V()).first->second;
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+bool HashMap<K,V,H,E>::get(const Q &key, V &value) const
+{
+	const_iterator it = this->find(key);
+	if(it == this->end()) return false;
+	value = it->second;
+	return true;
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+const V &HashMap<K,V,H,E>::get(const Q &key) const
+{
+	const_iterator it = this->find(key);
+	if(it == this->end()) throw OutOfBounds("Map key does not exist");
+	return it->second;
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+V &HashMap<K,V,H,E>::get(const Q &key)
+{
+	iterator it = this->find(key);
+	if(it == this->end()) throw OutOfBounds("Map key does not exist");
+	return it->second;
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename Q>
+const V &HashMap<K,V,H,E>::getOrDefault(const Q &key, const V &defaultValue) const
+{
+	const_iterator it = this->find(key);
+	if(it == this->end()) return defaultValue;
+	return it->second;
+}
+
+template<typename K, typename V, typename H, typename E>
+int HashMap<K,V,H,E>::getKeys(std::set<K> &set) const
+{
+	set.clear();
+	for(const auto &p : *this)
+		set.insert(p.first);
+
+	return set.size();
+}
+
+template<typename K, typename V, typename H, typename E>
+int HashMap<K,V,H,E>::getKeys(std::vector<K> &array) const
+{
+	array.clear();
+	array.reserve(this->size());
+	for(const auto &p : *this)
+		array.push_back(p.first);
+
+	return array.size();
+}
+
+template<typename K, typename V, typename H, typename E>
+int HashMap<K,V,H,E>::getKeys(std::list<K> &list) const
+{
+	list.clear();
+	for(const auto &p : *this)
+		list.push_back(p.first);
+
+	return list.size();
+}
+
+template<typename K, typename V, typename H, typename E>
+int HashMap<K,V,H,E>::getValues(std::vector<V> &array) const
+{
+	array.clear();
+	array.reserve(this->size());
+	for(const auto &p : *this)
+		array.push_back(p.second);
+
+	return array.size();
+}
+
+template<typename K, typename V, typename H, typename E>
+int HashMap<K,V,H,E>::getValues(std::list<V> &list) const
+{
+	list.clear();
+	for(const auto &p : *this)
+		list.push_back(p.second);
+
+	return list.size();
+}
+
+}
+
+#endif
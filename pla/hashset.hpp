@@ -0,0 +1,48 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2016 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef PLA_HASHSET_H
+#define PLA_HASHSET_H
+
+#include "pla/include.hpp"
+#include "pla/hashtable.hpp"
+
+namespace pla
+{
+
+template<typename T>
+struct HashSetKeyOf
+{
+	const T &operator()(const T &value) const { return value; }
+};
+
+// Unordered counterpart of Set
+template<typename T, typename H = KeyHash, typename E = KeyEqual>
+class HashSet : public HashTable<T, T, HashSetKeyOf<T>, H, E>
+{
+public:
+	template<typename Q> bool remove(const Q &value) { return this->erase(value) == 1; }
+	void insertAll(const HashSet &set) { for(const T &value : set) this->insert(value); }
+};
+
+}
+
+#endif
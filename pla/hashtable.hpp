@@ -0,0 +1,430 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2016 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef PLA_HASHTABLE_H
+#define PLA_HASHTABLE_H
+
+#include "pla/include.hpp"
+#include "pla/exception.hpp"
+#include "pla/stringview.hpp"
+
+#include <functional>
+#include <string>
+#include <cstring>
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace pla
+{
+
+// Hash functor, string-like keys share the same hash so that a String key
+// can be looked up with a const char*, a std::string or a StringView without conversion
+struct KeyHash
+{
+	template<typename T> struct IsString
+	{
+		static const bool value = std::is_convertible<const T&, const std::string&>::value
+			|| std::is_convertible<const T&, const char*>::value
+			|| std::is_same<T, StringView>::value;
+	};
+
+	size_t operator()(const std::string &str) const { return Bytes(str.data(), str.size()); }
+	size_t operator()(const char *str) const { return Bytes(str, std::strlen(str)); }
+	size_t operator()(const StringView &str) const { return Bytes(str.data(), str.size()); }
+
+	template<typename T, typename = typename std::enable_if<!IsString<T>::value>::type>
+	size_t operator()(const T &value) const { return size_t(Mix(uint64_t(std::hash<T>()(value)))); }
+
+	static inline uint64_t Mix(uint64_t h)
+	{
+		h^= h >> 33;
+		h*= 0xff51afd7ed558ccdULL;
+		h^= h >> 33;
+		h*= 0xc4ceb9fe1a85ec53ULL;
+		h^= h >> 33;
+		return h;
+	}
+
+	static inline size_t Bytes(const char *data, size_t size)
+	{
+		const uint64_t k = 0x9e3779b97f4a7c15ULL;
+		uint64_t h = k ^ size;
+		while(size >= 8)
+		{
+			uint64_t w;
+			std::memcpy(&w, data, 8);
+			h = (h ^ Mix(w)) * k;
+			data+= 8;
+			size-= 8;
+		}
+
+		uint64_t w = 0;
+		std::memcpy(&w, data, size);
+		return size_t(Mix(h ^ w));
+	}
+};
+
+struct KeyEqual
+{
+	template<typename A, typename B>
+	bool operator()(const A &a, const B &b) const { return a == b; }
+};
+
+// Open-addressing hash table with one control byte per slot, probed 16 at a time.
+// A control byte holds 7 bits of the hash for a full slot, or Empty/Deleted.
+// Erasing leaves a tombstone, so iterators stay valid until the next insertion.
+template<typename K, typename T, typename KeyOf, typename H = KeyHash, typename E = KeyEqual>
+class HashTable
+{
+public:
+	typedef K key_type;
+	typedef T value_type;
+	typedef size_t size_type;
+
+	template<typename P, typename R>
+	class basic_iterator
+	{
+	public:
+		basic_iterator(void) : mTable(NULL), mIndex(0) {}
+		basic_iterator(P table, size_t index) : mTable(table), mIndex(index) { skip(); }
+		template<typename P2, typename R2> basic_iterator(const basic_iterator<P2, R2> &it) : mTable(it.mTable), mIndex(it.mIndex) {}
+
+		R &operator*(void) const { return mTable->mSlots[mIndex]; }
+		R *operator->(void) const { return &mTable->mSlots[mIndex]; }
+		basic_iterator &operator++(void) { ++mIndex; skip(); return *this; }
+		basic_iterator operator++(int) { basic_iterator tmp(*this); ++*this; return tmp; }
+		template<typename P2, typename R2> bool operator==(const basic_iterator<P2, R2> &it) const { return mIndex == it.mIndex; }
+		template<typename P2, typename R2> bool operator!=(const basic_iterator<P2, R2> &it) const { return mIndex != it.mIndex; }
+
+	private:
+		void skip(void) { while(mIndex < mTable->mCapacity && mTable->mCtrl[mIndex] < 0) ++mIndex; }
+
+		P mTable;
+		size_t mIndex;
+
+		template<typename, typename> friend class basic_iterator;
+		friend class HashTable;
+	};
+
+	typedef basic_iterator<HashTable*, T> iterator;
+	typedef basic_iterator<const HashTable*, const T> const_iterator;
+
+	HashTable(void) {}
+	HashTable(const HashTable &other) { *this = other; }
+	HashTable(HashTable &&other) { swap(other); }
+	~HashTable(void) { release(); }
+
+	HashTable &operator=(const HashTable &other);
+	HashTable &operator=(HashTable &&other) { swap(other); return *this; }
+	void swap(HashTable &other);
+
+	iterator begin(void) { return iterator(this, 0); }
+	iterator end(void) { return iterator(this, mCapacity); }
+	const_iterator begin(void) const { return const_iterator(this, 0); }
+	const_iterator end(void) const { return const_iterator(this, mCapacity); }
+
+	size_t size(void) const { return mSize; }
+	bool empty(void) const { return mSize == 0; }
+	size_t capacity(void) const { return mCapacity; }
+
+	void clear(void);
+	void reserve(size_t count);
+
+	template<typename Q> iterator find(const Q &key) { return iterator(this, findIndex(key)); }
+	template<typename Q> const_iterator find(const Q &key) const { return const_iterator(this, findIndex(key)); }
+	template<typename Q> size_t count(const Q &key) const { return findIndex(key) != mCapacity ? 1 : 0; }
+	template<typename Q> bool contains(const Q &key) const { return findIndex(key) != mCapacity; }
+
+	std::pair<iterator, bool> insert(const T &value) { return emplace(KeyOf()(value), value); }
+	std::pair<iterator, bool> insert(T &&value) { const K key(KeyOf()(value)); return emplace(key, std::move(value)); }
+
+	template<typename Q> size_t erase(const Q &key);
+	iterator erase(const_iterator it);
+	iterator erase(iterator it) { return erase(const_iterator(it)); }
+
+protected:
+	static const int8_t Empty = -128;
+	static const int8_t Deleted = -2;
+	static const size_t GroupWidth = 16;
+	static const size_t MinCapacity = 16;
+
+	// Bit i is set if control byte i of the group matches
+	class Group
+	{
+	public:
+		explicit Group(const int8_t *ctrl)
+		{
+#ifdef __SSE2__
+			mCtrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+#else
+			std::memcpy(mCtrl, ctrl, GroupWidth);
+#endif
+		}
+
+		uint32_t match(int8_t h) const
+		{
+#ifdef __SSE2__
+			return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h), mCtrl)));
+#else
+			uint32_t mask = 0;
+			for(size_t i=0; i<GroupWidth; ++i) if(mCtrl[i] == h) mask|= 1u << i;
+			return mask;
+#endif
+		}
+
+		uint32_t matchEmpty(void) const { return match(Empty); }
+
+		uint32_t matchFree(void) const	// Empty or Deleted
+		{
+#ifdef __SSE2__
+			return uint32_t(_mm_movemask_epi8(mCtrl));
+#else
+			uint32_t mask = 0;
+			for(size_t i=0; i<GroupWidth; ++i) if(mCtrl[i] < 0) mask|= 1u << i;
+			return mask;
+#endif
+		}
+
+	private:
+#ifdef __SSE2__
+		__m128i mCtrl;
+#else
+		int8_t mCtrl[GroupWidth];
+#endif
+	};
+
+	static size_t MaxLoad(size_t capacity) { return capacity - capacity/8; }
+	static unsigned LowestBit(uint32_t mask) { return unsigned(__builtin_ctz(mask)); }
+
+	template<typename Q> size_t findIndex(const Q &key) const;
+	size_t prepareInsert(size_t hash);
+	void setCtrl(size_t i, int8_t c);
+	void rehash(size_t capacity);
+	void release(void);
+
+	// Inserts value constructed from args if key is not present
+	template<typename Q, typename... Args> std::pair<iterator, bool> emplace(const Q &key, Args&&... args);
+
+	int8_t *mCtrl = NULL;	// mCapacity + GroupWidth bytes, the last GroupWidth mirror the first ones
+	T *mSlots = NULL;
+	size_t mCapacity = 0;	// 0 or a power of 2
+	size_t mSize = 0;
+	size_t mGrowthLeft = 0;
+	H mHash;
+	E mEqual;
+};
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+HashTable<K,T,KeyOf,H,E> &HashTable<K,T,KeyOf,H,E>::operator=(const HashTable &other)
+{
+	if(&other == this) return *this;
+	clear();
+	reserve(other.size());
+	for(const T &value : other)
+		insert(value);
+	return *this;
+}
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+void HashTable<K,T,KeyOf,H,E>::swap(HashTable &other)
+{
+	std::swap(mCtrl, other.mCtrl);
+	std::swap(mSlots, other.mSlots);
+	std::swap(mCapacity, other.mCapacity);
+	std::swap(mSize, other.mSize);
+	std::swap(mGrowthLeft, other.mGrowthLeft);
+}
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+void HashTable<K,T,KeyOf,H,E>::clear(void)
+{
+	if(!mCapacity) return;
+
+	for(size_t i=0; i<mCapacity; ++i)
+		if(mCtrl[i] >= 0) mSlots[i].~T();
+
+	std::memset(mCtrl, Empty, mCapacity + GroupWidth);
+	mSize = 0;
+	mGrowthLeft = MaxLoad(mCapacity);
+}
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+void HashTable<K,T,KeyOf,H,E>::reserve(size_t count)
+{
+	size_t capacity = (mCapacity ? mCapacity : size_t(MinCapacity));
+	while(MaxLoad(capacity) < count) capacity*= 2;
+	if(capacity != mCapacity) rehash(capacity);
+}
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+template<typename Q>
+size_t HashTable<K,T,KeyOf,H,E>::erase(const Q &key)
+{
+	size_t i = findIndex(key);
+	if(i == mCapacity) return 0;
+	erase(const_iterator(this, i));
+	return 1;
+}
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+typename HashTable<K,T,KeyOf,H,E>::iterator HashTable<K,T,KeyOf,H,E>::erase(const_iterator it)
+{
+	Assert(it.mIndex < mCapacity && mCtrl[it.mIndex] >= 0);
+	mSlots[it.mIndex].~T();
+	setCtrl(it.mIndex, Deleted);	// tombstone, reclaimed on next rehash
+	--mSize;
+	return iterator(this, it.mIndex + 1);
+}
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+template<typename Q>
+size_t HashTable<K,T,KeyOf,H,E>::findIndex(const Q &key) const
+{
+	if(!mCapacity) return 0;
+
+	const size_t hash = mHash(key);
+	const int8_t h2 = int8_t(hash & 0x7F);
+	const size_t mask = mCapacity - 1;
+	size_t pos = (hash >> 7) & mask;
+	size_t step = 0;
+	while(true)
+	{
+		Group group(mCtrl + pos);
+		for(uint32_t m = group.match(h2); m; m&= m - 1)
+		{
+			size_t i = (pos + LowestBit(m)) & mask;
+			if(mEqual(KeyOf()(mSlots[i]), key)) return i;
+		}
+
+		if(group.matchEmpty()) return mCapacity;
+
+		// Triangular probing visits every group since the capacity is a power of 2
+		step+= GroupWidth;
+		pos = (pos + step) & mask;
+	}
+}
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+size_t HashTable<K,T,KeyOf,H,E>::prepareInsert(size_t hash)
+{
+	if(!mGrowthLeft)
+	{
+		// Purge tombstones if they take most of the load, grow otherwise
+		if(mCapacity && mSize*2 <= MaxLoad(mCapacity)) rehash(mCapacity);
+		else rehash(mCapacity ? mCapacity*2 : size_t(MinCapacity));
+	}
+
+	const size_t mask = mCapacity - 1;
+	size_t pos = (hash >> 7) & mask;
+	size_t step = 0;
+	while(true)
+	{
+		uint32_t m = Group(mCtrl + pos).matchFree();
+		if(m)
+		{
+			size_t i = (pos + LowestBit(m)) & mask;
+			if(mCtrl[i] == Empty) --mGrowthLeft;
+			setCtrl(i, int8_t(hash & 0x7F));
+			++mSize;
+			return i;
+		}
+
+		step+= GroupWidth;
+		pos = (pos + step) & mask;
+	}
+}
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+void HashTable<K,T,KeyOf,H,E>::setCtrl(size_t i, int8_t c)
+{
+	mCtrl[i] = c;
+	if(i < GroupWidth) mCtrl[mCapacity + i] = c;
+}
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+void HashTable<K,T,KeyOf,H,E>::rehash(size_t capacity)
+{
+	Assert(capacity >= MinCapacity && MaxLoad(capacity) >= mSize);
+
+	int8_t *oldCtrl = mCtrl;
+	T *oldSlots = mSlots;
+	size_t oldCapacity = mCapacity;
+
+	mCtrl = new int8_t[capacity + GroupWidth];
+	mSlots = static_cast<T*>(::operator new(capacity * sizeof(T)));
+	mCapacity = capacity;
+	mSize = 0;
+	mGrowthLeft = MaxLoad(capacity);
+	std::memset(mCtrl, Empty, capacity + GroupWidth);
+
+	for(size_t i=0; i<oldCapacity; ++i)
+	{
+		if(oldCtrl[i] < 0) continue;
+
+		T &value = oldSlots[i];
+		size_t j = prepareInsert(mHash(KeyOf()(value)));
+		new (&mSlots[j]) T(std::move(value));
+		value.~T();
+	}
+
+	delete[] oldCtrl;
+	::operator delete(oldSlots);
+}
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+void HashTable<K,T,KeyOf,H,E>::release(void)
+{
+	clear();
+	delete[] mCtrl;
+	::operator delete(mSlots);
+	mCtrl = NULL;
+	mSlots = NULL;
+	mCapacity = 0;
+	mGrowthLeft = 0;
+}
+
+template<typename K, typename T, typename KeyOf, typename H, typename E>
+template<typename Q, typename... Args>
+std::pair<typename HashTable<K,T,KeyOf,H,E>::iterator, bool> HashTable<K,T,KeyOf,H,E>::emplace(const Q &key, Args&&... args)
+{
+	size_t i = findIndex(key);
+	if(i != mCapacity) return std::make_pair(iterator(this, i), false);
+
+	i = prepareInsert(mHash(key));
+	try {
+		new (&mSlots[i]) T(std::forward<Args>(args)...);
+	}
+	catch(...)
+	{
+		setCtrl(i, Deleted);
+		--mSize;
+		throw;
+	}
+
+	return std::make_pair(iterator(this, i), true);
+}
+
+}
+
+#endif
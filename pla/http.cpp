@@ -174,16 +174,15 @@ void Http::Request::recv(Stream *stream, bool parsePost)
 		throw 405;
 
 	// Read headers
+	String header;
 	while(true)
 	{
-		String line;
-		AssertIO(stream->readLine(line));
-		if(line.empty()) break;
+		AssertIO(stream->readLine(header));
+		if(header.empty()) break;
 
-		String value = line.cut(':');
-		line.trim();
-		value.trim();
-		headers.insert(line,value);
+		StringView name = header.view();
+		StringView value = name.cut(':');
+		headers.insert(String(name.trimmed()), String(value.trimmed()));
 	}
 
 	// Read cookies
@@ -655,10 +654,14 @@ void Http::Server::generate(Stream &out, int code, const String &message)
 
 void Http::Server::handle(Stream *stream, const Address &remote)
 {
+	// Connection buffers belong to the pool thread and are reused by the next connection
+	static thread_local BufferedStream buffered;
+	buffered.reset(stream);
+
 	Request request;
 	try {
 		try {
-			request.recv(stream);
+			request.recv(&buffered);
 			request.remoteAddress = remote;
 			process(request);
 		}
@@ -691,6 +694,16 @@ void Http::Server::handle(Stream *stream, const Address &remote)
 
 		}
 	}
+
+	try {
+		buffered.flush();
+	}
+	catch(const std::exception &e)
+	{
+		LogDebug("Http::Server::Handler", e.what());
+	}
+
+	buffered.reset(NULL);
 }
 
 void Http::Server::respondWithFile(const Request &request, const String &fileName)
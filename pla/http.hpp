@@ -29,6 +29,7 @@
 #include "pla/threadpool.hpp"
 #include "pla/securetransport.hpp"
 #include "pla/file.hpp"
+#include "pla/bufferedstream.hpp"
 #include "pla/map.hpp"
 
 namespace pla
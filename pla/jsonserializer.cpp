@@ -24,18 +24,106 @@
 #include "pla/serializable.hpp"
 #include "pla/lineserializer.hpp"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace pla
 {
 
+static inline bool isBlank(char chr)
+{
+	return chr == ' ' || chr == '\t' || chr == '\r' || chr == '\n';
+}
+
+static inline bool isDelimiter(char chr)
+{
+	return chr == ',' || chr == ':' || chr == ']' || chr == '}';
+}
+
+// Return the position of the first non-blank character, or size
+static size_t findNonBlank(const char *data, size_t pos, size_t size)
+{
+#ifdef __SSE2__
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	while(pos + 16 <= size)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+		__m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+						_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+		uint32_t mask = ~uint32_t(_mm_movemask_epi8(blank)) & 0xFFFF;
+		if(mask) return pos + __builtin_ctz(mask);
+		pos+= 16;
+	}
+#endif
+	while(pos < size && isBlank(data[pos])) ++pos;
+	return pos;
+}
+
+// Return the position of the first quote or backslash, or size
+static size_t findQuoteOrEscape(const char *data, size_t pos, size_t size, char quote)
+{
+#ifdef __SSE2__
+	const __m128i q = _mm_set1_epi8(quote);
+	const __m128i bs = _mm_set1_epi8('\\');
+	while(pos + 16 <= size)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+		uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, bs))));
+		if(mask) return pos + __builtin_ctz(mask);
+		pos+= 16;
+	}
+#endif
+	while(pos < size && data[pos] != quote && data[pos] != '\\') ++pos;
+	return pos;
+}
+
+// Return the position of the first character which might need escaping, or size
+static size_t findEscapable(const char *data, size_t pos, size_t size)
+{
+#ifdef __SSE2__
+	const __m128i q = _mm_set1_epi8('\"');
+	const __m128i bs = _mm_set1_epi8('\\');
+	const __m128i ctl = _mm_set1_epi8(0x1F);
+	while(pos + 16 <= size)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+		__m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, bs)),
+						_mm_cmpeq_epi8(_mm_min_epu8(v, ctl), v));	// v <= 0x1F
+		uint32_t mask = uint32_t(_mm_movemask_epi8(special));
+		if(mask) return pos + __builtin_ctz(mask);
+		pos+= 16;
+	}
+#endif
+	while(pos < size)
+	{
+		uint8_t chr = uint8_t(data[pos]);
+		if(chr == '\"' || chr == '\\' || chr <= 0x1F) break;
+		++pos;
+	}
+	return pos;
+}
+
 JsonSerializer::JsonSerializer(Stream *stream) :
-	mStream(stream)
+	mStream(stream),
+	mString(dynamic_cast<BinaryString*>(stream))
 {
 	Assert(stream);
 }
 
 JsonSerializer::~JsonSerializer(void)
 {
+	try {
+		flushOutput();
+		giveBack();
+	}
+	catch(...)
+	{
 
+	}
 }
 
 bool JsonSerializer::read(Serializable &s)
@@ -52,125 +140,43 @@ bool JsonSerializer::read(Serializable &s)
 
 bool JsonSerializer::read(std::string &str)
 {
-	const String fieldDelimiters = ",:]}";
-
 	str.clear();
 
-	char chr;
-	if(!mStream->get(chr)) return false;
-	while(Stream::BlankCharacters.contains(chr))
-		if(!mStream->get(chr)) return false;
+	if(!skipBlanks()) return false;
 
-	if(fieldDelimiters.contains(chr))
+	char chr = inputData()[mPos];
+	if(isDelimiter(chr))
 	{
-		if(chr == '}' || chr == ']')
-		{
-			do {
-				if(!mStream->get(chr))
-					return false;
-			}
-			while(Stream::BlankCharacters.contains(chr));
-		}
+		++mPos;
+		if(chr == '}' || chr == ']') leaveInput();
 		return false;
 	}
 
 	// Special case: read map or array in string
-	if(chr == '{' || chr == '[')
-	{
-		char opening = chr;
-		char closing;
-		if(opening ==  '{') closing = '}';
-		else closing = ']';
-
-		int count = 1;
-		str+= chr;
-		while(count)
-		{
-			AssertIO(mStream->get(chr));
-			str+= chr;
-
-			if(chr == opening) ++count;
-			else if(chr == closing) --count;
-		}
-
-		do {
-			if(!mStream->get(chr))
-				return true;
-		}
-		while(Stream::BlankCharacters.contains(chr));
-
-		AssertIO(fieldDelimiters.contains(chr));
-		return true;
-	}
-
-	bool quotes = (chr == '\'' || chr == '\"');
-
-	String delimiters;
-	if(quotes)
+	if(chr == '{' || chr == '[') readNested(str);
+	else if(chr == '\'' || chr == '\"')
 	{
-		delimiters = String(chr);
-		AssertIO(mStream->get(chr));
-	}
-	else {
-		str+= chr;
-		delimiters = Stream::BlankCharacters;
-		delimiters+=fieldDelimiters;
-		if(!mStream->get(chr)) return true;
+		++mPos;
+		readQuoted(chr, str);
 	}
+	else readBare(str);
 
-	while(!delimiters.contains(chr))
-	{
-		if(chr == '\\')
-		{
-			AssertIO(mStream->get(chr));
-			switch(chr)
-			{
-			case 'b': 	chr = '\b';	break;
-			case 'f': 	chr = '\f';	break;
-			case 'n': 	chr = '\n';	break;
-			case 'r': 	chr = '\r';	break;
-			case 't': 	chr = '\t';	break;
-			case 'u':
-			{
-				String tmp;
-				AssertIO(mStream->read(tmp, 4));
-
-				unsigned u = 0;
-				tmp.hexaMode(true);
-				tmp >> u;
-
-				wchar_t wstr[2];
-				wstr[0] = wchar_t(u);
-				wstr[1] = 0;
-
-				str+= String(wstr);
-				chr = 0;
-				break;
-			}
-			default:
-				if(isalpha(chr) || isdigit(chr))
-					chr = 0; // unknown escape sequence
-				break;
-			}
-		}
+	// Consume key separator
+	if(skipBlanks() && inputData()[mPos] == ':') ++mPos;
 
-		if(chr) str+= chr;
-		if(!mStream->get(chr))
-		{
-			if(quotes) throw IOException();
-			else break;
-		}
-	}
+	if(mInputLevel == 0) leaveInput();
+	return true;
+}
 
-	if(!fieldDelimiters.contains(chr))
-	{
-		do {
-			if(!mStream->get(chr))
-				return true;
-		}
-		while(Stream::BlankCharacters.contains(chr));
+bool JsonSerializer::read(bool &b)
+{
+	if(!read(mToken)) return false;
 
-		AssertIO(fieldDelimiters.contains(chr));
+	if(mToken == "true") b = true;
+	else if(mToken == "false") b = false;
+	else {
+		String tmp(mToken);
+		AssertIO(tmp.read(b));
 	}
 
 	return true;
@@ -180,104 +186,151 @@ void JsonSerializer::write(const Serializable &s)
 {
 	if(s.isInlineSerializable() && !s.isNativeSerializable()) Serializer::write(s.toString());
 	else s.serialize(*this);
-	if(mKey) *mStream << ':' << Stream::Space;
+	if(mKey)
+	{
+		mOutput.push_back(':');
+		mOutput.push_back(Stream::Space);
+	}
 	mKey = false;
+
+	if(mLevel == 0) flushOutput();
 }
 
 void JsonSerializer::write(const std::string &str)
 {
-	*mStream<<'\"';
-	for(size_t i=0; i<str.size(); ++i)
+	const char *data = str.data();
+	size_t size = str.size();
+	size_t pos = 0;
+
+	mOutput.push_back('\"');
+	while(true)
 	{
-		char chr = str[i];
+		size_t end = findEscapable(data, pos, size);
+		mOutput.append(data + pos, end - pos);
+		if(end == size) break;
+
+		char chr = data[end];
 		switch(chr)
 		{
-		case '\\': mStream->write("\\\\"); break;
-		case '\"': mStream->write("\\\""); break;
-		//case '\'': mStream->write("\\\'"); break;
-		case '\b': mStream->write("\\b");  break;
-		case '\f': mStream->write("\\f");  break;
-		case '\n': mStream->write("\\n");  break;
-		case '\r': mStream->write("\\r");  break;
-		case '\t': mStream->write("\\t");  break;
-		default: mStream->put(chr); break;
+		case '\\': mOutput+= "\\\\"; break;
+		case '\"': mOutput+= "\\\""; break;
+		case '\b': mOutput+= "\\b";  break;
+		case '\f': mOutput+= "\\f";  break;
+		case '\n': mOutput+= "\\n";  break;
+		case '\r': mOutput+= "\\r";  break;
+		case '\t': mOutput+= "\\t";  break;
+		default: mOutput.push_back(chr); break;
 		}
+		pos = end + 1;
 	}
-	*mStream<<'\"';
+	mOutput.push_back('\"');
 
-	if(mKey) *mStream << ':' << Stream::Space;
+	if(mKey)
+	{
+		mOutput.push_back(':');
+		mOutput.push_back(Stream::Space);
+	}
 	mKey = false;
+
+	if(mLevel == 0) flushOutput();
 }
 
 bool JsonSerializer::readArrayBegin(void)
 {
-	char chr;
-	do if(!mStream->get(chr)) return false;
-	while(Stream::BlankCharacters.contains(chr));
+	if(!skipBlanks()) return false;
 
-	if(chr == '[') return true;
-	if(chr == '}' || chr == ']') return false;
+	char chr = inputData()[mPos];
+	if(chr == '[')
+	{
+		++mPos;
+		enterInput();
+		return true;
+	}
+
+	if(chr == '}' || chr == ']')
+	{
+		++mPos;
+		leaveInput();
+		return false;
+	}
 
 	throw IOException();
 }
 
 bool JsonSerializer::readArrayNext(void)
 {
-	char chr = mStream->last();
-	while(Stream::BlankCharacters.contains(chr))
-		if(!mStream->get(chr))
-			return false;
+	if(!skipBlanks()) return false;
+
+	char chr = inputData()[mPos];
+	if(chr == ',')
+	{
+		++mPos;
+		return true;
+	}
 
-	if(chr == '[' || chr == ',') return true;
 	if(chr == '}' || chr == ']')
 	{
-		mStream->ignore(1);
+		++mPos;
+		leaveInput();
 		return false;
 	}
 
-	throw IOException();
+	return true;	// first element
 }
 
 bool JsonSerializer::readMapBegin(void)
 {
-	char chr;
-	do if(!mStream->get(chr)) return false;
-	while(Stream::BlankCharacters.contains(chr));
+	if(!skipBlanks()) return false;
+
+	char chr = inputData()[mPos];
+	if(chr == '{')
+	{
+		++mPos;
+		enterInput();
+		return true;
+	}
 
-	if(chr == '{') return true;
-	if(chr == '}' || chr == ']') return false;
+	if(chr == '}' || chr == ']')
+	{
+		++mPos;
+		leaveInput();
+		return false;
+	}
 
 	throw IOException();
 }
 
 bool JsonSerializer::readMapNext(void)
 {
-	char chr = mStream->last();
-	while(Stream::BlankCharacters.contains(chr))
-		if(!mStream->get(chr))
-			return false;
+	if(!skipBlanks()) return false;
+
+	char chr = inputData()[mPos];
+	if(chr == ',')
+	{
+		++mPos;
+		return true;
+	}
 
-	if(chr == '{' || chr == ',') return true;
 	if(chr == '}' || chr == ']')
 	{
-		mStream->ignore(1);
+		++mPos;
+		leaveInput();
 		return false;
 	}
 
-	throw IOException();
+	return true;	// first element
 }
 
 void JsonSerializer::writeArrayBegin(size_t size)
 {
-	*mStream<<'[';
+	mOutput.push_back('[');
 	++mLevel;
 }
 
 void JsonSerializer::writeArrayNext(size_t i)
 {
-	if(i > 0) *mStream<<',';
-	*mStream<<Stream::NewLine;
-	*mStream<<String(mLevel*2, ' ');
+	if(i > 0) mOutput.push_back(',');
+	appendIndent();
 	mKey = false;
 }
 
@@ -285,21 +338,21 @@ void JsonSerializer::writeArrayEnd(void)
 {
 	Assert(mLevel > 0);
 	--mLevel;
-	*mStream<<Stream::NewLine;
-	*mStream<<String(mLevel*2, ' ')<<']';
+	appendIndent();
+	mOutput.push_back(']');
+	if(mLevel == 0) flushOutput();
 }
 
 void JsonSerializer::writeMapBegin(size_t size)
 {
-	*mStream<<'{';
+	mOutput.push_back('{');
 	++mLevel;
 }
 
 void JsonSerializer::writeMapNext(size_t i)
 {
-	if(i > 0) *mStream<<',';
-	*mStream<<Stream::NewLine;
-	*mStream<<String(mLevel*2, ' ');
+	if(i > 0) mOutput.push_back(',');
+	appendIndent();
 	mKey = true;
 }
 
@@ -307,8 +360,256 @@ void JsonSerializer::writeMapEnd(void)
 {
 	Assert(mLevel > 0);
 	--mLevel;
-	*mStream<<Stream::NewLine;
-	*mStream<<String(mLevel*2, ' ')<<'}';
+	appendIndent();
+	mOutput.push_back('}');
+	if(mLevel == 0) flushOutput();
+}
+
+void JsonSerializer::writeEnd(void)
+{
+	flushOutput();
+}
+
+bool JsonSerializer::fill(void)
+{
+	if(mString) return false;	// the whole input is already available
+
+	if(mPos == mInput.size())
+	{
+		mInput.clear();
+		mPos = 0;
+	}
+
+	size_t size = mInput.size();
+	mInput.resize(size + BufferSize);
+	size_t len = mStream->readData(&mInput[size], BufferSize);
+	mInput.resize(size + len);
+	return len > 0;
+}
+
+bool JsonSerializer::skipBlanks(void)
+{
+	while(true)
+	{
+		mPos = findNonBlank(inputData(), mPos, inputSize());
+		if(mPos < inputSize()) return true;
+		if(!fill()) return false;
+	}
+}
+
+char JsonSerializer::nextChar(void)
+{
+	if(mPos == inputSize()) AssertIO(fill());
+	return inputData()[mPos++];
+}
+
+void JsonSerializer::readQuoted(char quote, std::string &str)
+{
+	while(true)
+	{
+		const char *data = inputData();
+		size_t size = inputSize();
+		size_t end = findQuoteOrEscape(data, mPos, size, quote);
+		str.append(data + mPos, end - mPos);
+		mPos = end;
+
+		if(mPos == size)
+		{
+			AssertIO(fill());	// unterminated string
+			continue;
+		}
+
+		if(data[mPos++] == quote) break;
+
+		char chr = nextChar();
+		switch(chr)
+		{
+		case 'b': 	chr = '\b';	break;
+		case 'f': 	chr = '\f';	break;
+		case 'n': 	chr = '\n';	break;
+		case 'r': 	chr = '\r';	break;
+		case 't': 	chr = '\t';	break;
+		case 'u':
+		{
+			String tmp;
+			for(int i=0; i<4; ++i)
+				tmp+= nextChar();
+
+			unsigned u = 0;
+			tmp.hexaMode(true);
+			tmp >> u;
+
+			wchar_t wstr[2];
+			wstr[0] = wchar_t(u);
+			wstr[1] = 0;
+
+			str+= String(wstr);
+			chr = 0;
+			break;
+		}
+		default:
+			if(isalpha(chr) || isdigit(chr))
+				chr = 0; // unknown escape sequence
+			break;
+		}
+
+		if(chr) str+= chr;
+	}
+}
+
+void JsonSerializer::readBare(std::string &str)
+{
+	while(true)
+	{
+		const char *data = inputData();
+		size_t size = inputSize();
+		size_t end = mPos;
+		while(end < size && !isBlank(data[end]) && !isDelimiter(data[end]))
+			++end;
+
+		str.append(data + mPos, end - mPos);
+		mPos = end;
+		if(mPos < size || !fill()) break;
+	}
+}
+
+void JsonSerializer::readNested(std::string &str)
+{
+	int count = 0;
+	char quote = 0;
+	bool escape = false;
+	do {
+		char chr = nextChar();
+		str+= chr;
+
+		if(quote)
+		{
+			if(escape) escape = false;
+			else if(chr == '\\') escape = true;
+			else if(chr == quote) quote = 0;
+		}
+		else if(chr == '\"' || chr == '\'') quote = chr;
+		else if(chr == '{' || chr == '[') ++count;
+		else if(chr == '}' || chr == ']') --count;
+	}
+	while(count > 0);
+}
+
+void JsonSerializer::enterInput(void)
+{
+	++mInputLevel;
+}
+
+void JsonSerializer::leaveInput(void)
+{
+	if(mInputLevel > 0) --mInputLevel;
+
+	// Consume the string once a top-level value has been read
+	if(mInputLevel == 0 && mString && mPos)
+	{
+		mString->erase(0, mPos);
+		mPos = 0;
+	}
+}
+
+void JsonSerializer::giveBack(void)
+{
+	if(mString) return;	// the string is consumed in place
+
+	// Trailing blanks can be dropped safely
+	size_t pos = findNonBlank(mInput.data(), mPos, mInput.size());
+	size_t unread = mInput.size() - pos;
+	mInput.clear();
+	mPos = 0;
+	if(!unread) return;
+
+	try {
+		mStream->seekRead(mStream->tellRead() - int64_t(unread));
+	}
+	catch(const Unsupported &e)
+	{
+		LogWarn("JsonSerializer", "Dropping " + String::number(uint64_t(unread)) + " bytes read ahead on a stream which can't seek");
+	}
+}
+
+bool JsonSerializer::parseInteger(int64_t &i, int64_t min, int64_t max)
+{
+	if(!read(mToken)) return false;
+
+	const char *str = mToken.c_str();
+	char *end = NULL;
+	errno = 0;
+	long long l = std::strtoll(str, &end, 10);
+	AssertIO(end != str && errno != ERANGE && l >= min && l <= max);
+	i = int64_t(l);
+	return true;
+}
+
+bool JsonSerializer::parseInteger(uint64_t &i, uint64_t min, uint64_t max)
+{
+	if(!read(mToken)) return false;
+
+	const char *str = mToken.c_str();
+	while(isBlank(*str)) ++str;
+	AssertIO(*str != '-');	// strtoull would wrap negative values
+
+	char *end = NULL;
+	errno = 0;
+	unsigned long long l = std::strtoull(str, &end, 10);
+	AssertIO(end != str && errno != ERANGE && l >= min && l <= max);
+	i = uint64_t(l);
+	return true;
+}
+
+void JsonSerializer::appendValue(int64_t i)
+{
+	if(i < 0)
+	{
+		mOutput.push_back('-');
+		appendValue(uint64_t(0) - uint64_t(i));
+	}
+	else appendValue(uint64_t(i));
+}
+
+void JsonSerializer::appendValue(uint64_t i)
+{
+	char buffer[20];
+	char *p = buffer + sizeof(buffer);
+	do {
+		*--p = char('0' + i % 10);
+		i/= 10;
+	}
+	while(i);
+
+	mOutput.append(p, buffer + sizeof(buffer) - p);
+}
+
+void JsonSerializer::appendValue(double f)
+{
+	// Same representation as the default stream formatting
+	char buffer[32];
+	int len = std::snprintf(buffer, sizeof(buffer), "%g", f);
+	Assert(len > 0 && size_t(len) < sizeof(buffer));
+	mOutput.append(buffer, len);
+}
+
+void JsonSerializer::appendValue(bool b)
+{
+	if(b) mOutput+= "true";
+	else mOutput+= "false";
+}
+
+void JsonSerializer::appendIndent(void)
+{
+	mOutput+= Stream::NewLine;
+	mOutput.append(mLevel*2, ' ');
+}
+
+void JsonSerializer::flushOutput(void)
+{
+	if(mOutput.empty()) return;
+	mStream->writeData(mOutput.data(), mOutput.size());
+	mOutput.clear();
 }
 
 }
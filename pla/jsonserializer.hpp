@@ -26,9 +26,16 @@
 #include "pla/stream.hpp"
 #include "pla/string.hpp"
 
+#include <type_traits>
+
 namespace pla
 {
 
+// Buffered JSON serializer
+// Input is tokenized over a contiguous buffer (directly over the string when reading from one),
+// output is accumulated and written to the stream once per top-level value.
+// When reading from another stream, input read ahead but not consumed is given back on destruction
+// by seeking backwards. Streams which can't seek must not be read by anything else afterwards.
 class JsonSerializer : public Serializer
 {
 public:
@@ -39,29 +46,29 @@ private:
 	bool read(Serializable &s);
 	bool read(std::string &str);
 	bool read(int8_t &i)	{ return readValue(i); }
-	bool read(int16_t &i)	{ return readValue(i); }
-	bool read(int32_t &i)	{ return readValue(i); }
-	bool read(int64_t &i)	{ return readValue(i); }
+	bool read(int16_t &i)	{ return readInteger(i); }
+	bool read(int32_t &i)	{ return readInteger(i); }
+	bool read(int64_t &i)	{ return readInteger(i); }
 	bool read(uint8_t &i)	{ return readValue(i); }
-	bool read(uint16_t &i)	{ return readValue(i); }
-	bool read(uint32_t &i)	{ return readValue(i); }
-	bool read(uint64_t &i)	{ return readValue(i); }
-	bool read(bool &b)	{ return readValue(b); }
-	bool read(float &f)	{ return readValue(f); }
-	bool read(double &f)	{ return readValue(f); }
+	bool read(uint16_t &i)	{ return readInteger(i); }
+	bool read(uint32_t &i)	{ return readInteger(i); }
+	bool read(uint64_t &i)	{ return readInteger(i); }
+	bool read(bool &b);
+	bool read(float &f)	{ return readFloat(f); }
+	bool read(double &f)	{ return readFloat(f); }
 
 	void write(const Serializable &s);
 	void write(const std::string &str);
 	void write(int8_t i)	{ writeValue(i); }
-	void write(int16_t i)	{ writeValue(i); }
-	void write(int32_t i)	{ writeValue(i); }
+	void write(int16_t i)	{ writeValue(int64_t(i)); }
+	void write(int32_t i)	{ writeValue(int64_t(i)); }
 	void write(int64_t i)	{ writeValue(i); }
 	void write(uint8_t i)	{ writeValue(i); }
-	void write(uint16_t i)	{ writeValue(i); }
-	void write(uint32_t i)	{ writeValue(i); }
+	void write(uint16_t i)	{ writeValue(uint64_t(i)); }
+	void write(uint32_t i)	{ writeValue(uint64_t(i)); }
 	void write(uint64_t i)	{ writeValue(i); }
 	void write(bool b)	{ writeValue(b); }
-	void write(float f)	{ writeValue(f); }
+	void write(float f)	{ writeValue(double(f)); }
 	void write(double f)	{ writeValue(f); }
 
 	bool readArrayBegin(void);
@@ -75,11 +82,45 @@ private:
 	void writeMapBegin(size_t size);
 	void writeMapNext(size_t i);
 	void writeMapEnd(void);
+	void writeEnd(void);
+
+	// Input
+	const char *inputData(void) const	{ return mString ? mString->data() : mInput.data(); }
+	size_t inputSize(void) const		{ return mString ? mString->size() : mInput.size(); }
+	bool fill(void);
+	bool skipBlanks(void);
+	char nextChar(void);
+	void readQuoted(char quote, std::string &str);
+	void readBare(std::string &str);
+	void readNested(std::string &str);
+	void enterInput(void);
+	void leaveInput(void);
+	void giveBack(void);
+	bool parseInteger(int64_t &i, int64_t min, int64_t max);
+	bool parseInteger(uint64_t &i, uint64_t min, uint64_t max);
 
 	template<typename T> bool readValue(T &value);
+	template<typename T> bool readInteger(T &value);
+	template<typename T> bool readFloat(T &value);
+
+	// Output
+	void appendValue(int64_t i);
+	void appendValue(uint64_t i);
+	void appendValue(double f);
+	void appendValue(bool b);
+	void appendIndent(void);
+	void flushOutput(void);
+
+	template<typename T> void appendValue(const T &value);
 	template<typename T> void writeValue(const T &value);
 
 	Stream *mStream;
+	BinaryString *mString;	// non-null if the stream is a string
+	std::string mInput;
+	std::string mOutput;
+	std::string mToken;
+	size_t mPos = 0;
+	int mInputLevel = 0;
 	int mLevel = 0;
 	bool mKey = false;
 };
@@ -93,14 +134,51 @@ bool JsonSerializer::readValue(T &value)
 	return true;
 }
 
+template<typename T>
+bool JsonSerializer::readInteger(T &value)
+{
+	typedef typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type integer_t;
+
+	integer_t i = 0;
+	if(!parseInteger(i, std::numeric_limits<T>::min(), std::numeric_limits<T>::max())) return false;
+	value = T(i);
+	return true;
+}
+
+template<typename T>
+bool JsonSerializer::readFloat(T &value)
+{
+	if(!read(mToken)) return false;
+	const char *str = mToken.c_str();
+	char *end = NULL;
+	double f = std::strtod(str, &end);
+	AssertIO(end != str);
+	value = T(f);
+	return true;
+}
+
+template<typename T>
+void JsonSerializer::appendValue(const T &value)
+{
+	std::ostringstream oss;
+	oss << value;
+	mOutput+= oss.str();
+}
+
 template<typename T>
 void JsonSerializer::writeValue(const T &value)
 {
-	mStream->space();
-	mStream->write(value);
-	if(mKey) *mStream << ':' << Stream::Space;
-	else if(mLevel == 0) *mStream << Stream::NewLine;
+	mOutput.push_back(Stream::Space);
+	appendValue(value);
+	if(mKey)
+	{
+		mOutput.push_back(':');
+		mOutput.push_back(Stream::Space);
+	}
+	else if(mLevel == 0) mOutput+= Stream::NewLine;
 	mKey = false;
+
+	if(mLevel == 0) flushOutput();
 }
 
 }
@@ -0,0 +1,130 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "pla/mappedfile.hpp"
+#include "pla/exception.hpp"
+
+#ifndef WINDOWS
+#include <sys/mman.h>
+#endif
+
+namespace pla
+{
+
+MappedFile::MappedFile(void) :
+	mData(NULL),
+	mSize(0),
+	mOpen(false)
+#ifdef WINDOWS
+	, mMapping(NULL)
+#endif
+{
+
+}
+
+MappedFile::MappedFile(const String &filename) :
+	MappedFile()
+{
+	open(filename);
+}
+
+MappedFile::~MappedFile(void)
+{
+	close();
+}
+
+void MappedFile::open(const String &filename)
+{
+	close();
+
+#ifdef WINDOWS
+	HANDLE file = CreateFile(filename.pathEncode().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE) throw Exception("Unable to open file: " + filename);
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		throw Exception("Unable to get file size: " + filename);
+	}
+
+	mSize = size_t(size.QuadPart);
+	if(mSize > 0)
+	{
+		mMapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(mMapping) mData = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	}
+
+	CloseHandle(file);	// the mapping keeps the file open
+	if(mSize > 0 && !mData)
+	{
+		if(mMapping) CloseHandle(mMapping);
+		mMapping = NULL;
+		mSize = 0;
+		throw Exception("Unable to map file: " + filename);
+	}
+#else
+	int fd = ::open(filename.pathEncode().c_str(), O_RDONLY);
+	if(fd < 0) throw Exception("Unable to open file: " + filename);
+
+	struct stat st;
+	if(fstat(fd, &st))
+	{
+		::close(fd);
+		throw Exception("Unable to get file size: " + filename);
+	}
+
+	mSize = size_t(st.st_size);
+	if(mSize > 0)	// mapping an empty file fails
+	{
+		void *data = mmap(NULL, mSize, PROT_READ, MAP_SHARED, fd, 0);
+		if(data == MAP_FAILED)
+		{
+			::close(fd);
+			mSize = 0;
+			throw Exception("Unable to map file: " + filename);
+		}
+
+		mData = static_cast<const char*>(data);
+	}
+
+	::close(fd);	// the mapping keeps the file open
+#endif
+
+	mOpen = true;
+}
+
+void MappedFile::close(void)
+{
+#ifdef WINDOWS
+	if(mData) UnmapViewOfFile(mData);
+	if(mMapping) CloseHandle(mMapping);
+	mMapping = NULL;
+#else
+	if(mData) munmap(const_cast<char*>(mData), mSize);
+#endif
+
+	mData = NULL;
+	mSize = 0;
+	mOpen = false;
+}
+
+}
@@ -0,0 +1,61 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef PLA_MAPPEDFILE_H
+#define PLA_MAPPEDFILE_H
+
+#include "pla/include.hpp"
+#include "pla/string.hpp"
+
+namespace pla
+{
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile(void);
+	MappedFile(const String &filename);
+	~MappedFile(void);
+
+	void open(const String &filename);
+	void close(void);
+	bool isOpen(void) const	{ return mOpen; }
+
+	const char *data(void) const	{ return mData; }
+	size_t size(void) const		{ return mSize; }
+
+private:
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	const char *mData;
+	size_t mSize;
+	bool mOpen;
+
+#ifdef WINDOWS
+	HANDLE mMapping;
+#endif
+};
+
+}
+
+#endif
@@ -0,0 +1,230 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2016 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef PLA_PATHTREE_H
+#define PLA_PATHTREE_H
+
+#include "pla/include.hpp"
+#include "pla/string.hpp"
+#include "pla/set.hpp"
+#include "pla/map.hpp"
+#include "pla/hashmap.hpp"
+
+#include <algorithm>
+
+namespace pla
+{
+
+// Radix tree over '/'-separated path segments, mapping prefixes to sets of values.
+// match() visits every registered prefix of a path in one walk, longest first.
+template<typename T>
+class PathTree
+{
+public:
+	PathTree(void);
+
+	void insert(const String &prefix, const T &value);
+	bool erase(const String &prefix, const T &value);
+	bool empty(void) const { return mRoot->isEmpty() && mOthers.empty(); }
+
+	// f(const String &prefix, const Set<T> &values) is called for each prefix of path with values
+	// f may insert new prefixes, erased nodes are only pruned once the walk is over
+	template<typename F> void match(const String &path, F f) { match(path.data(), path.size(), f); }
+	template<typename F> void match(const char *path, size_t size, F f);
+
+	// f(const String &prefix, const Set<T> &values) is called for each registered prefix
+	template<typename F> void forEach(F f) const;
+
+private:
+	struct Node
+	{
+		bool isEmpty(void) const { return values.empty() && children.empty(); }
+
+		String prefix;
+		Set<T> values;
+		HashMap<String, sptr<Node> > children;
+	};
+
+	template<typename F> void matchNode(Node *node, const char *begin, const char *end, F &f);
+	template<typename F> void forEachNode(const Node *node, F &f) const;
+	bool eraseNode(Node *node, const char *begin, const char *end, const T &value);
+	bool prune(Node *node);	// returns true if node is empty
+
+	sptr<Node> mRoot;
+	Map<String, Set<T> > mOthers;	// prefixes not starting with '/', never matched
+	int mWalking;
+	bool mPrunePending;
+};
+
+template<typename T>
+PathTree<T>::PathTree(void) :
+	mRoot(std::make_shared<Node>()),
+	mWalking(0),
+	mPrunePending(false)
+{
+	mRoot->prefix = "/";
+}
+
+template<typename T>
+void PathTree<T>::insert(const String &prefix, const T &value)
+{
+	if(prefix.empty() || prefix[0] != '/')
+	{
+		mOthers[prefix].insert(value);
+		return;
+	}
+
+	Node *node = mRoot.get();
+	if(prefix.size() > 1)
+	{
+		const char *begin = prefix.data() + 1;
+		const char *end = prefix.data() + prefix.size();
+		while(true)
+		{
+			const char *sep = std::find(begin, end, '/');
+			auto it = node->children.find(StringView(begin, sep - begin));
+			if(it == node->children.end())
+			{
+				auto child = std::make_shared<Node>();
+				child->prefix.assign(prefix.data(), sep - prefix.data());
+				it = node->children.insert(String(begin, sep - begin), child);
+			}
+
+			node = it->second.get();
+			if(sep == end) break;
+			begin = sep + 1;
+		}
+	}
+
+	node->values.insert(value);
+}
+
+template<typename T>
+bool PathTree<T>::erase(const String &prefix, const T &value)
+{
+	if(prefix.empty() || prefix[0] != '/')
+	{
+		auto it = mOthers.find(prefix);
+		if(it == mOthers.end() || !it->second.erase(value)) return false;
+		if(it->second.empty()) mOthers.erase(it);
+		return true;
+	}
+
+	const char *begin = (prefix.size() > 1 ? prefix.data() + 1 : NULL);
+	return eraseNode(mRoot.get(), begin, prefix.data() + prefix.size(), value);
+}
+
+template<typename T>
+bool PathTree<T>::eraseNode(Node *node, const char *begin, const char *end, const T &value)
+{
+	if(!begin) return node->values.erase(value) != 0;
+
+	const char *sep = std::find(begin, end, '/');
+	auto it = node->children.find(StringView(begin, sep - begin));
+	if(it == node->children.end()) return false;
+
+	Node *child = it->second.get();
+	if(!eraseNode(child, sep != end ? sep + 1 : NULL, end, value)) return false;
+
+	if(child->isEmpty())
+	{
+		if(mWalking) mPrunePending = true;	// the walk might be holding the node
+		else node->children.erase(it);
+	}
+
+	return true;
+}
+
+template<typename T>
+template<typename F>
+void PathTree<T>::match(const char *path, size_t size, F f)
+{
+	if(!size || path[0] != '/') return;
+
+	++mWalking;
+	try {
+		matchNode(mRoot.get(), path + 1, path + size, f);
+	}
+	catch(...)
+	{
+		--mWalking;
+		throw;
+	}
+
+	if(--mWalking == 0 && mPrunePending)
+	{
+		mPrunePending = false;
+		prune(mRoot.get());
+	}
+}
+
+template<typename T>
+template<typename F>
+void PathTree<T>::matchNode(Node *node, const char *begin, const char *end, F &f)
+{
+	// begin is NULL once the path is exhausted
+	if(begin)
+	{
+		const char *sep = std::find(begin, end, '/');
+		auto it = node->children.find(StringView(begin, sep - begin));
+		if(it != node->children.end())
+			matchNode(it->second.get(), sep != end ? sep + 1 : NULL, end, f);
+	}
+
+	if(!node->values.empty())
+		f(node->prefix, node->values);
+}
+
+template<typename T>
+template<typename F>
+void PathTree<T>::forEach(F f) const
+{
+	forEachNode(mRoot.get(), f);
+	for(const auto &p : mOthers)
+		f(p.first, p.second);
+}
+
+template<typename T>
+template<typename F>
+void PathTree<T>::forEachNode(const Node *node, F &f) const
+{
+	if(!node->values.empty())
+		f(node->prefix, node->values);
+
+	for(const auto &p : node->children)
+		forEachNode(p.second.get(), f);
+}
+
+template<typename T>
+bool PathTree<T>::prune(Node *node)
+{
+	for(auto it = node->children.begin(); it != node->children.end(); )
+	{
+		if(prune(it->second.get())) it = node->children.erase(it);
+		else ++it;
+	}
+
+	return node->isEmpty();
+}
+
+}
+
+#endif
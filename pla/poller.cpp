@@ -0,0 +1,177 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2013 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "pla/poller.hpp"
+#include "pla/exception.hpp"
+
+#ifndef WINDOWS
+#include <poll.h>
+#endif
+
+namespace pla
+{
+
+const int Poller::Read  = 0x1;
+const int Poller::Write = 0x2;
+
+Poller::Poller(void)
+{
+
+}
+
+Poller::~Poller(void)
+{
+
+}
+
+void Poller::add(socket_t sock, int events)
+{
+	Entry entry;
+	entry.sock = sock;
+	entry.events = events;
+	entry.revents = 0;
+	mEntries.append(entry);
+}
+
+void Poller::clear(void)
+{
+	mEntries.clear();
+}
+
+#ifndef WINDOWS
+
+static short toPollEvents(int events)
+{
+	short pevents = 0;
+	if(events & Poller::Read)  pevents|= POLLIN;
+	if(events & Poller::Write) pevents|= POLLOUT;
+	return pevents;
+}
+
+static int fromPollEvents(int events, short revents)
+{
+	// Errors and hangups are reported as readiness so the next call fails or returns 0
+	int result = 0;
+	if(revents & (POLLIN | POLLHUP | POLLERR)) result|= events & Poller::Read;
+	if(revents & (POLLOUT | POLLERR)) result|= events & Poller::Write;
+	if(revents & POLLNVAL) result|= events;
+	return result;
+}
+
+static int doPoll(struct pollfd *fds, size_t count, duration timeout)
+{
+	int ms = -1;
+	if(timeout >= duration::zero())
+		ms = int(std::min(std::ceil(milliseconds(timeout).count()), double(std::numeric_limits<int>::max())));
+
+	int ret;
+	do ret = ::poll(fds, nfds_t(count), ms);
+	while(ret < 0 && sockerrno == EINTR);
+
+	if(ret < 0) throw Exception("Unable to wait on socket");
+	return ret;
+}
+
+int Poller::Wait(socket_t sock, int events, duration timeout)
+{
+	struct pollfd pfd;
+	pfd.fd = sock;
+	pfd.events = toPollEvents(events);
+	pfd.revents = 0;
+	doPoll(&pfd, 1, timeout);
+	return fromPollEvents(events, pfd.revents);
+}
+
+int Poller::wait(duration timeout)
+{
+	std::vector<struct pollfd> fds(mEntries.size());
+	for(size_t i = 0; i < mEntries.size(); ++i)
+	{
+		fds[i].fd = mEntries[i].sock;
+		fds[i].events = toPollEvents(mEntries[i].events);
+		fds[i].revents = 0;
+	}
+
+	int ret = doPoll(fds.data(), fds.size(), timeout);
+
+	for(size_t i = 0; i < mEntries.size(); ++i)
+		mEntries[i].revents = fromPollEvents(mEntries[i].events, fds[i].revents);
+
+	return ret;
+}
+
+#else
+
+int Poller::Wait(socket_t sock, int events, duration timeout)
+{
+	Poller poller;
+	poller.add(sock, events);
+	poller.wait(timeout);
+	return poller.ready(sock);
+}
+
+int Poller::wait(duration timeout)
+{
+	// Windows fd_set is an array of handles, not a bitmap, so select() has no descriptor limit here
+	fd_set readfds;
+	fd_set writefds;
+	FD_ZERO(&readfds);
+	FD_ZERO(&writefds);
+	for(size_t i = 0; i < mEntries.size(); ++i)
+	{
+		if(mEntries[i].events & Read)  FD_SET(mEntries[i].sock, &readfds);
+		if(mEntries[i].events & Write) FD_SET(mEntries[i].sock, &writefds);
+	}
+
+	struct timeval tv;
+	struct timeval *ptv = NULL;
+	if(timeout >= duration::zero())
+	{
+		durationToStruct(timeout, tv);
+		ptv = &tv;
+	}
+
+	int ret = ::select(0, &readfds, &writefds, NULL, ptv);
+	if(ret < 0) throw Exception("Unable to wait on socket");
+
+	for(size_t i = 0; i < mEntries.size(); ++i)
+	{
+		int revents = 0;
+		if(FD_ISSET(mEntries[i].sock, &readfds))  revents|= Read;
+		if(FD_ISSET(mEntries[i].sock, &writefds)) revents|= Write;
+		mEntries[i].revents = revents;
+	}
+
+	return ret;
+}
+
+#endif
+
+int Poller::ready(socket_t sock) const
+{
+	for(size_t i = 0; i < mEntries.size(); ++i)
+		if(mEntries[i].sock == sock)
+			return mEntries[i].revents;
+
+	return 0;
+}
+
+}
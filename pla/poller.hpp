@@ -0,0 +1,64 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2013 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef PLA_POLLER_H
+#define PLA_POLLER_H
+
+#include "pla/include.hpp"
+#include "pla/array.hpp"
+
+namespace pla
+{
+
+// Socket readiness, backed by poll() where available
+// Unlike select(), descriptors are not limited by FD_SETSIZE
+class Poller
+{
+public:
+	static const int Read;
+	static const int Write;
+
+	// Wait for events on a single socket, returns ready events or 0 on timeout
+	// A negative timeout waits indefinitely
+	static int Wait(socket_t sock, int events, duration timeout);
+
+	Poller(void);
+	~Poller(void);
+
+	void add(socket_t sock, int events);
+	void clear(void);
+	int wait(duration timeout);	// returns the number of ready sockets
+	int ready(socket_t sock) const;	// returns ready events after wait()
+
+private:
+	struct Entry
+	{
+		socket_t sock;
+		int events;
+		int revents;
+	};
+
+	Array<Entry> mEntries;
+};
+
+}
+
+#endif
@@ -203,6 +203,12 @@ void SecureTransport::close(void)
 	}
 }
 
+void SecureTransport::shutdown(void)
+{
+	if(mStream)
+		mStream->shutdown();
+}
+
 void SecureTransport::setHostname(const String &hostname)
 {
 	if(isHandshakeDone())
@@ -100,6 +100,7 @@ public:
 
 	void handshake(void);
 	void close(void);
+	void shutdown(void);	// shuts down the underlying stream, the session is left untouched
 
 	void setHostname(const String &hostname);	// remote hostname for client
 
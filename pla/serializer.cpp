@@ -22,6 +22,7 @@
 #include "pla/serializer.hpp"
 #include "pla/string.hpp"
 #include "pla/binarystring.hpp"
+#include "pla/digest.hpp"
 #include "pla/exception.hpp"
 
 namespace pla
@@ -57,6 +58,19 @@ void Serializer::write(const BinaryString &s)
 	write(static_cast<const Serializable&>(s));
 }
 
+bool Serializer::read(Digest &d)
+{
+	BinaryString s;
+	if(!read(s)) return false;
+	d = Digest(s);
+	return true;
+}
+
+void Serializer::write(const Digest &d)
+{
+	write(d.toBinary());
+}
+
 bool Serializer::read(uint8_t &i)
 {
 	uint64_t t = 0;
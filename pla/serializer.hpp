@@ -31,6 +31,7 @@ namespace pla
 
 class String;
 class BinaryString;
+class Digest;
 
 class Serializer
 {
@@ -76,6 +77,8 @@ protected:
 	virtual void	write(const String &s);
 	virtual bool	read(BinaryString &s);
 	virtual void	write(const BinaryString &s);
+	virtual bool	read(Digest &d);
+	virtual void	write(const Digest &d);
 
 	virtual bool	read(std::string &str) = 0;
 	virtual bool	read(uint8_t &i);
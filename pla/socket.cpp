@@ -23,6 +23,7 @@
 #include "pla/exception.hpp"
 #include "pla/http.hpp"
 #include "pla/proxy.hpp"
+#include "pla/poller.hpp"
 
 namespace pla
 {
@@ -35,25 +36,19 @@ void Socket::Transfer(Socket *sock1, Socket *sock2)
 
 	while(true)
 	{
-		fd_set readfds;
-		FD_ZERO(&readfds);
-		FD_SET(sock1->mSock, &readfds);
-		FD_SET(sock2->mSock, &readfds);
+		Poller poller;
+		poller.add(sock1->mSock, Poller::Read);
+		poller.add(sock2->mSock, Poller::Read);
+		if(poller.wait(seconds(-1.)) == 0) break;
 
-		int n = std::max(SOCK_TO_INT(sock1->mSock),SOCK_TO_INT(sock2->mSock))+1;
-		int ret = ::select(n, &readfds, NULL, NULL, NULL);
-
-		if (ret < 0) throw Exception("Unable to wait on socket");
-		if (ret ==  0) break;
-
-		if(FD_ISSET(sock1->mSock, &readfds))
+		if(poller.ready(sock1->mSock) & Poller::Read)
 		{
 			 int count = ::recv(sock1->mSock, buffer, BufferSize, 0);
 			 if(count <= 0) break;
 			 sock2->writeData(buffer, count);
 		}
 
-		if(FD_ISSET(sock2->mSock, &readfds))
+		if(poller.ready(sock2->mSock) & Poller::Read)
 		{
 			 int count = ::recv(sock2->mSock, buffer, BufferSize, 0);
 			 if(count <= 0) break;
@@ -106,30 +101,14 @@ bool Socket::isReadable(void) const
 {
 	if(!isConnected()) return false;
 
-	fd_set readfds;
-	FD_ZERO(&readfds);
-	FD_SET(mSock, &readfds);
-
-	struct timeval tv;
-	tv.tv_sec = 0;
-	tv.tv_usec = 0;
-	::select(SOCK_TO_INT(mSock)+1, &readfds, NULL, NULL, &tv);
-	return FD_ISSET(mSock, &readfds);
+	return (Poller::Wait(mSock, Poller::Read, duration::zero()) & Poller::Read) != 0;
 }
 
 bool Socket::isWriteable(void) const
 {
 	if(!isConnected()) return false;
 
-	fd_set writefds;
-	FD_ZERO(&writefds);
-	FD_SET(mSock, &writefds);
-
-	struct timeval tv;
-	tv.tv_sec = 0;
-	tv.tv_usec = 0;
-	::select(SOCK_TO_INT(mSock)+1, NULL, &writefds, NULL, &tv);
-	return FD_ISSET(mSock, &writefds);
+	return (Poller::Wait(mSock, Poller::Write, duration::zero()) & Poller::Write) != 0;
 }
 
 Address Socket::getLocalAddress(void) const
@@ -229,17 +208,7 @@ void Socket::connect(const Address &addr, bool noproxy)
 			// Initiate connection
 			::connect(mSock, addr.addr(), addr.addrLen());
 
-			fd_set writefds;
-			FD_ZERO(&writefds);
-			FD_SET(mSock, &writefds);
-
-			struct timeval tv;
-			durationToStruct(mConnectTimeout, tv);
-			int ret = ::select(SOCK_TO_INT(mSock)+1, NULL, &writefds, NULL, &tv);
-
-			if (ret < 0)
-				throw Exception("Unable to wait on socket");
-
+			int ret = Poller::Wait(mSock, Poller::Write, mConnectTimeout);
 			if (ret ==  0 || ::send(mSock, NULL, 0, 0) != 0)
 				throw NetException(String("Connection to ")+addr.toString()+" failed");
 
@@ -271,6 +240,18 @@ void Socket::close(void)
 	mProxifiedAddr.clear();
 }
 
+void Socket::shutdown(void)
+{
+	if(mSock != INVALID_SOCKET)
+	{
+#ifdef WINDOWS
+		::shutdown(mSock, SD_BOTH);
+#else
+		::shutdown(mSock, SHUT_RDWR);
+#endif
+	}
+}
+
 size_t Socket::readData(char *buffer, size_t size)
 {
 	return recvData(buffer, size, 0);
@@ -286,15 +267,7 @@ bool Socket::waitData(duration timeout)
 	if(mSock == INVALID_SOCKET)
 		throw NetException("Socket is closed");
 
-	fd_set readfds;
-	FD_ZERO(&readfds);
-	FD_SET(mSock, &readfds);
-
-	struct timeval tv;
-	durationToStruct(timeout, tv);
-	int ret = ::select(SOCK_TO_INT(mSock)+1, &readfds, NULL, NULL, &tv);
-	if (ret < 0) throw Exception("Unable to wait on socket");
-	return (ret != 0);
+	return (Poller::Wait(mSock, Poller::Read, timeout) != 0);
 }
 
 size_t Socket::peekData(char *buffer, size_t size)
@@ -320,23 +293,13 @@ size_t Socket::recvData(char *buffer, size_t size, int flags)
 
 void Socket::sendData(const char *data, size_t size, int flags)
 {
-	struct timeval tv;
-	durationToStruct(std::max(mWriteTimeout, duration::zero()), tv);
-
 	do {
 		if(mSock == INVALID_SOCKET)
 			throw NetException("Socket is closed");
 
 		if(mWriteTimeout >= duration::zero())
 		{
-			fd_set writefds;
-			FD_ZERO(&writefds);
-			FD_SET(mSock, &writefds);
-
-			int ret = ::select(SOCK_TO_INT(mSock)+1, NULL, &writefds, NULL, &tv);
-			if (ret == -1)
-				throw Exception("Unable to wait on socket");
-			if (ret == 0)
+			if(!Poller::Wait(mSock, Poller::Write, mWriteTimeout))
 				throw Timeout();
 		}
 
@@ -55,6 +55,7 @@ public:
 
 	void connect(const Address &addr, bool noproxy = false);
 	void close(void);
+	void shutdown(void);
 
 	// Stream
 	size_t readData(char *buffer, size_t size);
@@ -85,6 +85,11 @@ void Stream::close(void)
 	// do nothing
 }
 
+void Stream::shutdown(void)
+{
+	// do nothing
+}
+
 bool Stream::ignore(size_t size)
 {
 	char buffer[BufferSize];
@@ -357,12 +362,12 @@ void Stream::write(const Serializable &s)
 
 void Stream::write(const char *s)
 {
-	if(s) write(String(s));
+	if(s) writeData(s, std::strlen(s));
 }
 
 void Stream::write(const std::string &s)
 {
-	write(String(s));
+	writeData(s.data(), s.size());
 }
 
 void Stream::write(bool b)
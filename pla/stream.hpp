@@ -62,6 +62,7 @@ public:
 	virtual void clear(void);
 	virtual void flush(void);
 	virtual void close(void);
+	virtual void shutdown(void);	// make pending and future calls fail without releasing anything
 	virtual bool ignore(size_t size = 1);
 	virtual bool skipMark(void);
 	virtual bool isDatagram(void) const;
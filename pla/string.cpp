@@ -201,6 +201,12 @@ String::String(const wchar_t *str)
 	}
 }
 
+String::String(const StringView &view) :
+	BinaryString(view.data(), view.size())
+{
+
+}
+
 String::~String(void)
 {
 
@@ -217,6 +223,11 @@ void String::explode(std::list<String> &strings, char separator) const
 	}
 }
 
+void String::explode(std::vector<StringView> &views, char separator) const
+{
+	view().explode(views, separator);
+}
+
 void String::implode(const std::list<String> &strings, char separator)
 {
 	clear();
@@ -433,6 +444,31 @@ String String::beforeLast(char c) const
 	else return this->substr(0,pos);
 }
 
+StringView String::view(void) const
+{
+	return StringView(data(), size());
+}
+
+StringView String::afterView(char c) const
+{
+	return view().after(c);
+}
+
+StringView String::afterLastView(char c) const
+{
+	return view().afterLast(c);
+}
+
+StringView String::beforeView(char c) const
+{
+	return view().before(c);
+}
+
+StringView String::beforeLastView(char c) const
+{
+	return view().beforeLast(c);
+}
+
 String String::noAccents(void) const
 {
 	String s(*this);
@@ -24,6 +24,7 @@
 
 #include "pla/include.hpp"
 #include "pla/binarystring.hpp"
+#include "pla/stringview.hpp"
 #include "pla/random.hpp"
 
 #include <cwchar>
@@ -62,10 +63,12 @@ public:
 	String(const String &str, int begin = 0);
 	String(const String &str, int begin, int end);
 	String(const wchar_t *str);	// UTF-16
+	explicit String(const StringView &view);
 	template <class InputIterator> String(InputIterator first, InputIterator last) : BinaryString(first, last) {}
 	virtual ~String(void);
 
 	void explode(std::list<String> &strings, char separator) const;
+	void explode(std::vector<StringView> &views, char separator) const;	// views reference the string
 	void implode(const std::list<String> &strings, char separator);
 	String cut(char separator);
 	String cutLast(char separator);
@@ -97,6 +100,13 @@ public:
 	String before(char c) const;
 	String beforeLast(char c) const;
 
+	// Non-allocating variants, views reference the string
+	StringView view(void) const;
+	StringView afterView(char c) const;
+	StringView afterLastView(char c) const;
+	StringView beforeView(char c) const;
+	StringView beforeLastView(char c) const;
+
 	String noAccents(void) const;
 	String toLower(void) const;
 	String toUpper(void) const;
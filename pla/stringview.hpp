@@ -0,0 +1,185 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2016 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Plateform.                                     *
+ *                                                                       *
+ *   Plateform is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Plateform is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Plateform.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef PLA_STRINGVIEW_H
+#define PLA_STRINGVIEW_H
+
+#include "pla/include.hpp"
+
+#include <string>
+#include <cstring>
+
+namespace pla
+{
+
+// Non-owning reference to a sequence of characters, the referenced string must outlive the view
+class StringView
+{
+public:
+	static const size_t NotFound = size_t(-1);
+
+	StringView(void) : mData(""), mSize(0) {}
+	StringView(const char *str) : mData(str), mSize(std::strlen(str)) {}
+	StringView(const char *data, size_t size) : mData(data), mSize(size) {}
+	StringView(const std::string &str) : mData(str.data()), mSize(str.size()) {}
+
+	const char *data(void) const	{ return mData; }
+	size_t size(void) const		{ return mSize; }
+	bool empty(void) const		{ return mSize == 0; }
+	const char *begin(void) const	{ return mData; }
+	const char *end(void) const	{ return mData + mSize; }
+	char operator[](size_t pos) const	{ return mData[pos]; }
+
+	size_t indexOf(char c, size_t from = 0) const;
+	size_t lastIndexOf(char c) const;
+	bool contains(char c) const { return indexOf(c) != NotFound; }
+
+	StringView mid(size_t pos, size_t n = NotFound) const;
+	StringView left(size_t n) const		{ return StringView(mData, std::min(n, mSize)); }
+	StringView after(char c) const;
+	StringView afterLast(char c) const;
+	StringView before(char c) const;
+	StringView beforeLast(char c) const;
+	StringView trimmed(void) const;
+
+	// Same semantics as String::cut(), the view is truncated and the remainder is returned
+	StringView cut(char separator);
+	StringView cutLast(char separator);
+
+	void explode(std::vector<StringView> &views, char separator) const;
+
+	int compare(const StringView &view) const;
+	std::string toStdString(void) const	{ return std::string(mData, mSize); }
+
+private:
+	static bool IsBlank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+	const char *mData;
+	size_t mSize;
+};
+
+inline size_t StringView::indexOf(char c, size_t from) const
+{
+	if(from >= mSize) return NotFound;
+	const char *p = static_cast<const char*>(std::memchr(mData + from, c, mSize - from));
+	return p ? size_t(p - mData) : NotFound;
+}
+
+inline size_t StringView::lastIndexOf(char c) const
+{
+	size_t pos = mSize;
+	while(pos > 0)
+		if(mData[--pos] == c)
+			return pos;
+	return NotFound;
+}
+
+inline StringView StringView::mid(size_t pos, size_t n) const
+{
+	if(pos > mSize) pos = mSize;
+	return StringView(mData + pos, std::min(n, mSize - pos));
+}
+
+inline StringView StringView::after(char c) const
+{
+	size_t pos = indexOf(c);
+	if(pos == NotFound) return *this;
+	else return mid(pos+1);
+}
+
+inline StringView StringView::afterLast(char c) const
+{
+	size_t pos = lastIndexOf(c);
+	if(pos == NotFound) return *this;
+	else return mid(pos+1);
+}
+
+inline StringView StringView::before(char c) const
+{
+	size_t pos = indexOf(c);
+	if(pos == NotFound) return *this;
+	else return left(pos);
+}
+
+inline StringView StringView::beforeLast(char c) const
+{
+	size_t pos = lastIndexOf(c);
+	if(pos == NotFound) return *this;
+	else return left(pos);
+}
+
+inline StringView StringView::trimmed(void) const
+{
+	size_t begin = 0;
+	size_t end = mSize;
+	while(begin < end && IsBlank(mData[begin])) ++begin;
+	while(end > begin && IsBlank(mData[end-1])) --end;
+	return StringView(mData + begin, end - begin);
+}
+
+inline StringView StringView::cut(char separator)
+{
+	size_t pos = indexOf(separator);
+	if(pos == NotFound) return StringView(mData + mSize, 0);
+	StringView after = mid(pos+1);
+	mSize = pos;
+	return after;
+}
+
+inline StringView StringView::cutLast(char separator)
+{
+	size_t pos = lastIndexOf(separator);
+	if(pos == NotFound) return StringView(mData + mSize, 0);
+	StringView after = mid(pos+1);
+	mSize = pos;
+	return after;
+}
+
+inline void StringView::explode(std::vector<StringView> &views, char separator) const
+{
+	views.clear();
+	size_t begin = 0;
+	size_t pos;
+	while((pos = indexOf(separator, begin)) != NotFound)
+	{
+		views.push_back(StringView(mData + begin, pos - begin));
+		begin = pos + 1;
+	}
+	views.push_back(StringView(mData + begin, mSize - begin));
+}
+
+inline int StringView::compare(const StringView &view) const
+{
+	int r = std::memcmp(mData, view.mData, std::min(mSize, view.mSize));
+	if(r != 0) return r;
+	return mSize < view.mSize ? -1 : (mSize > view.mSize ? 1 : 0);
+}
+
+inline bool operator==(const StringView &a, const StringView &b) { return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0; }
+inline bool operator!=(const StringView &a, const StringView &b) { return !(a == b); }
+inline bool operator< (const StringView &a, const StringView &b) { return a.compare(b) < 0; }
+inline bool operator> (const StringView &a, const StringView &b) { return a.compare(b) > 0; }
+inline bool operator<=(const StringView &a, const StringView &b) { return a.compare(b) <= 0; }
+inline bool operator>=(const StringView &a, const StringView &b) { return a.compare(b) >= 0; }
+
+}
+
+#endif
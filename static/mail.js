@@ -29,7 +29,7 @@ function setMailReceiverRec(url, object, period, next) {
 		dataType: 'json',
 		timeout: 300000
 	})
-	.done(function(array) {
+	.done(function(array, textStatus, jqXHR) {
 		var posturl = url;
 		var count = 0;
 		$.each(array, function(i, mail) {
@@ -254,6 +254,10 @@ function setMailReceiverRec(url, object, period, next) {
 		});
 		*/
 
+		// Mail numbers are not contiguous, continue after the last one read
+		var last = jqXHR.getResponseHeader('X-Next');
+		if(last) next = parseInt(last);
+
 		this.messagesTimeout = setTimeout(function() {
 			setMailReceiverRec(url, object, period, next);
 		}, period);
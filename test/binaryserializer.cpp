@@ -0,0 +1,131 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include "pla/binaryserializer.hpp"
+#include "pla/binarystring.hpp"
+#include "pla/map.hpp"
+#include "pla/array.hpp"
+
+using namespace pla;
+
+struct Values
+{
+	uint8_t u8 = 0;
+	int16_t i16 = 0;
+	uint32_t u32 = 0;
+	int64_t i64 = 0;
+	double d = 0.;
+	bool b = false;
+	BinaryString small;
+	BinaryString large;
+	String empty;
+	Array<String> array;
+	Map<String, uint64_t> map;
+
+	bool operator==(const Values &v) const
+	{
+		return u8 == v.u8 && i16 == v.i16 && u32 == v.u32 && i64 == v.i64 && d == v.d && b == v.b
+			&& small == v.small && large == v.large && empty == v.empty && array == v.array && map == v.map;
+	}
+};
+
+static void write(Serializer &s, const Values &v)
+{
+	s << v.u8 << v.i16 << v.u32 << v.i64 << v.d << v.b;
+	s << v.small << v.large << v.empty << v.array << v.map;
+}
+
+static bool read(Serializer &s, Values &v)
+{
+	if(!(s >> v.u8) || !(s >> v.i16) || !(s >> v.u32) || !(s >> v.i64) || !(s >> v.d) || !(s >> v.b))
+		return false;
+
+	if(!(s >> v.small) || !(s >> v.large) || !(s >> v.empty) || !(s >> v.array) || !(s >> v.map))
+		return false;
+
+	return true;
+}
+
+void testBinarySerializer(void)
+{
+	Values values;
+	values.u8 = 0xAB;
+	values.i16 = -12345;
+	values.u32 = 0xDEADBEEF;
+	values.i64 = std::numeric_limits<int64_t>::min() + 1;
+	values.d = 3.25;
+	values.b = true;
+	values.small = "small";
+	values.large.resize(100000);
+	for(size_t i = 0; i < values.large.size(); ++i) values.large[i] = char(i);
+	for(int i = 0; i < 10; ++i) values.array.append(String(size_t(i), 'a'));
+	values.map.insert("one", 1);
+	values.map.insert("max", std::numeric_limits<uint64_t>::max());
+
+	BinaryString data;
+	{
+		BinarySerializer serializer(&data);
+		write(serializer, values);
+	}
+
+	// Integers are big-endian on the wire
+	Check(uint8_t(data[0]) == 0xAB);
+	Check(uint8_t(data[1]) == 0xCF && uint8_t(data[2]) == 0xC7);
+
+	// Stream path
+	{
+		BinaryString copy(data);
+		BinarySerializer serializer(&copy);
+		Values result;
+		Check(read(serializer, result));
+		Check(result == values);
+	}
+
+	// Contiguous buffer path
+	{
+		BinarySerializer serializer(data.data(), data.size());
+		Values result;
+		Check(read(serializer, result));
+		Check(result == values);
+		Check(serializer.left() == 0);
+
+		uint8_t extra;
+		Check(!(serializer >> extra));
+	}
+
+	// Truncated buffer, either the end is reached or the string length is rejected
+	for(size_t size : { size_t(0), size_t(1), size_t(20), data.size()/2, data.size() - 1 })
+	{
+		BinarySerializer serializer(data.data(), size);
+		Values result;
+		bool failed = false;
+		try {
+			failed = !read(serializer, result);
+		}
+		catch(const IOException &e)
+		{
+			failed = true;
+		}
+		Check(failed);
+	}
+}
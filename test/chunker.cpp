@@ -0,0 +1,105 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include "tpn/chunker.hpp"
+
+#include "pla/binarystring.hpp"
+#include "pla/set.hpp"
+
+using namespace tpn;
+
+static BinaryString makeData(size_t size, uint64_t seed)
+{
+	// Incompressible but deterministic content
+	BinaryString data;
+	data.resize(size);
+	for(size_t i = 0; i < size; i+= 8)
+	{
+		uint64_t z = (seed+= 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z^= z >> 31;
+		std::memcpy(&data[i], &z, std::min(size_t(8), size - i));
+	}
+	return data;
+}
+
+// Return the end offsets of chunks
+static Array<size_t> chunk(const BinaryString &data)
+{
+	BinaryString input(data);
+	Chunker chunker(&input);
+
+	Array<size_t> ends;
+	size_t offset = 0;
+	size_t size;
+	while((size = chunker.next()) > 0)
+	{
+		Check(size <= Chunker::MaxSize);
+		offset+= size;
+		ends.append(offset);
+	}
+
+	Check(offset == data.size());
+	return ends;
+}
+
+void testChunker(void)
+{
+	const size_t total = 16*Chunker::MaxSize + 12345;
+	const BinaryString data = makeData(total, 1);
+
+	Array<size_t> ends = chunk(data);
+	Check(ends.size() >= total/Chunker::MaxSize);
+
+	// Every chunk but the last is at least MinSize
+	size_t previous = 0;
+	for(size_t i = 0; i + 1 < ends.size(); ++i)
+	{
+		Check(ends[i] - previous > Chunker::MinSize);
+		previous = ends[i];
+	}
+
+	// Boundaries are deterministic
+	Check(chunk(data) == ends);
+
+	// Inserting data at the beginning only moves the first boundaries
+	const size_t shift = 1000;
+	BinaryString shifted = makeData(shift, 2);
+	shifted.append(data);
+
+	Set<size_t> original;
+	for(size_t end : ends) original.insert(end + shift);
+
+	size_t common = 0;
+	Array<size_t> shiftedEnds = chunk(shifted);
+	for(size_t end : shiftedEnds)
+		if(original.contains(end))
+			++common;
+
+	Check(common + 2 >= ends.size());
+
+	// Short input is a single chunk
+	Check(chunk(makeData(Chunker::MinSize/2, 3)).size() == 1);
+	Check(chunk(BinaryString()).empty());
+}
@@ -0,0 +1,61 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include "tpn/config.hpp"
+
+using namespace tpn;
+
+void testConfig(void)
+{
+	const Config::Value value("test_value");
+	Check(value.toString().empty());
+	Check(value.toInt() == 0);
+
+	static int notified = 0;	// watchers can't be removed
+	Config::Watch([]() { ++notified; });
+
+	// Handles follow changes, values are parsed for every type
+	Config::Put("test_value", "2.5");
+	Check(value.toString() == "2.5");
+	Check(value.toDouble() == 2.5);
+	Check(value.toInt() == 2);
+	Check(notified == 1);
+
+	Config::Default("test_value", "3");
+	Check(value.toString() == "2.5");
+	Check(notified == 1);
+
+	Config::Put("test_value", "true");
+	Check(value.toBool());
+	Check(value.toInt() == 0);	// mismatching types are left to default
+	Check(notified == 2);
+
+	// Handles created afterwards see the current value
+	const Config::Value other("test_value");
+	Check(other.toBool());
+	Check(Config::Get("test_value") == "true");
+
+	Config::Clear();
+	Check(value.toString().empty());
+	Check(notified == 3);
+}
@@ -0,0 +1,102 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include "pla/crypto.hpp"
+#include "pla/binarystring.hpp"
+
+using namespace pla;
+
+static BinaryString makeData(size_t size, uint8_t seed)
+{
+	BinaryString data;
+	data.resize(size);
+	for(size_t i = 0; i < size; ++i)
+		data[i] = char(uint8_t(i*31 + seed));
+	return data;
+}
+
+// Reference output, transforming one cipher block at a time as Cipher used to
+static BinaryString referenceCtr(const BinaryString &key, const BinaryString &iv, const BinaryString &data)
+{
+	struct CTR_CTX(struct aes_ctx, AES_BLOCK_SIZE) ctx;
+	aes_set_encrypt_key(&ctx.ctx, key.size(), key.bytes());
+	CTR_SET_COUNTER(&ctx, iv.bytes());
+
+	BinaryString result(data);
+	for(size_t i = 0; i < result.size(); i+= AES_BLOCK_SIZE)
+	{
+		uint8_t *ptr = result.bytes() + i;
+		CTR_CRYPT(&ctx, aes_encrypt, std::min(result.size() - i, size_t(AES_BLOCK_SIZE)), ptr, ptr);
+	}
+
+	return result;
+}
+
+static BinaryString encrypt(const BinaryString &key, const BinaryString &iv, const BinaryString &data, size_t chunk)
+{
+	BinaryString result;
+	AesCtr cipher(&result);
+	cipher.setEncryptionKey(key);
+	cipher.setInitializationVector(iv);
+	for(size_t i = 0; i < data.size(); i+= chunk)
+		cipher.writeData(data.data() + i, std::min(chunk, data.size() - i));
+
+	Check(cipher.tellWrite() == int64_t(data.size()));
+	cipher.close();
+	return result;
+}
+
+static BinaryString decrypt(const BinaryString &key, const BinaryString &iv, const BinaryString &data, size_t chunk)
+{
+	BinaryString input(data);
+	AesCtr cipher(&input);
+	cipher.setDecryptionKey(key);
+	cipher.setInitializationVector(iv);
+
+	BinaryString result;
+	result.resize(data.size() + chunk);
+	size_t size = 0, len;
+	while((len = cipher.readData(&result[size], std::min(chunk, result.size() - size))) > 0)
+		size+= len;
+
+	Check(cipher.tellRead() == int64_t(size));
+	result.resize(size);
+	return result;
+}
+
+void testCipher(void)
+{
+	const BinaryString key = makeData(32, 1);
+	const BinaryString iv = makeData(16, 2);
+
+	// Spans straddle the staging buffer, with a partial final block
+	const BinaryString data = makeData(3*Cipher::StagingSize + 37, 3);
+	const size_t chunks[] = { 1, 13, 16, 4096, Cipher::StagingSize, Cipher::StagingSize + 5, data.size() };
+
+	const BinaryString ctr = referenceCtr(key, iv, data);
+	for(size_t chunk : chunks)
+	{
+		Check(encrypt(key, iv, data, chunk) == ctr);
+		Check(decrypt(key, iv, ctr, chunk) == data);
+	}
+}
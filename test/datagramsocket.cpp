@@ -0,0 +1,97 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include "pla/datagramsocket.hpp"
+
+using namespace pla;
+
+void testDatagramSocket(void)
+{
+	const Address local("127.0.0.1", 0);
+	DatagramSocket receiver(local);
+	DatagramSocket mapped(local);
+	DatagramSocket unmapped(local);
+
+	const Address receiverAddr = receiver.getBindAddress();
+	DatagramStream stream(&receiver, mapped.getBindAddress());
+	stream.setTimeout(seconds(5.));
+
+	// Several receive batches for the stream, then one datagram from an unmapped sender
+	const int count = 3*DatagramSocket::RecvBatchSize + 5;
+	for(int i = 0; i < count; ++i)
+	{
+		String data = "datagram " + String::number(i);
+		mapped.write(data.data(), data.size(), receiverAddr);
+	}
+
+	String last = "unmapped";
+	unmapped.write(last.data(), last.size(), receiverAddr);
+
+	// Reading from the socket demultiplexes everything received before the unmapped datagram
+	char buffer[DatagramSocket::MaxDatagramSize];
+	Address sender;
+	int size = receiver.read(buffer, sizeof(buffer), sender, seconds(5.));
+	Check(size == int(last.size()));
+	Check(String(buffer, size_t(size)) == last);
+	Check(sender == unmapped.getBindAddress());
+
+	for(int i = 0; i < count; ++i)
+	{
+		String data = "datagram " + String::number(i);
+		size_t len = stream.readData(buffer, sizeof(buffer));
+		Check(String(buffer, len) == data);
+		Check(stream.nextRead());
+	}
+
+	Check(!stream.waitData(duration::zero()));
+	Check(receiver.read(buffer, sizeof(buffer), sender, duration::zero()) < 0);
+
+	// Datagrams are dropped once the stream queues more than MaxQueueSize bytes
+	const size_t maxQueueSize = DatagramStream::MaxQueueSize;
+	DatagramStream::MaxQueueSize = 100;
+	for(int i = 0; i < 20; ++i)
+		mapped.write("0123456789", 10, receiverAddr);
+
+	unmapped.write(last.data(), last.size(), receiverAddr);
+	size = receiver.read(buffer, sizeof(buffer), sender, seconds(5.));
+	DatagramStream::MaxQueueSize = maxQueueSize;
+	Check(size == int(last.size()));
+	Check(receiver.droppedCount() == 10);
+
+	int queued = 0;
+	while(stream.waitData(duration::zero()) && stream.nextRead()) ++queued;
+	Check(queued == 10);
+
+	// Writes on a shut down stream fail
+	stream.shutdown();
+	bool thrown = false;
+	try {
+		stream.writeData("x", 1);
+		stream.nextWrite();
+	}
+	catch(const NetException &e)
+	{
+		thrown = true;
+	}
+	Check(thrown);
+}
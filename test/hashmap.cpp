@@ -0,0 +1,125 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include "pla/hashmap.hpp"
+#include "pla/hashset.hpp"
+#include "pla/string.hpp"
+#include "pla/stringview.hpp"
+
+#include <map>
+
+using namespace pla;
+
+void testHashMap(void)
+{
+	HashMap<String, int> map;
+	std::map<String, int> reference;
+
+	// Enough entries to force several rehashes
+	for(int i = 0; i < 5000; ++i)
+	{
+		String key = "key" + String::number(i);
+		map.insert(key, i);
+		reference[key] = i;
+	}
+
+	Check(map.size() == reference.size());
+	Check(map.insert("key42", -1)->second == 42);	// existing value is kept
+
+	// Erase every third entry, leaving tombstones behind
+	for(int i = 0; i < 5000; i+= 3)
+	{
+		String key = "key" + String::number(i);
+		Check(map.erase(key) == 1);
+		reference.erase(key);
+	}
+
+	Check(map.erase(String("key0")) == 0);
+	Check(map.size() == reference.size());
+
+	// Reinsert over tombstones
+	for(int i = 0; i < 5000; i+= 6)
+	{
+		String key = "key" + String::number(i);
+		map[key] = i*2;
+		reference[key] = i*2;
+	}
+
+	Check(map.size() == reference.size());
+	for(auto &p : reference)
+	{
+		int value = 0;
+		Check(map.get(p.first, value));
+		Check(value == p.second);
+	}
+
+	size_t count = 0;
+	for(auto &p : map)
+	{
+		Check(reference.find(p.first) != reference.end());
+		Check(reference[p.first] == p.second);
+		++count;
+	}
+	Check(count == reference.size());
+
+	// Heterogeneous lookup without building a String
+	Check(map.contains("key1"));
+	Check(map.contains(StringView("key2")));
+	Check(!map.contains("key3"));
+	Check(map.getOrDefault(String("key3"), -1) == -1);
+
+	bool thrown = false;
+	try { map.get(String("missing")); }
+	catch(const OutOfBounds &e) { thrown = true; }
+	Check(thrown);
+
+	HashMap<String, int> copy(map);
+	map.clear();
+	Check(map.empty() && !map.contains("key1"));
+	Check(copy.size() == reference.size() && copy.contains("key1"));
+}
+
+void testHashSet(void)
+{
+	HashSet<int> set;
+	for(int i = 0; i < 1000; ++i)
+		Check(set.insert(i).second);
+
+	Check(!set.insert(500).second);
+	Check(set.size() == 1000);
+
+	for(int i = 0; i < 1000; i+= 2)
+		Check(set.remove(i));
+
+	Check(!set.remove(0));
+	Check(set.size() == 500);
+	for(int i = 0; i < 1000; ++i)
+		Check(set.contains(i) == (i % 2 == 1));
+
+	HashSet<int> other;
+	other.insert(0);
+	other.insert(1);
+	set.insertAll(other);
+	Check(set.size() == 501);
+	Check(set.contains(0));
+}
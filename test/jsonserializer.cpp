@@ -0,0 +1,173 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include "pla/jsonserializer.hpp"
+#include "pla/binarystring.hpp"
+#include "pla/file.hpp"
+#include "pla/map.hpp"
+#include "pla/array.hpp"
+
+using namespace pla;
+
+// Stream returning at most a few bytes per read, so tokens straddle refills
+class ChunkedStream : public Stream
+{
+public:
+	ChunkedStream(const BinaryString &data, size_t chunk) : mData(data), mPos(0), mChunk(chunk) {}
+
+	size_t readData(char *buffer, size_t size)
+	{
+		size = std::min(std::min(size, mChunk), mData.size() - mPos);
+		std::memcpy(buffer, mData.data() + mPos, size);
+		mPos+= size;
+		return size;
+	}
+
+	void writeData(const char *data, size_t size)
+	{
+		throw Unsupported("Writing to ChunkedStream");
+	}
+
+private:
+	BinaryString mData;
+	size_t mPos;
+	size_t mChunk;
+};
+
+static void fillRecord(Map<String, String> &record)
+{
+	// Values around the buffer size, with escapes close to the boundaries
+	for(size_t size = BufferSize - 3; size <= BufferSize + 3; ++size)
+	{
+		String value(size, 'x');
+		value[size/2] = '"';
+		value[size-2] = '\\';
+		value[size-1] = '\n';
+		record.insert("key" + String::number(unsigned(size)), value);
+	}
+
+	record.insert("empty", "");
+}
+
+void testJsonSerializer(void)
+{
+	Map<String, String> record;
+	fillRecord(record);
+
+	Array<int64_t> numbers;
+	numbers.append(0);
+	numbers.append(-1);
+	numbers.append(std::numeric_limits<int64_t>::min());
+	numbers.append(std::numeric_limits<int64_t>::max());
+
+	BinaryString json;
+	{
+		JsonSerializer serializer(&json);
+		serializer << record;
+		serializer << numbers;
+	}
+
+	// In place over the string
+	{
+		BinaryString copy(json);
+		JsonSerializer serializer(&copy);
+		Map<String, String> result;
+		Array<int64_t> resultNumbers;
+		serializer >> result;
+		serializer >> resultNumbers;
+		Check(result == record);
+		Check(resultNumbers == numbers);
+	}
+
+	// Buffered over a stream, with various read sizes
+	const size_t chunks[] = { 1, 7, BufferSize - 1, BufferSize, BufferSize + 1 };
+	for(size_t chunk : chunks)
+	{
+		ChunkedStream stream(json, chunk);
+		JsonSerializer serializer(&stream);
+		Map<String, String> result;
+		Array<int64_t> resultNumbers;
+		serializer >> result;
+		serializer >> resultNumbers;
+		Check(result == record);
+		Check(resultNumbers == numbers);
+	}
+}
+
+void testJsonSerializerGiveBack(void)
+{
+	Map<String, String> record;
+	fillRecord(record);
+
+	String filename = File::TempName();
+	try {
+		{
+			File file(filename, File::Truncate);
+			JsonSerializer serializer(&file);
+			serializer << record;
+			file.write("trailing line\n");
+		}
+
+		// Input read ahead by the serializer is given back to the file on destruction
+		File file(filename, File::Read);
+		{
+			JsonSerializer serializer(&file);
+			Map<String, String> result;
+			serializer >> result;
+			Check(result == record);
+		}
+
+		String line;
+		Check(file.readLine(line));
+		Check(line == "trailing line");
+		file.close();
+	}
+	catch(...)
+	{
+		File::Remove(filename);
+		throw;
+	}
+
+	File::Remove(filename);
+}
+
+void testJsonSerializerUnsigned(void)
+{
+	const char *invalid[] = { "-1", " -1", "-0", "18446744073709551616", "abc" };
+	for(const char *str : invalid)
+	{
+		BinaryString json(str);
+		JsonSerializer serializer(&json);
+		uint64_t value = 0;
+		bool thrown = false;
+		try { serializer >> value; }
+		catch(const IOException &e) { thrown = true; }
+		Check(thrown);
+	}
+
+	BinaryString json("18446744073709551615");
+	JsonSerializer serializer(&json);
+	uint64_t value = 0;
+	serializer >> value;
+	Check(value == std::numeric_limits<uint64_t>::max());
+}
@@ -0,0 +1,69 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include <iostream>
+
+struct Test
+{
+	const char *name;
+	void (*run)(void);
+};
+
+// Registered tests, terminated by a null entry
+static const Test Tests[] = {
+	{ "binary serializer", testBinarySerializer },
+	{ "chunker", testChunker },
+	{ "cipher", testCipher },
+	{ "config", testConfig },
+	{ "datagram socket", testDatagramSocket },
+	{ "directory index", testDirectoryIndex },
+	{ "hash map", testHashMap },
+	{ "hash set", testHashSet },
+	{ "index record", testIndexRecord },
+	{ "json serializer", testJsonSerializer },
+	{ "json serializer give back", testJsonSerializerGiveBack },
+	{ "json serializer unsigned", testJsonSerializerUnsigned },
+	{ "overlay batch", testOverlayBatch },
+	{ "path tree", testPathTree },
+	{ "string view", testStringView },
+	{ NULL, NULL }
+};
+
+int main(int argc, char** argv)
+{
+	int failed = 0;
+	for(const Test *test = Tests; test->name; ++test)
+	{
+		try {
+			test->run();
+			std::cout << "PASS " << test->name << std::endl;
+		}
+		catch(const std::exception &e)
+		{
+			std::cout << "FAIL " << test->name << ": " << e.what() << std::endl;
+			++failed;
+		}
+	}
+
+	return (failed ? 1 : 0);
+}
@@ -0,0 +1,101 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include "tpn/overlay.hpp"
+
+#include "pla/crypto.hpp"
+
+using namespace tpn;
+
+void testOverlayBatch(void)
+{
+	Set<BinaryString> keys;
+	for(int i = 0; i < 100; ++i)
+	{
+		BinaryString key;
+		BinaryString data = BinaryString::number(uint32_t(i));
+		Sha256().compute(data.data(), data.size(), key);
+		keys.insert(key);
+	}
+
+	const BinaryString value("node");
+
+	// Batches round-trip and stay under MaxBatchSize
+	Array<Overlay::Message> messages;
+	Check(Overlay::MakeBatch(Overlay::Message::StoreBatch, keys, value, true, messages) > 1);
+
+	Set<BinaryString> decoded;
+	for(const Overlay::Message &message : messages)
+	{
+		Check(message.type == Overlay::Message::StoreBatch);
+		Check(message.content.size() <= Overlay::MaxBatchSize);
+
+		Array<BinaryString> batch;
+		BinaryString batchValue;
+		Check(Overlay::ParseBatch(message, batch, batchValue));
+		Check(batchValue == value);
+		for(const BinaryString &key : batch) decoded.insert(key);
+	}
+
+	Check(decoded == keys);
+
+	Check(Overlay::MakeBatch(Overlay::Message::RetrieveBatch, keys, "", true, messages) > 1);
+	decoded.clear();
+	for(const Overlay::Message &message : messages)
+	{
+		Array<BinaryString> batch;
+		BinaryString batchValue;
+		Check(Overlay::ParseBatch(message, batch, batchValue));
+		Check(batchValue.empty());
+		for(const BinaryString &key : batch) decoded.insert(key);
+	}
+
+	Check(decoded == keys);
+
+	// A peer which did not advertise batch support gets one message per key
+	Check(Overlay::MakeBatch(Overlay::Message::StoreBatch, keys, value, false, messages) == int(keys.size()));
+	decoded.clear();
+	for(const Overlay::Message &message : messages)
+	{
+		Check(message.type == Overlay::Message::Store);
+		Check(message.content.toBinary() == value);
+		decoded.insert(message.destination);
+	}
+
+	Check(decoded == keys);
+
+	Check(Overlay::MakeBatch(Overlay::Message::RetrieveBatch, keys, "", false, messages) == int(keys.size()));
+	for(const Overlay::Message &message : messages)
+	{
+		Check(message.type == Overlay::Message::Retrieve);
+		Check(message.content.empty());
+		Check(keys.contains(message.destination));
+	}
+
+	// Truncated or mistyped contents are rejected
+	Overlay::Message truncated(Overlay::Message::StoreBatch, BinaryString(value));
+	Array<BinaryString> batch;
+	BinaryString batchValue;
+	Check(!Overlay::ParseBatch(truncated, batch, batchValue));
+	Check(!Overlay::ParseBatch(Overlay::Message(Overlay::Message::Store, BinaryString(value)), batch, batchValue));
+}
@@ -0,0 +1,87 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include "pla/pathtree.hpp"
+#include "pla/array.hpp"
+
+using namespace pla;
+
+void testPathTree(void)
+{
+	PathTree<int> tree;
+	tree.insert("/", 0);
+	tree.insert("/a", 1);
+	tree.insert("/a/b", 2);
+	tree.insert("/a/b", 3);
+	tree.insert("/ab", 4);
+	tree.insert("other", 5);
+
+	Array<String> prefixes;
+	Array<int> values;
+	auto collect = [&](const String &prefix, const Set<int> &set)
+	{
+		prefixes.append(prefix);
+		for(int v : set) values.append(v);
+	};
+
+	// Longest prefix first, segments are matched as a whole
+	tree.match("/a/b/c", collect);
+	Check(prefixes.size() == 3);
+	Check(prefixes[0] == "/a/b" && prefixes[1] == "/a" && prefixes[2] == "/");
+	Check(values.size() == 4);
+
+	prefixes.clear(); values.clear();
+	tree.match("/abc", collect);
+	Check(prefixes.size() == 1 && prefixes[0] == "/");
+
+	prefixes.clear(); values.clear();
+	tree.match("other", collect);	// prefixes not starting with '/' are never matched
+	Check(prefixes.empty());
+
+	int count = 0;
+	tree.forEach([&](const String &prefix, const Set<int> &set) { count+= set.size(); });
+	Check(count == 6);
+
+	// Erase while walking, pruning is deferred until the walk is over
+	tree.match("/a/b", [&](const String &prefix, const Set<int> &set)
+	{
+		if(prefix == "/a/b")
+		{
+			tree.erase("/a/b", 2);
+			tree.erase("/a/b", 3);
+		}
+	});
+
+	prefixes.clear(); values.clear();
+	tree.match("/a/b", collect);
+	Check(prefixes.size() == 2 && prefixes[0] == "/a");
+
+	Check(!tree.erase("/a/b", 2));
+	Check(!tree.erase("/x", 1));
+	Check(tree.erase("/a", 1));
+	Check(tree.erase("/ab", 4));
+	Check(tree.erase("/", 0));
+	Check(!tree.empty());
+	Check(tree.erase("other", 5));
+	Check(tree.empty());
+}
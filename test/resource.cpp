@@ -0,0 +1,199 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include "tpn/resource.hpp"
+
+#include "pla/file.hpp"
+#include "pla/binaryserializer.hpp"
+#include "pla/object.hpp"
+
+using namespace tpn;
+
+typedef Resource::DirectoryIndex DirectoryIndex;
+typedef Resource::DirectoryRecord DirectoryRecord;
+typedef Resource::IndexRecord IndexRecord;
+
+static BinaryString readFile(const String &filename)
+{
+	File file(filename, File::Read);
+	BinaryString data;
+	file.readBinary(data);
+	return data;
+}
+
+static void writeFile(const String &filename, const BinaryString &data)
+{
+	File file(filename, File::Truncate);
+	file.writeBinary(data);
+}
+
+static bool isValid(const String &filename)
+{
+	try {
+		DirectoryIndex index(filename);
+		return true;
+	}
+	catch(const Exception &e)
+	{
+		return false;
+	}
+}
+
+static void testDirectoryIndexFile(const String &filename)
+{
+	const int count = 100;
+
+	// Names in reverse order, digests shared by pairs of records
+	int i = 0;
+	size_t written = DirectoryIndex::Write([&i](DirectoryRecord &record) {
+		if(i == count) return false;
+		record.name = "file" + String::number(count - i, 3);
+		record.type = (i % 10 == 0 ? "directory" : "file");
+		record.size = i*1000;
+		record.digest = BinaryString::number(uint32_t(i/2));
+		record.time = Time(time_t(1000000000 + i));
+		++i;
+		return true;
+	}, filename);
+
+	Check(written == size_t(count));
+
+	{
+		DirectoryIndex index(filename);
+		Check(index.count() == size_t(count));
+		Check(index.uniqueCount() == size_t(count/2));
+
+		// Records keep their order, lookups go through the sorted tables
+		DirectoryRecord record;
+		for(int j = 0; j < count; ++j)
+		{
+			index.get(j, record);
+			Check(record.name == "file" + String::number(count - j, 3));
+			Check(record.type == (j % 10 == 0 ? "directory" : "file"));
+			Check(record.size == j*1000);
+			Check(record.digest == BinaryString::number(uint32_t(j/2)));
+			Check(record.time.toUnixTime() == time_t(1000000000 + j));
+
+			DirectoryRecord found;
+			Check(index.find(record.name, found));
+			Check(found.size == record.size);
+
+			BinaryString digest = BinaryString::number(uint32_t(j/2));
+			Check(index.findDigest(digest) == size_t(j - j%2));	// first matching index
+		}
+
+		Check(!index.find("missing", record));
+		Check(!index.contains(BinaryString::number(uint32_t(count))));
+	}
+
+	// Corrupted or truncated files are rejected
+	const BinaryString data = readFile(filename);
+	const size_t headerSize = 32;
+	const size_t entrySize = 40;
+
+	BinaryString corrupted(data);
+	corrupted[0] = 'x';	// magic
+	writeFile(filename, corrupted);
+	Check(!isValid(filename));
+
+	corrupted = data;
+	corrupted.resize(data.size() - 1);
+	writeFile(filename, corrupted);
+	Check(!isValid(filename));
+
+	corrupted = data;
+	uint32_t invalid = uint32_t(count);
+	std::memcpy(&corrupted[headerSize + count*entrySize], &invalid, sizeof(invalid));	// byName[0]
+	writeFile(filename, corrupted);
+	Check(!isValid(filename));
+
+	corrupted = data;
+	invalid = std::numeric_limits<uint32_t>::max();
+	std::memcpy(&corrupted[headerSize + 16], &invalid, sizeof(invalid));	// first name offset
+	writeFile(filename, corrupted);
+	Check(!isValid(filename));
+
+	writeFile(filename, data);
+	Check(isValid(filename));
+
+	File::Remove(filename);
+	Check(!isValid(filename));
+}
+
+void testDirectoryIndex(void)
+{
+	String filename = File::TempName();
+	try {
+		testDirectoryIndexFile(filename);
+	}
+	catch(...)
+	{
+		if(File::Exist(filename)) File::Remove(filename);
+		throw;
+	}
+}
+
+void testIndexRecord(void)
+{
+	IndexRecord record;
+	record.name = "file";
+	record.type = "file";
+	record.size = 3*1024*1024;
+	for(int i = 0; i < 4; ++i)
+	{
+		record.blockDigests.append(BinaryString::number(uint32_t(i)));
+		record.blockSizes.append(int64_t(512*1024 + i*128*1024));
+	}
+
+	BinaryString data;
+	BinarySerializer serializer(&data);
+	serializer << record;
+	serializer << uint32_t(42);	// following value
+
+	{
+		IndexRecord result;
+		BinarySerializer deserializer(data.data(), data.size());
+		Check(!!(deserializer >> result));
+		Check(result.size == record.size);
+		Check(result.blockDigests == record.blockDigests);
+		Check(result.blockSizes == record.blockSizes);
+	}
+
+	// Older nodes don't know sizes, they must skip them and stay in sync
+	{
+		String name, type;
+		int64_t size = 0;
+		Array<BinaryString> digests;
+		uint32_t following = 0;
+		BinarySerializer deserializer(data.data(), data.size());
+		Check(!!(deserializer >> Object()
+			.insert("name", name)
+			.insert("type", type)
+			.insert("size", size)
+			.insert("digests", digests)));
+		Check(!!(deserializer >> following));
+		Check(name == record.name);
+		Check(digests == record.blockDigests);
+		Check(following == 42);
+	}
+}
@@ -0,0 +1,89 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "test/test.hpp"
+
+#include "pla/string.hpp"
+#include "pla/stringview.hpp"
+
+#include <list>
+#include <vector>
+
+using namespace pla;
+
+static bool same(const StringView &view, const String &str)
+{
+	return view.toStdString() == str;
+}
+
+void testStringView(void)
+{
+	const char *samples[] = { "", "/", "a", "/a/b/c", "a/b/", "//", "no separator", " \t padded \r\n" };
+
+	// The view variants must agree with their allocating String counterparts
+	for(const char *sample : samples)
+	{
+		String str(sample);
+		StringView view(str);
+
+		Check(same(view.after('/'), str.after('/')));
+		Check(same(view.afterLast('/'), str.afterLast('/')));
+		Check(same(view.before('/'), str.before('/')));
+		Check(same(view.beforeLast('/'), str.beforeLast('/')));
+		Check(same(str.afterView('/'), str.after('/')));
+		Check(same(str.beforeLastView('/'), str.beforeLast('/')));
+		Check(same(view.trimmed(), str.trimmed()));
+
+		String strHead(str), strLastHead(str);
+		StringView viewHead(view), viewLastHead(view);
+		Check(same(viewHead.cut('/'), strHead.cut('/')));
+		Check(same(viewHead, strHead));
+		Check(same(viewLastHead.cutLast('/'), strLastHead.cutLast('/')));
+		Check(same(viewLastHead, strLastHead));
+
+		std::list<String> strings;
+		std::vector<StringView> views;
+		str.explode(strings, '/');
+		view.explode(views, '/');
+		Check(strings.size() == views.size());
+		auto it = strings.begin();
+		for(const StringView &v : views)
+			Check(same(v, *it++));
+	}
+
+	StringView view("hello world");
+	Check(view.indexOf('o') == 4);
+	Check(view.indexOf('o', 5) == 7);
+	Check(view.indexOf('o', 100) == StringView::NotFound);
+	Check(view.lastIndexOf('o') == 7);
+	Check(view.lastIndexOf('z') == StringView::NotFound);
+	Check(view.mid(6) == "world");
+	Check(view.mid(100).empty());
+	Check(view.mid(0, 5) == "hello");
+	Check(view.left(100) == view);
+
+	// Ordering is bytewise, then by length
+	Check(StringView("abc") < StringView("abd"));
+	Check(StringView("ab") < StringView("abc"));
+	Check(StringView("abc") == StringView("abcdef", 3));
+	Check(StringView("b") > StringView("abc"));
+	Check(StringView().compare(StringView("")) == 0);
+}
@@ -0,0 +1,46 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef TPN_TEST_H
+#define TPN_TEST_H
+
+#include "tpn/include.hpp"
+
+// Unlike Assert, checks are never compiled out
+#define Check(condition) if(!(condition)) throw AssertException(__FILE__, __LINE__, "Check failed : " #condition)
+
+void testBinarySerializer(void);
+void testChunker(void);
+void testCipher(void);
+void testConfig(void);
+void testDatagramSocket(void);
+void testDirectoryIndex(void);
+void testHashMap(void);
+void testHashSet(void);
+void testIndexRecord(void);
+void testJsonSerializer(void);
+void testJsonSerializerGiveBack(void);
+void testJsonSerializerUnsigned(void);
+void testOverlayBatch(void);
+void testPathTree(void);
+void testStringView(void);
+
+#endif
@@ -738,6 +738,14 @@ void AddressBook::Contact::init(void)
 		}
 
 		Interface::Instance->add(nUrlPrefix(), this);
+
+		handle("info", [this](const Network::Link &link, Serializer &serializer) {
+			return recvInfo(link, serializer);
+		});
+		handle("contacts", [this](const Network::Link &link, Serializer &serializer) {
+			return recvContacts(link, serializer);
+		});
+
 		listen(mAddressBook->user()->identifier(), mIdentifier);
 	}
 }
@@ -905,52 +913,59 @@ bool AddressBook::Contact::recv(const Network::Link &link, const String &type, S
 {
 	if(!mAddressBook) return false;
 
-	LogDebug("AddressBook::Contact", "Contact " + uniqueName() + ": received message (type=\"" + type + "\")");
+	LogWarn("AddressBook::Contact::recv", "Unknown message type \"" + type + "\"");
+	return false;
+}
 
-	if(type == "info")
-	{
-		String instance;
-		BinaryString remoteSecret;
-		serializer >> Object()
-			.insert("instance", instance)
-			.insert("secret", remoteSecret);
-
-		sptr<Board> board;
-		if(!isSelf())
-		{
-			BinaryString boardId = mAddressBook->user()->identifier() ^ identifier();
-			board = std::make_shared<Board>(boardId.toString(), secret().toString(), name());
-		}
+bool AddressBook::Contact::recvInfo(const Network::Link &link, Serializer &serializer)
+{
+	if(!mAddressBook) return false;
 
-		LogDebug("AddressBook::Contact", "Remote instance name: \"" + instance + "\"");
+	LogDebug("AddressBook::Contact", "Contact " + uniqueName() + ": received message (type=\"info\")");
 
-		{
-			std::unique_lock<std::mutex> lock(mMutex);
-			mInstances[link.node] = instance;
-			mRemoteSecret = remoteSecret;
-			mPrivateBoard = board;
-		}
+	String instance;
+	BinaryString remoteSecret;
+	serializer >> Object()
+		.insert("instance", instance)
+		.insert("secret", remoteSecret);
 
-		mAddressBook->save();
-	}
-	else if(type == "contacts")
+	sptr<Board> board;
+	if(!isSelf())
 	{
-		if(!isSelf()) throw Exception("Received contacts from other than self");
+		BinaryString boardId = mAddressBook->user()->identifier() ^ identifier();
+		board = std::make_shared<Board>(boardId.toString(), secret().toString(), name());
+	}
 
-		BinaryString digest;
-		Time time = 0;
-		serializer >> Object()
-			.insert("digest", digest)
-			.insert("time", time);
+	LogDebug("AddressBook::Contact", "Remote instance name: \"" + instance + "\"");
 
-		if(!digest.empty() && digest != mAddressBook->digest() && time > mAddressBook->time())
-			mAddressBook->mScheduler.schedule(Scheduler::clock::now(), Resource::ImportTask(mAddressBook, digest, "contacts", secret()));
-	}
-	else {
-		LogWarn("AddressBook::Contact::recv", "Unknown message type \"" + type + "\"");
-		return false;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mInstances[link.node] = instance;
+		mRemoteSecret = remoteSecret;
+		mPrivateBoard = board;
 	}
 
+	mAddressBook->save();
+	return true;
+}
+
+bool AddressBook::Contact::recvContacts(const Network::Link &link, Serializer &serializer)
+{
+	if(!mAddressBook) return false;
+
+	LogDebug("AddressBook::Contact", "Contact " + uniqueName() + ": received message (type=\"contacts\")");
+
+	if(!isSelf()) throw Exception("Received contacts from other than self");
+
+	BinaryString digest;
+	Time time = 0;
+	serializer >> Object()
+		.insert("digest", digest)
+		.insert("time", time);
+
+	if(!digest.empty() && digest != mAddressBook->digest() && time > mAddressBook->time())
+		mAddressBook->mScheduler.schedule(Scheduler::clock::now(), Resource::ImportTask(mAddressBook, digest, "contacts", secret()));
+
 	return true;
 }
 
@@ -107,6 +107,9 @@ public:
 	private:
 		void setAddressBook(AddressBook *addressBook);
 
+		bool recvInfo(const Network::Link &link, Serializer &serializer);
+		bool recvContacts(const Network::Link &link, Serializer &serializer);
+
 		void init(void);
 		void uninit(void);
 
@@ -65,7 +65,7 @@ bool Block::ProcessFile(File &file, Block &block, bool cache)
 		return false;
 
 	// TODO
-	block.mFile = new File(file.name(), File::Read);
+	block.setFile(new File(file.name(), File::Read));
 	block.mOffset = offset;
 	block.mSize = file.tellRead() - offset;
 	block.mFile->seekRead(offset);
@@ -98,7 +98,7 @@ bool Block::EncryptFile(Stream &stream, const BinaryString &key, const BinaryStr
 	if(!EncryptFile(stream, key, iv, block.mDigest, &fileName))
 		return false;
 
-	block.mFile = new File(fileName, File::Read);
+	block.setFile(new File(fileName, File::Read));
 	block.mOffset = 0;
 	block.mSize = block.mFile->size();
 	return true;
@@ -115,9 +115,10 @@ Block::Block(const Block &block) :
 
 Block::Block(const BinaryString &digest) :
 	mDigest(digest),
+	mFile(NULL),
 	mCipher(NULL)
 {
-	mFile = Store::Instance->getBlock(digest, mSize);
+	setFile(Store::Instance->getBlock(digest, mSize));
 	if(mFile)
 	{
 		mOffset = mFile->tellRead();
@@ -130,9 +131,10 @@ Block::Block(const BinaryString &digest) :
 
 Block::Block(const BinaryString &digest, const String &filename, int64_t offset, int64_t size) :
 	mDigest(digest),
+	mFile(NULL),
 	mCipher(NULL)
 {
-	mFile = new File(filename, File::Write);
+	setFile(new File(filename, File::Write));
 	mOffset = offset;
 	mSize = size;
 
@@ -140,9 +142,10 @@ Block::Block(const BinaryString &digest, const String &filename, int64_t offset,
 }
 
 Block::Block(const String &filename, int64_t offset, int64_t size) :
+	mFile(NULL),
 	mCipher(NULL)
 {
-	mFile = new File(filename, File::Read);
+	setFile(new File(filename, File::Read));
 	mOffset = offset;
 
 	mFile->seekRead(mOffset);
@@ -156,6 +159,7 @@ Block::Block(const String &filename, int64_t offset, int64_t size) :
 Block::~Block(void)
 {
 	delete mCipher;
+	if(mFile) Cache::Instance->release(mFile->name());
 	delete mFile;
 }
 
@@ -230,7 +234,7 @@ void Block::seekWrite(int64_t position)
 
 int64_t Block::tellRead(void) const
 {
-	if(mCipher) return mCipher->tellRead() - mOffset;
+	if(mCipher) return mCipher->tellRead();	// plaintext position from block start
 	else return mFile->tellRead() - mOffset;
 }
 
@@ -244,7 +248,7 @@ Block &Block::operator = (const Block &block)
 	mDigest = block.mDigest;
 	mOffset = block.mOffset;
 	mSize = block.mSize;
-	mFile = new File(block.mFile->name());
+	setFile(new File(block.mFile->name()));
 	return *this;
 }
 
@@ -253,7 +257,7 @@ void Block::waitContent(void) const
 	if(!mFile)
 	{
 		Store::Instance->waitBlock(mDigest);
-		mFile = Store::Instance->getBlock(mDigest, mSize);
+		setFile(Store::Instance->getBlock(mDigest, mSize));
 		Assert(mFile);
 		mOffset = mFile->tellRead();
 	}
@@ -291,6 +295,13 @@ bool Block::waitContent(duration timeout) const
 	return true;
 }
 
+void Block::setFile(File *file) const
+{
+	if(mFile) Cache::Instance->release(mFile->name());
+	mFile = file;
+	if(mFile) Cache::Instance->retain(mFile->name());
+}
+
 void Block::notifyStore(void) const
 {
 	Assert(mFile);
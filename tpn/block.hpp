@@ -75,6 +75,7 @@ private:
   	void waitContent(void) const;
 	bool waitContent(duration timeout) const;
 	void notifyStore(void) const;
+	void setFile(File *file) const;	// pins the file in cache
 
 	BinaryString mDigest;
 
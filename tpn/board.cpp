@@ -29,33 +29,100 @@
 
 #include "pla/jsonserializer.hpp"
 #include "pla/binaryserializer.hpp"
+#include "pla/crypto.hpp"
 #include "pla/object.hpp"
 
 namespace tpn
 {
 
+static const Config::Value RequestTimeout("request_timeout");
+
+// Flat boards written for older peers are named after the board with this suffix
+static const String FlatSuffix = ".flat";
+
+std::mutex Board::MailDatabaseMutex;
+std::condition_variable Board::MailDatabaseCondition;
+Map<String, int64_t> Board::NextNumbers;
+
+Database *Board::MailDatabase(void)
+{
+	static Database *database = NULL;
+	if(!database)
+	{
+		database = new Database("boards.db");
+
+		database->execute("CREATE TABLE IF NOT EXISTS mails\
+			(id INTEGER PRIMARY KEY AUTOINCREMENT,\
+			board TEXT,\
+			number INTEGER(8),\
+			time INTEGER(8),\
+			digest BLOB,\
+			parent BLOB,\
+			data BLOB)");
+		database->execute("CREATE UNIQUE INDEX IF NOT EXISTS mails_digest ON mails (board, digest)");
+		database->execute("CREATE INDEX IF NOT EXISTS mails_number ON mails (board, number)");
+		database->execute("CREATE INDEX IF NOT EXISTS mails_time ON mails (board, time, digest)");
+		database->execute("CREATE INDEX IF NOT EXISTS mails_parent ON mails (board, parent)");
+
+		database->execute("CREATE TABLE IF NOT EXISTS segments\
+			(board TEXT,\
+			position INTEGER(8),\
+			digest BLOB,\
+			key BLOB,\
+			count INTEGER,\
+			time INTEGER(8),\
+			first BLOB)");
+		database->execute("CREATE INDEX IF NOT EXISTS segments_position ON segments (board, position)");
+		database->execute("CREATE INDEX IF NOT EXISTS segments_digest ON segments (board, digest)");
+		database->execute("CREATE INDEX IF NOT EXISTS segments_key ON segments (board, key)");
+		database->execute("CREATE INDEX IF NOT EXISTS segments_first ON segments (board, time, first)");
+
+		database->execute("CREATE TABLE IF NOT EXISTS boards\
+			(name TEXT UNIQUE,\
+			digest BLOB)");
+	}
+
+	return database;
+}
+
 Board::Board(const String &name, const String &secret, const String &displayName) :
 	mName(name),
 	mDisplayName(displayName),
 	mSecret(secret),
+	mDirty(false),
 	mHasNew(false),
 	mUnread(0)
 {
 	if(!mName.empty() && mName[0] == '/') mName = mName.substr(1);
 	Assert(!mName.empty());
 
+	// Mails of private boards must not be stored in clear in the shared database
+	if(!mSecret.empty())
+		Sha256().pbkdf2_hmac(mSecret, "board:" + mName, mKey, 32, 100000);
+
+	// Mails are loaded lazily, the database is shared by boards with the same name
+	BinaryString digest;
+	{
+		std::unique_lock<std::mutex> lock(MailDatabaseMutex);
+		digest = storedDigest();
+	}
+
 	Interface::Instance->add(urlPrefix(), this);
 
 	const String prefix = "/mail/" + mName;
 
-	Set<BinaryString> digests;
-	Store::Instance->retrieveValue(Store::Hash(prefix), digests);
-
-	for(auto it = digests.begin(); it != digests.end(); ++it)
+	// Import stored digests only if the board is not in the database yet
+	if(digest.empty())
 	{
-		//LogDebug("Board", "Retrieved digest: " + it->toString());
-		if(fetch(Network::Link::Null, prefix, "/", *it, false))
-			incoming(Network::Link::Null, prefix, "/", *it);
+		Set<BinaryString> digests;
+		Store::Instance->retrieveValue(Store::Hash(prefix), digests);
+
+		for(auto it = digests.begin(); it != digests.end(); ++it)
+		{
+			//LogDebug("Board", "Retrieved digest: " + it->toString());
+			if(fetch(Network::Link::Null, prefix, "/", *it, false))
+				incoming(Network::Link::Null, prefix, "/", *it);
+		}
 	}
 
 	publish(prefix);
@@ -66,6 +133,10 @@ Board::~Board(void)
 {
 	Interface::Instance->remove(urlPrefix(), this);
 
+	// Flush pending mails
+	mProcessAlarm.cancel();
+	process();
+
 	const String prefix = "/mail/" + mName;
 
 	unpublish(prefix);
@@ -94,30 +165,31 @@ int Board::unread(void) const
 
 BinaryString Board::digest(void) const
 {
-	std::unique_lock<std::mutex> lock(mMutex);
-	return mDigest;
+	std::unique_lock<std::mutex> lock(MailDatabaseMutex);
+	return storedDigest();
 }
 
 bool Board::add(const Mail &mail, bool noIssue)
 {
+	if(mail.empty())
+		return false;
+
 	{
 		std::unique_lock<std::mutex> lock(mMutex);
+		{
+			std::unique_lock<std::mutex> databaseLock(MailDatabaseMutex);
+			if(!insert(mail))
+				return false;
+		}
 
-		if(mail.empty() || mMails.contains(mail))
-			return false;
-
-		auto it = mMails.insert(mail);
-		const Mail &m = *it.first;
-		mUnorderedMails.append(&m);
+		schedule();
 	}
 
 	const String prefix = "/mail/" + mName;
 
 	if(!noIssue) issue(prefix, mail);
-	process();
-	publish(prefix);
 
-	mCondition.notify_all();
+	MailDatabaseCondition.notify_all();
 	return true;
 }
 
@@ -133,29 +205,529 @@ void Board::removeMergeUrl(const String &url)
 	mMergeUrls.erase(url);
 }
 
-void Board::process(void)
+BinaryString Board::encode(const Mail &mail) const
+{
+	BinaryString data;
+	BinarySerializer serializer(&data);
+	serializer << mail;
+
+	if(mKey.empty())
+		return data;
+
+	// The IV is derived from the mail digest, which is unique per board
+	BinaryString iv;
+	Sha256().pbkdf2_hmac(mail.digest(), mName, iv, 16, 100);
+
+	BinaryString encrypted;
+	AesCtr cipher(&encrypted);
+	cipher.setEncryptionKey(mKey);
+	cipher.setInitializationVector(iv);
+	cipher.writeData(data.data(), data.size());
+	cipher.close();
+	return encrypted;
+}
+
+bool Board::decode(const BinaryString &digest, const BinaryString &data, Mail &mail) const
 {
+	BinaryString plain;
+	if(!mKey.empty())
+	{
+		BinaryString iv;
+		Sha256().pbkdf2_hmac(digest, mName, iv, 16, 100);
+
+		BinaryString encrypted(data);
+		AesCtr cipher(&encrypted);
+		cipher.setDecryptionKey(mKey);
+		cipher.setInitializationVector(iv);
+		plain.resize(data.size());
+		plain.resize(size_t(cipher.readBinary(plain.ptr(), plain.size())));
+	}
+	else {
+		plain = data;
+	}
+
 	try {
+		BinarySerializer serializer(plain.data(), plain.size());
+		return !!(serializer >> mail);
+	}
+	catch(const Exception &e)
+	{
+		LogWarn("Board::decode", String("Invalid stored mail: ") + e.what());
+		return false;
+	}
+}
+
+bool Board::insert(const Mail &mail)
+{
+	Database *database = MailDatabase();
+	const BinaryString digest = mail.digest();
+
+	Database::Statement statement = database->prepare("SELECT 1 FROM mails WHERE board = ?1 AND digest = ?2");
+	statement.bind(1, mName);
+	statement.bind(2, digest);
+	bool exists = statement.step();
+	statement.finalize();
+	if(exists) return false;
+
+	const BinaryString data = encode(mail);
+
+	// The number is the row id, so it is unique and increasing even if other boards
+	// with the same name or other processes insert too
+	int64_t number = 0;
+	database->execute("SAVEPOINT insert_mail");
+	try {
+		statement = database->prepare("INSERT INTO mails (board, time, digest, parent, data) VALUES (?1, ?2, ?3, ?4, ?5)");
+		statement.bind(1, mName);
+		statement.bind(2, mail.time());
+		statement.bind(3, digest);
+		if(!mail.parent().empty()) statement.bind(4, mail.parent());
+		statement.bind(5, data);
+		statement.execute();
+
+		number = database->insertId();
+		statement = database->prepare("UPDATE mails SET number = ?1 WHERE id = ?1");
+		statement.bind(1, number);
+		statement.execute();
+	}
+	catch(...)
+	{
+		NOEXCEPTION(database->execute("ROLLBACK TO insert_mail"));
+		NOEXCEPTION(database->execute("RELEASE insert_mail"));
+		throw;
+	}
+
+	database->execute("RELEASE insert_mail");
+	NextNumbers[mName] = number + 1;
+
+	// Extend the range of new mails
+	const Position position = PositionOf(mail);
+	if(!mDirty || position < mDirtyFirst) mDirtyFirst = position;
+	if(!mDirty || mDirtyLast < position) mDirtyLast = position;
+	mDirty = true;
+	return true;
+}
+
+unsigned Board::read(Resource &resource)
+{
+	// Decode without locking, the reader may wait for blocks from the network
+	Array<Mail> mails;
+	{
+		Resource::Reader reader(&resource, mSecret);
+		BinarySerializer serializer(&reader);
+		Mail mail;
+		while(!!(serializer >> mail))
+			if(!mail.empty())
+				mails.append(mail);
+	}
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	{
+		std::unique_lock<std::mutex> databaseLock(MailDatabaseMutex);
+		Database *database = MailDatabase();
+		database->execute("BEGIN TRANSACTION");
+		try {
+			for(const Mail &mail : mails)
+			{
+				if(insert(mail))
+				{
+					++mUnread;
+					mHasNew = true;
+				}
+			}
+		}
+		catch(...)
+		{
+			database->execute("ROLLBACK");
+			NextNumbers.erase(mName);	// read again from the database
+			throw;
+		}
+
+		database->execute("COMMIT");
+	}
+
+	// Remember the segment so it is neither read nor written again
+	const unsigned count = unsigned(mails.size());
+	mSegmentCounts.insert(resource.digest(), count);
+	mSegmentKeys.insert(SegmentKey(mails), resource.digest());
+	return count;
+}
+
+int64_t Board::count(void) const
+{
+	// Long-pollers check it on every wakeup, so it is kept in memory once read
+	int64_t count = 0;
+	if(NextNumbers.get(mName, count))
+		return count;
+
+	Database::Statement statement = MailDatabase()->prepare("SELECT MAX(number) FROM mails WHERE board = ?1");
+	statement.bind(1, mName);
+	if(statement.step() && statement.type(0) != Database::Statement::Null)
+	{
+		statement.value(0, count);
+		++count;
+	}
+	statement.finalize();
+	NextNumbers.insert(mName, count);
+	return count;
+}
+
+BinaryString Board::storedDigest(void) const
+{
+	BinaryString digest;
+	Database::Statement statement = MailDatabase()->prepare("SELECT digest FROM boards WHERE name = ?1");
+	statement.bind(1, mName);
+	if(statement.step())
+		statement.value(0, digest);
+	statement.finalize();
+	return digest;
+}
+
+void Board::fetchMails(const Position &from, bool inclusive, int limit, Array<Mail> &result)
+{
+	result.clear();
+
+	std::unique_lock<std::mutex> databaseLock(MailDatabaseMutex);
+	Database::Statement statement = MailDatabase()->prepare(String("SELECT digest, data FROM mails WHERE board = ?1 AND (time > ?2 OR (time = ?2 AND digest ")
+		+ (inclusive ? ">=" : ">") + " ?3)) ORDER BY time, digest LIMIT ?4");
+	statement.bind(1, mName);
+	statement.bind(2, from.first);
+	statement.bind(3, from.second);
+	statement.bind(4, limit);
+	while(statement.step())
+	{
+		BinaryString digest, data;
+		statement.value(0, digest);
+		statement.value(1, data);
+		Mail mail;
+		if(decode(digest, data, mail))
+			result.append(mail);
+	}
+	statement.finalize();
+}
+
+int64_t Board::fetchMails(int64_t next, int limit, Array<Mail> &result)
+{
+	result.clear();
+
+	std::unique_lock<std::mutex> databaseLock(MailDatabaseMutex);
+	Database::Statement statement = MailDatabase()->prepare("SELECT number, digest, data FROM mails WHERE board = ?1 AND number >= ?2 ORDER BY number LIMIT ?3");
+	statement.bind(1, mName);
+	statement.bind(2, next);
+	statement.bind(3, limit);
+	while(statement.step())
+	{
+		// Rows which can't be decoded are skipped but still move the cursor
+		int64_t number = 0;
+		BinaryString digest, data;
+		statement.value(0, number);
+		statement.value(1, digest);
+		statement.value(2, data);
+		next = number + 1;
+
+		Mail mail;
+		if(decode(digest, data, mail))
+			result.append(mail);
+	}
+	statement.finalize();
+	return next;
+}
+
+Board::Segment Board::writeSegment(const Array<Mail> &mails, const Map<BinaryString, BinaryString> &keys)
+{
+	Segment segment;
+	segment.key = SegmentKey(mails);
+	segment.count = unsigned(mails.size());
+	segment.first = PositionOf(mails.front());
+
+	// Reuse an identical segment if possible
+	if(keys.get(segment.key, segment.digest))
+		return segment;
+
+	{
+		std::unique_lock<std::mutex> databaseLock(MailDatabaseMutex);
+		Database::Statement statement = MailDatabase()->prepare("SELECT digest FROM segments WHERE board = ?1 AND key = ?2 LIMIT 1");
+		statement.bind(1, mName);
+		statement.bind(2, segment.key);
+		bool found = statement.step();
+		if(found) statement.value(0, segment.digest);
+		statement.finalize();
+		if(found) return segment;
+	}
+
+	String tempFileName = File::TempName();
+	File tempFile(tempFileName, File::Truncate);
+	BinarySerializer serializer(&tempFile);
+	for(const Mail &mail : mails)
+		serializer << mail;
+	tempFile.close();
+
+	Resource resource;
+	resource.cache(tempFileName, mName, "mail", mSecret);
+	segment.digest = resource.digest();
+	return segment;
+}
+
+bool Board::writeFlat(bool changed)
+{
+	{
 		std::unique_lock<std::mutex> lock(mMutex);
 
-		// Write messages to temporary file
+		// Forget peers which are gone or have been upgraded
+		for(auto it = mLegacyLinks.begin(); it != mLegacyLinks.end(); )
+		{
+			if(!Network::Instance->isLegacy(*it)) it = mLegacyLinks.erase(it);
+			else ++it;
+		}
+
+		if(mLegacyLinks.empty())
+		{
+			mFlatDigest.clear();
+			return false;
+		}
+
+		if(!changed && !mFlatDigest.empty())
+			return false;
+	}
+
+	String tempFileName = File::TempName();
+	File tempFile(tempFileName, File::Truncate);
+	BinarySerializer serializer(&tempFile);
+	Array<Mail> page;
+	Position from(std::numeric_limits<int64_t>::min(), BinaryString());
+	bool inclusive = true;
+	while(true)
+	{
+		fetchMails(from, inclusive, PageSize, page);
+		if(page.empty()) break;
+		for(const Mail &mail : page)
+			serializer << mail;
+		from = PositionOf(page.back());
+		inclusive = false;
+	}
+	tempFile.close();
+
+	Resource resource;
+	resource.cache(tempFileName, mName + FlatSuffix, "mail", mSecret);
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mFlatDigest = resource.digest();
+	return true;
+}
+
+bool Board::findSegment(const BinaryString &digest, unsigned &count)
+{
+	if(mSegmentCounts.get(digest, count))
+		return true;
+
+	std::unique_lock<std::mutex> databaseLock(MailDatabaseMutex);
+	Database::Statement statement = MailDatabase()->prepare("SELECT count FROM segments WHERE board = ?1 AND digest = ?2 LIMIT 1");
+	statement.bind(1, mName);
+	statement.bind(2, digest);
+	bool found = statement.step();
+	if(found) statement.value(0, count);
+	statement.finalize();
+	return found;
+}
+
+void Board::schedule(void)
+{
+	// Debounce so bursts of mails result in a single update, but never delay more than 10s
+	const auto now = Alarm::clock::now();
+	if(mProcessDeadline == Alarm::time_point())
+		mProcessDeadline = now + seconds(10);
+
+	mProcessAlarm.schedule(std::min(Alarm::time_point(now + seconds(1)), mProcessDeadline), [this]()
+	{
+		process();
+	});
+}
+
+void Board::process(void)
+{
+	std::unique_lock<std::mutex> processLock(mProcessMutex);
+
+	try {
+		Position dirtyFirst, dirtyLast;
+		Map<BinaryString, BinaryString> keys;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mProcessDeadline = Alarm::time_point();
+			if(!mDirty)
+			{
+				lock.unlock();
+				if(writeFlat(false)) publish("/mail/" + mName);
+				return;
+			}
+			mDirty = false;
+			dirtyFirst = mDirtyFirst;
+			dirtyLast = mDirtyLast;
+			keys = mSegmentKeys;
+		}
+
+		// Find the last segment starting before new mails, previous ones are unchanged
+		int64_t begin = 0;
+		Position start(std::numeric_limits<int64_t>::min(), BinaryString());
+		{
+			std::unique_lock<std::mutex> databaseLock(MailDatabaseMutex);
+			Database::Statement statement = MailDatabase()->prepare("SELECT position, time, first FROM segments WHERE board = ?1 AND (time < ?2 OR (time = ?2 AND first <= ?3)) ORDER BY position DESC LIMIT 1");
+			statement.bind(1, mName);
+			statement.bind(2, dirtyFirst.first);
+			statement.bind(3, dirtyFirst.second);
+			if(statement.step())
+			{
+				statement.value(0, begin);
+				statement.value(1, start.first);
+				statement.value(2, start.second);
+			}
+			statement.finalize();
+		}
+
+		// Cut segments from there, stop when cuts align with old segments again
+		Array<Segment> created;
+		int64_t resume = -1;	// position of the first unchanged old segment
+		bool past = false;	// past all new mails
+		Array<Mail> current, page;
+		Position from = start;
+		bool inclusive = true;
+		bool finished = false;
+		while(!finished)
+		{
+			fetchMails(from, inclusive, PageSize, page);
+			if(page.empty()) break;
+			from = PositionOf(page.back());
+			inclusive = false;
+
+			for(const Mail &mail : page)
+			{
+				if(current.empty() && past)
+				{
+					std::unique_lock<std::mutex> databaseLock(MailDatabaseMutex);
+					Database::Statement statement = MailDatabase()->prepare("SELECT position FROM segments WHERE board = ?1 AND time = ?2 AND first = ?3 AND position >= ?4 LIMIT 1");
+					const Position position = PositionOf(mail);
+					statement.bind(1, mName);
+					statement.bind(2, position.first);
+					statement.bind(3, position.second);
+					statement.bind(4, begin);
+					if(statement.step()) statement.value(0, resume);
+					statement.finalize();
+
+					if(resume >= 0)
+					{
+						finished = true;
+						break;
+					}
+				}
+
+				current.append(mail);
+				if(IsBoundary(mail, int(current.size())))
+				{
+					created.append(writeSegment(current, keys));
+					past = !(PositionOf(mail) < dirtyLast);
+					current.clear();
+				}
+			}
+		}
+
+		if(!current.empty())
+			created.append(writeSegment(current, keys));
+
+		// Update segments and read back the full list
+		Array<BinaryString> segments;
+		{
+			std::unique_lock<std::mutex> databaseLock(MailDatabaseMutex);
+			Database *database = MailDatabase();
+			database->execute("BEGIN TRANSACTION");
+			try {
+				Database::Statement statement;
+				if(resume >= 0)
+				{
+					statement = database->prepare("DELETE FROM segments WHERE board = ?1 AND position >= ?2 AND position < ?3");
+					statement.bind(1, mName);
+					statement.bind(2, begin);
+					statement.bind(3, resume);
+					statement.execute();
+
+					statement = database->prepare("UPDATE segments SET position = position + ?3 WHERE board = ?1 AND position >= ?2");
+					statement.bind(1, mName);
+					statement.bind(2, resume);
+					statement.bind(3, begin + int64_t(created.size()) - resume);
+					statement.execute();
+				}
+				else {
+					statement = database->prepare("DELETE FROM segments WHERE board = ?1 AND position >= ?2");
+					statement.bind(1, mName);
+					statement.bind(2, begin);
+					statement.execute();
+				}
+
+				statement = database->prepare("INSERT INTO segments (board, position, digest, key, count, time, first) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7)");
+				for(int i = 0; i < int(created.size()); ++i)
+				{
+					const Segment &segment = created[i];
+					statement.bind(1, mName);
+					statement.bind(2, begin + int64_t(i));
+					statement.bind(3, segment.digest);
+					statement.bind(4, segment.key);
+					statement.bind(5, segment.count);
+					statement.bind(6, segment.first.first);
+					statement.bind(7, segment.first.second);
+					statement.step();
+					statement.reset();
+				}
+				statement.finalize();
+
+				statement = database->prepare("SELECT digest FROM segments WHERE board = ?1 ORDER BY position");
+				statement.bind(1, mName);
+				while(statement.step())
+				{
+					BinaryString digest;
+					statement.value(0, digest);
+					segments.append(digest);
+				}
+				statement.finalize();
+			}
+			catch(...)
+			{
+				database->execute("ROLLBACK");
+				throw;
+			}
+
+			database->execute("COMMIT");
+		}
+
+		// Write segment list to temporary file
 		String tempFileName = File::TempName();
 		File tempFile(tempFileName, File::Truncate);
 		BinarySerializer serializer(&tempFile);
-		for(auto it = mMails.begin(); it != mMails.end(); ++it)
-			serializer << *it;
+		serializer << segments;
 		tempFile.close();
 
 		// Move to cache
 		Resource resource;
-		resource.cache(tempFileName, mName, "mail", mSecret);
+		resource.cache(tempFileName, mName, "board", mSecret);
+
+		{
+			std::unique_lock<std::mutex> databaseLock(MailDatabaseMutex);
+			Database::Statement statement = MailDatabase()->prepare("INSERT OR REPLACE INTO boards (name, digest) VALUES (?1, ?2)");
+			statement.bind(1, mName);
+			statement.bind(2, resource.digest());
+			statement.execute();
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mSegmentCounts.clear();
+			mSegmentKeys.clear();
+		}
 
-		// Retrieve digest and store it
+		writeFlat(true);
+
+		// Store digest and publish it, the flat board is only anounced
 		const String prefix = "/mail/" + mName;
-		mDigest = resource.digest();
-		Store::Instance->storeValue(Store::Hash(prefix), mDigest, Store::Permanent);
+		Store::Instance->storeValue(Store::Hash(prefix), resource.digest(), Store::Permanent);
+		publish(prefix);
 
-		LogDebug("Board::process", "Board processed: " + mDigest.toString());
+		LogDebug("Board::process", "Board processed: " + resource.digest().toString() + " (" + String::number(int(segments.size())) + " segments, " + String::number(int(created.size())) + " written)");
 	}
 	catch(const Exception &e)
 	{
@@ -163,73 +735,114 @@ void Board::process(void)
 	}
 }
 
+Board::Position Board::PositionOf(const Mail &mail)
+{
+	return Position(int64_t(mail.time().toUnixTime()), mail.digest());
+}
+
+bool Board::IsBoundary(const Mail &mail, int count)
+{
+	if(count >= MaxSegmentSize) return true;
+
+	BinaryString digest = mail.digest();
+	return !digest.empty() && (uint8_t(digest[digest.size()-1]) & SegmentMask) == 0;
+}
+
+BinaryString Board::SegmentKey(const Array<Mail> &mails)
+{
+	Sha256 hash;
+	hash.init();
+	for(const Mail &mail : mails)
+		hash.process(mail.digest());
+
+	BinaryString key;
+	hash.finalize(key);
+	return key;
+}
+
 bool Board::anounce(const Network::Link &link, const String &prefix, const String &path, List<BinaryString> &targets)
 {
-	std::unique_lock<std::mutex> lock(mMutex);
 	targets.clear();
 
-	if(mDigest.empty())
+	const BinaryString digest = this->digest();
+	if(digest.empty())
 		return false;
 
-	targets.push_back(mDigest);
+	targets.push_back(digest);
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	if(!link.remote.empty() && !mLegacyLinks.contains(link) && Network::Instance->isLegacy(link))
+	{
+		// The peer can't read the tree, write a flat board too
+		mLegacyLinks.insert(link);
+		if(mFlatDigest.empty()) schedule();
+	}
+
+	if(!mFlatDigest.empty())
+		targets.push_back(mFlatDigest);
+
 	return true;
 }
 
 bool Board::incoming(const Network::Link &link, const String &prefix, const String &path, const BinaryString &target)
 {
+	if(target == digest())
+		return false;
+
+	// Check the index first, flat boards written for older peers duplicate a tree
+	if(!fetch(link, prefix, path, target, false))
+		return true;	// called again once fetched
+
+	try {
+		Resource resource(target, true);	// local only
+		if(resource.type() == "mail" && resource.name() == mName + FlatSuffix)
+			return true;
+	}
+	catch(const Exception &e)
 	{
-		std::unique_lock<std::mutex> lock(mMutex);
-		if(target == mDigest)
-			return false;
+		LogWarn("Board::incoming", e.what());
+		return true;
 	}
 
 	if(fetch(link, prefix, path, target, true))
 	{
 		try {
 			Resource resource(target, true);	// local only (already fetched)
-			if(resource.type() != "mail")
-				return false;
-
-			bool complete = false;
+			if(resource.type() == "mail")
 			{
+				// Single segment or flat board from an older version
+				read(resource);
 				std::unique_lock<std::mutex> lock(mMutex);
-
-				Resource::Reader reader(&resource, mSecret);
-				BinarySerializer serializer(&reader);
-				Mail mail;
-				unsigned count = 0;
-				while(!!(serializer >> mail))
+				if(mDirty) schedule();
+			}
+			else if(resource.type() == "board")
+			{
+				Array<BinaryString> segments;
 				{
-					if(mail.empty())
-						continue;
+					Resource::Reader reader(&resource, mSecret);
+					BinarySerializer serializer(&reader);
+					AssertIO(serializer >> segments);
+				}
 
-					if(!mMails.contains(mail))
+				// Compare trees, read unknown segments only
+				for(const BinaryString &segment : segments)
+				{
+					unsigned count = 0;
 					{
-						auto it = mMails.insert(mail);
-						const Mail &m = *it.first;
-						mUnorderedMails.append(&m);
-
-						++mUnread;
-						mHasNew = true;
+						std::unique_lock<std::mutex> lock(mMutex);
+						if(findSegment(segment, count))
+							continue;
 					}
 
-					++count;
-				}
+					if(!fetch(link, prefix, path, segment, true))
+						continue;	// it will be merged when fetched
 
-				if(count == mMails.size())
-				{
-					mDigest = target;
-					complete = true;
+					Resource segmentResource(segment, true);
+					read(segmentResource);
 				}
-			}
 
-			if(!complete)
-			{
-				const String prefix = "/mail/" + mName;
-
-				process();
-				if(digest() != target)
-					publish(prefix);
+				std::unique_lock<std::mutex> lock(mMutex);
+				if(mDirty) schedule();
 			}
 		}
 		catch(const Exception &e)
@@ -237,7 +850,7 @@ bool Board::incoming(const Network::Link &link, const String &prefix, const Stri
 			LogWarn("Board::incoming", e.what());
 		}
 
-		mCondition.notify_all();
+		MailDatabaseCondition.notify_all();
 	}
 
 	return true;
@@ -247,6 +860,7 @@ bool Board::incoming(const Network::Link &link, const String &prefix, const Stri
 {
 	if(add(mail, true))
 	{
+		std::unique_lock<std::mutex> lock(mMutex);
 		++mUnread;
 		mHasNew = true;
 		return true;
@@ -307,35 +921,37 @@ void Board::http(const String &prefix, Http::Request &request)
 
 			if(request.get.contains("json"))
 			{
-				int next = 0;
+				int64_t next = 0;
 				if(request.get.contains("next"))
 					request.get["next"].extract(next);
 
-				duration timeout = milliseconds(Config::Get("request_timeout").toInt());
+				duration timeout = RequestTimeout.toMilliseconds();
 				if(request.get.contains("timeout"))
 					timeout = seconds(request.get["timeout"].toDouble());
 
-				decltype(mUnorderedMails) temp;
 				{
-					std::unique_lock<std::mutex> lock(mMutex);
-
-					if(next >= int(mUnorderedMails.size()))
+					std::unique_lock<std::mutex> databaseLock(MailDatabaseMutex);
+					if(next >= count())
 					{
-						mCondition.wait_for(lock, std::chrono::duration<double>(timeout), [this, next]() {
-							return next < int(mUnorderedMails.size());
+						MailDatabaseCondition.wait_for(databaseLock, std::chrono::duration<double>(timeout), [this, next]() {
+							return next < count();
 						});
 					}
+				}
 
-					temp.reserve(int(mUnorderedMails.size() - next));
-					for(int i = next; i < int(mUnorderedMails.size()); ++i)
-						temp.push_back(mUnorderedMails[i]);
-
+				{
+					std::unique_lock<std::mutex> lock(mMutex);
 					mUnread = 0;
 					mHasNew = false;
 				}
 
+				// Numbers are not contiguous, the client continues from the returned number
+				Array<Mail> temp;
+				int64_t last = fetchMails(int64_t(next), PageSize, temp);	// the client polls again for next pages
+
 				Http::Response response(request, 200);
 				response.headers["Content-Type"] = "application/json";
+				response.headers["X-Next"] << last;
 				response.send();
 
 				JsonSerializer json(response.stream);
@@ -25,6 +25,8 @@
 #include "tpn/include.hpp"
 #include "tpn/mail.hpp"
 #include "tpn/network.hpp"
+#include "tpn/resource.hpp"
+#include "tpn/database.hpp"
 #include "tpn/interface.hpp"
 
 #include "pla/binarystring.hpp"
@@ -32,6 +34,7 @@
 #include "pla/array.hpp"
 #include "pla/map.hpp"
 #include "pla/set.hpp"
+#include "pla/alarm.hpp"
 
 namespace tpn
 {
@@ -63,21 +66,71 @@ public:
 	void http(const String &prefix, Http::Request &request);
 
 private:
+	// Segments are cut at content-defined boundaries over time-ordered mails,
+	// so peers holding the same mails build the same segments.
+	static const int SegmentMask = 0x7F;		// 128 mails on average
+	static const int MaxSegmentSize = 1024;
+	static const int PageSize = 1024;		// mails per query
+
+	typedef std::pair<int64_t, BinaryString> Position;	// mail time and digest
+
+	struct Segment
+	{
+		BinaryString digest;
+		BinaryString key;	// digest of mail digests
+		unsigned count;
+		Position first;
+	};
+
+	static Position PositionOf(const Mail &mail);
+	static bool IsBoundary(const Mail &mail, int count);
+	static BinaryString SegmentKey(const Array<Mail> &mails);
+
+	// Mails and segments of all boards are stored in a shared database
+	static Database *MailDatabase(void);	// MailDatabaseMutex must be locked
+	static std::mutex MailDatabaseMutex;
+	static std::condition_variable MailDatabaseCondition;	// notified when mails are inserted
+	static Map<String, int64_t> NextNumbers;		// by board name, MailDatabaseMutex must be locked
+
+	BinaryString encode(const Mail &mail) const;
+	bool decode(const BinaryString &digest, const BinaryString &data, Mail &mail) const;
+	bool insert(const Mail &mail);	// mMutex and MailDatabaseMutex must be locked
+	int64_t count(void) const;	// next mail number, MailDatabaseMutex must be locked
+	BinaryString storedDigest(void) const;	// MailDatabaseMutex must be locked
+	unsigned read(Resource &resource);
+	void fetchMails(const Position &from, bool inclusive, int limit, Array<Mail> &result);
+	int64_t fetchMails(int64_t next, int limit, Array<Mail> &result);	// returns the number following the last row read
+	Segment writeSegment(const Array<Mail> &mails, const Map<BinaryString, BinaryString> &keys);
+	bool writeFlat(bool changed);	// returns true if a new flat board was written
+	bool findSegment(const BinaryString &digest, unsigned &count);	// mMutex must be locked
+	void schedule(void);	// mMutex must be locked
 	void process(void);
 
 	String mName;
 	String mDisplayName;
 	String mSecret;
-	BinaryString mDigest;
-	Set<Mail> mMails;
-	Array<const Mail*> mUnorderedMails;
+	BinaryString mKey;	// stored mails are encrypted with it for private boards
 
 	StringSet mMergeUrls;
 
+	// The board resource is the root of a Merkle tree listing segments,
+	// peers only fetch the segments they don't know.
+	Map<BinaryString, unsigned> mSegmentCounts;	// remote segments read since last process
+	Map<BinaryString, BinaryString> mSegmentKeys;	// mails digest to segment digest
+
+	// Older peers only read flat "mail" boards, so one is also written while they subscribe
+	Set<Network::Link> mLegacyLinks;
+	BinaryString mFlatDigest;
+	bool mDirty;
+	Position mDirtyFirst, mDirtyLast;	// range of new mails
+	Alarm::time_point mProcessDeadline;
+
 	mutable std::mutex mMutex;
-	mutable std::condition_variable mCondition;
 	mutable bool mHasNew;
 	mutable unsigned mUnread;
+
+	std::mutex mProcessMutex;
+	Alarm mProcessAlarm;	// must be destroyed first
 };
 
 }
@@ -23,6 +23,8 @@
 #include "tpn/config.hpp"
 #include "tpn/resource.hpp"
 #include "tpn/store.hpp"
+#include "tpn/network.hpp"
+#include "tpn/block.hpp"
 
 #include "pla/file.hpp"
 #include "pla/directory.hpp"
@@ -32,61 +34,134 @@
 namespace tpn
 {
 
+static const Config::Value RequestTimeout("request_timeout");
+static const Config::Value CacheMaxSize("cache_max_size");
+static const Config::Value CacheMaxFileSize("cache_max_file_size");
+static const Config::Value PrefetchMaxSize("prefetch_max_size");
+static const Config::Value PrefetchMaxBlocks("prefetch_max_blocks");
+
 Cache *Cache::Instance = NULL;
 
 Cache::Cache(void) :
-	mScheduler(2)
+	mTotalSize(0),
+	mPrefetchStats(),
+	mVisibleRunning(0),
+	mPrefetchStop(false),
+	mPrefetchPool(PrefetchThreads)
 {
 	mDirectory = Config::Get("cache_dir");
 
 	if(!Directory::Exist(mDirectory))
 		Directory::Create(mDirectory);
+
+	load();
+
+	for(int i = 0; i < PrefetchThreads; ++i)
+		mPrefetchPool.enqueue([this]() { runPrefetch(); });
 }
 
 Cache::~Cache(void)
 {
+	{
+		std::unique_lock<std::mutex> lock(mPrefetchMutex);
+		mPrefetchStop = true;
+	}
 
+	mPrefetchCondition.notify_all();
+	mPrefetchPool.join();
 }
 
-bool Cache::prefetch(const BinaryString &target)
+bool Cache::prefetch(const BinaryString &target, Priority priority, int blocks)
 {
 	// Test local availability
 	if(Store::Instance->hasBlock(target))
 	{
 		Resource resource(target, true);	// local only
-		if(resource.isLocallyAvailable())
-			return true;
+		if(blocks < 0)
+		{
+			if(resource.isLocallyAvailable())
+				return true;
+		}
+		else {
+			int count = std::min(blocks, resource.blocksCount());
+			int i = 0;
+			while(i < count && Store::Instance->hasBlock(resource.blockDigest(i))) ++i;
+			if(i == count)
+				return true;
+		}
 	}
 
-	mScheduler.schedule(Scheduler::clock::now(), [target]() {
-		try {
-			Resource resource(target);
-			Resource::Reader reader(&resource);
-			reader.discard();		// read everything
-		}
-		catch(const Exception &e)
+	std::unique_lock<std::mutex> lock(mPrefetchMutex);
+	if(mPrefetchStop) return false;
+
+	sptr<Prefetch> p;
+	if(mPrefetches.get(target, p) && !p->cancelled)
+	{
+		// Already queued or running, only raise priority and limit
+		if(p->limit >= 0 && (blocks < 0 || blocks > p->limit))
+			p->limit = blocks;
+
+		if(priority > p->priority)
 		{
-			LogWarn("Cache::prefetch", "Prefetching failed for " + target.toString());
+			p->priority = priority;
+			if(p->running) ++mVisibleRunning;
+			else mPrefetchQueues[priority].push_back(p);	// stale entry will be skipped
 		}
-	});
+	}
+	else {
+		p = std::make_shared<Prefetch>();
+		p->target = target;
+		p->priority = priority;
+		p->running = false;
+		p->cancelled = false;
+		p->next = 0;
+		p->limit = blocks;
+		mPrefetches[target] = p;	// may replace a cancelled running one
+		mPrefetchQueues[priority].push_back(p);
+	}
 
+	mPrefetchCondition.notify_all();
 	return false;
 }
 
-String Cache::move(const String &filename, BinaryString *fileDigest)
+void Cache::cancel(const BinaryString &target)
 {
-	// Check file size
-	int64_t fileSize = File::Size(filename);
-	int64_t maxCacheFileSize = 0;
-	Config::Get("cache_max_file_size").extract(maxCacheFileSize);	// MiB
-	if(fileSize > maxCacheFileSize*1024*1024)
-		throw Exception("File is too large for cache: " + filename);
+	std::unique_lock<std::mutex> lock(mPrefetchMutex);
 
-	// Free some space
-	int64_t maxCacheSize = 0;
-	Config::Get("cache_max_size").extract(maxCacheSize);	// MiB
-	if(freeSpace(mDirectory, maxCacheSize*1024*1024, fileSize) < fileSize)
-		throw Exception("Not enough free space in cache for " + filename);
+	sptr<Prefetch> p;
+	if(!mPrefetches.get(target, p))
+		return;
+
+	p->cancelled = true;
+	if(!p->running)
+	{
+		// Queue entry will be skipped, the worker accounts for running ones
+		mPrefetches.erase(target);
+		++mPrefetchStats.cancelled;
+	}
+
+	mPrefetchCondition.notify_all();
+}
+
+Cache::PrefetchStats Cache::prefetchStats(void)
+{
+	std::unique_lock<std::mutex> lock(mPrefetchMutex);
+
+	PrefetchStats stats = mPrefetchStats;
+	stats.queued = 0;
+	stats.running = 0;
+	for(auto &it : mPrefetches)
+	{
+		if(it.second->running) ++stats.running;
+		else ++stats.queued;
+	}
+
+	return stats;
+}
+
+String Cache::move(const String &filename, BinaryString *fileDigest)
+{
+	reserve(filename);
 
 	BinaryString digest;
 	File file(filename);
@@ -96,60 +171,106 @@ String Cache::move(const String &filename, BinaryString *fileDigest)
 	if(fileDigest) *fileDigest = digest;
 
 	String destination = path(digest);
+	int64_t size = File::Size(filename);
 	File::Rename(filename, destination);
+	add(destination, size);
 	return destination;
 }
 
+String Cache::move(const String &filename, const BinaryString &fileDigest)
+{
+	reserve(filename);
+
+	String destination = path(fileDigest);
+	int64_t size = File::Size(filename);
+	File::Rename(filename, destination);
+	add(destination, size);
+	return destination;
+}
+
+void Cache::insert(const String &path)
+{
+	int64_t size = File::Size(path);
+	add(path, size);
+
+	// The file is already there, trim the cache back under its limit
+	std::unique_lock<std::mutex> lock(mMutex);
+	const int64_t maxCacheSize = CacheMaxSize.toInt();	// MiB
+	freeSpace(maxCacheSize*1024*1024, 0);
+}
+
+void Cache::retain(const String &path)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	++mPins[path];
+
+	// Access, move to front
+	auto it = mEntries.find(path);
+	if(it != mEntries.end())
+		mLru.splice(mLru.begin(), mLru, it->second.lru);
+}
+
+void Cache::release(const String &path)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	auto it = mPins.find(path);
+	if(it != mPins.end() && --it->second <= 0)
+		mPins.erase(it);
+}
+
+void Cache::reserve(const String &filename)
+{
+	// Check file size
+	int64_t fileSize = File::Size(filename);
+	const int64_t maxCacheFileSize = CacheMaxFileSize.toInt();	// MiB
+	if(fileSize > maxCacheFileSize*1024*1024)
+		throw Exception("File is too large for cache: " + filename);
+
+	// Free some space
+	std::unique_lock<std::mutex> lock(mMutex);	// files may be moved concurrently
+	const int64_t maxCacheSize = CacheMaxSize.toInt();	// MiB
+	if(freeSpace(maxCacheSize*1024*1024, fileSize) < fileSize)
+		throw Exception("Not enough free space in cache for " + filename);
+}
+
 String Cache::path(const BinaryString &digest) const
 {
 	Assert(!digest.empty());
 	return mDirectory + Directory::Separator + digest.toString();
 }
 
-int64_t Cache::freeSpace(const String &path, int64_t maxSize, int64_t space)
+int64_t Cache::freeSpace(int64_t maxSize, int64_t space)
 {
-	int64_t totalSize = 0;
-
+	// mMutex must be locked
 	try {
-		StringList list;
-		Directory dir(path);
-		while(dir.nextFile())
-		{
-			if(!dir.fileIsDir())
-			{
-				list.push_back(dir.fileName());
-				totalSize+= dir.fileSize();
-			}
-		}
-
-		if(maxSize > totalSize)
+		if(maxSize > mTotalSize)
 		{
-			int64_t freeSpace = Directory::GetAvailableSpace(path);
+			int64_t freeSpace = Directory::GetAvailableSpace(mDirectory);
 			int64_t margin = 1024*1024;	// 1 MiB
 			freeSpace = std::max(freeSpace - margin, int64_t(0));
-			maxSize = totalSize + std::min(maxSize-totalSize, freeSpace);
+			maxSize = mTotalSize + std::min(maxSize-mTotalSize, freeSpace);
 		}
 
 		space = std::min(space, maxSize);
 
-		while(!list.empty() && totalSize > maxSize - space)
+		// Evict least recently used files, skipping pinned ones
+		auto it = mLru.end();
+		while(it != mLru.begin() && mTotalSize > maxSize - space)
 		{
-			int r = Random().uniform(0, int(list.size()));
-			StringList::iterator it = list.begin();
-			while(r--) ++it;
+			--it;
+			String filePath = *it;
+			if(mPins.contains(filePath))
+				continue;
 
-			String filePath = path + Directory::Separator + *it;
-			if(File::Exist(filePath))
-			{
-				int64_t fileSize = File::Size(filePath);
-				if(!File::Remove(filePath)) continue;
-				totalSize-= fileSize;
-			}
+			if(File::Exist(filePath) && !File::Remove(filePath))
+				continue;
+
+			mTotalSize-= mEntries[filePath].size;
+			mEntries.erase(filePath);
+			it = mLru.erase(it);
 
 			// Notify Store
 			Store::Instance->notifyFileErasure(filePath);
-
-			list.erase(it);
 		}
 	}
 	catch(const Exception &e)
@@ -158,7 +279,296 @@ int64_t Cache::freeSpace(const String &path, int64_t maxSize, int64_t space)
 		return 0;
 	}
 
-	return std::max(maxSize - totalSize, int64_t(0));
+	return std::max(maxSize - mTotalSize, int64_t(0));
+}
+
+void Cache::load(void)
+{
+	// Index existing files once, access order is unknown so it is arbitrary
+	try {
+		Directory dir(mDirectory);
+		while(dir.nextFile())
+			if(!dir.fileIsDir())
+				add(dir.filePath(), dir.fileSize());
+	}
+	catch(const Exception &e)
+	{
+		LogWarn("Cache::load", String("Unable to list cache: ") + e.what());
+	}
+
+	LogDebug("Cache::load", "Cache contains " + String::number(int(mEntries.size())) + " files (" + String::hrSize(mTotalSize) + ")");
+}
+
+void Cache::add(const String &path, int64_t size)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	auto it = mEntries.find(path);
+	if(it != mEntries.end())
+	{
+		mTotalSize-= it->second.size;
+		it->second.size = size;
+		mLru.splice(mLru.begin(), mLru, it->second.lru);
+	}
+	else {
+		mLru.push_front(path);
+		Entry entry;
+		entry.size = size;
+		entry.lru = mLru.begin();
+		mEntries.insert(path, entry);
+	}
+
+	mTotalSize+= size;
+}
+
+void Cache::runPrefetch(void)
+{
+	std::unique_lock<std::mutex> lock(mPrefetchMutex);
+	while(!mPrefetchStop)
+	{
+		sptr<Prefetch> p = popPrefetch();
+		if(!p)
+		{
+			mPrefetchCondition.wait(lock);
+			continue;
+		}
+
+		p->running = true;
+		if(p->priority == Visible) ++mVisibleRunning;
+		lock.unlock();
+
+		bool finished = false;
+		bool failed = false;
+		try {
+			finished = fetchBlocks(p);
+		}
+		catch(const std::exception &e)
+		{
+			LogWarn("Cache::prefetch", "Prefetching failed for " + p->target.toString() + ": " + e.what());
+			failed = true;
+		}
+
+		lock.lock();
+		p->running = false;
+		if(p->priority == Visible) --mVisibleRunning;
+
+		if(!finished && !failed && !p->cancelled && !mPrefetchStop)
+		{
+			// Preempted by a visible target, resume later
+			mPrefetchQueues[p->priority].push_front(p);
+		}
+		else {
+			sptr<Prefetch> current;
+			if(mPrefetches.get(p->target, current) && current == p)
+				mPrefetches.erase(p->target);
+
+			if(finished) ++mPrefetchStats.completed;
+			else if(failed) ++mPrefetchStats.failed;
+			else ++mPrefetchStats.cancelled;
+
+			lock.unlock();
+			const PrefetchStats stats = prefetchStats();
+			LogDebug("Cache::prefetch", String(finished ? "Prefetched " : (failed ? "Failed to prefetch " : "Cancelled prefetching "))
+				+ p->target.toString() + " (" + String::number(stats.queued) + " queued, " + String::number(stats.running) + " running, "
+				+ String::number(stats.blocks) + " blocks in flight, " + String::hrSize(uint64_t(stats.bytes)) + ", "
+				+ String::number(stats.completed) + " completed, " + String::number(stats.failed) + " failed, " + String::number(stats.cancelled) + " cancelled)");
+			lock.lock();
+		}
+
+		mPrefetchCondition.notify_all();
+	}
+}
+
+bool Cache::fetchBlocks(sptr<Prefetch> p)
+{
+	// Fetch index block first
+	if(!waitPrefetchBlock(p, p->target))
+		return false;
+
+	Resource resource(p->target, true);	// local only
+	Resource::IndexRecord record = resource.getIndexRecord();
+	const int total = resource.blocksCount();
+	int count = total;
+
+	{
+		std::unique_lock<std::mutex> lock(mPrefetchMutex);
+		if(p->limit >= 0) count = std::min(total, p->limit);
+	}
+
+	struct Pending
+	{
+		int index;
+		BinaryString digest;
+		int64_t size;
+		sptr<Network::Caller> caller;
+	};
+
+	// Missing blocks are called in parallel within the budget, and waited for in order
+	Deque<Pending> window;
+	bool interrupted = false;
+	try {
+		while(true)
+		{
+			while(p->next < count && Store::Instance->hasBlock(resource.blockDigest(p->next)))
+				++p->next;
+
+			if(p->next < count)
+			{
+				int64_t size = (!record.blockSizes.empty() ? record.blockSizes[p->next]
+					: std::min(int64_t(Block::Size), record.size - int64_t(p->next)*int64_t(Block::Size)));
+
+				std::unique_lock<std::mutex> lock(mPrefetchMutex);
+				if(isInterrupted(p))
+				{
+					interrupted = true;
+					break;
+				}
+
+				if(acquirePrefetch(size))
+				{
+					lock.unlock();
+
+					Pending pending;
+					pending.index = p->next;
+					pending.digest = resource.blockDigest(p->next);
+					pending.size = size;
+					pending.caller = std::make_shared<Network::Caller>(pending.digest);	// start fetching now
+					window.push_back(pending);
+					++p->next;
+					continue;
+				}
+
+				if(window.empty())
+				{
+					// Wait for budget released by other targets
+					mPrefetchCondition.wait_for(lock, seconds(1));
+					continue;
+				}
+			}
+
+			if(window.empty())
+			{
+				// The limit might have been raised in the meantime
+				std::unique_lock<std::mutex> lock(mPrefetchMutex);
+				int limit = (p->limit >= 0 ? std::min(total, p->limit) : total);
+				if(limit > count)
+				{
+					count = limit;
+					continue;
+				}
+
+				break;	// finished
+			}
+
+			// Wait for the oldest block
+			bool success = waitPrefetchBlock(p, window.front().digest);
+			if(!success)
+			{
+				interrupted = true;
+				break;
+			}
+
+			releasePrefetch(window.front().size);
+			window.pop_front();
+		}
+	}
+	catch(...)
+	{
+		for(const Pending &pending : window)
+			releasePrefetch(pending.size);
+		throw;
+	}
+
+	if(interrupted)
+	{
+		if(!window.empty()) p->next = window.front().index;
+		for(const Pending &pending : window)
+			releasePrefetch(pending.size);
+		return false;
+	}
+
+	return true;
+}
+
+bool Cache::waitPrefetchBlock(sptr<Prefetch> p, const BinaryString &digest)
+{
+	const duration timeout = RequestTimeout.toMilliseconds()*2;
+	const duration step = seconds(1);
+	const auto start = std::chrono::steady_clock::now();
+
+	// Wait in steps to react to cancellation and preemption
+	while(!Store::Instance->waitBlock(digest, step))
+	{
+		{
+			std::unique_lock<std::mutex> lock(mPrefetchMutex);
+			if(isInterrupted(p))
+				return false;
+		}
+
+		if(std::chrono::steady_clock::now() - start >= timeout)
+			throw Timeout();
+	}
+
+	return true;
+}
+
+bool Cache::isInterrupted(sptr<Prefetch> p)
+{
+	if(p->cancelled || mPrefetchStop)
+		return true;
+
+	// Speculative targets yield to visible ones
+	return p->priority == Speculative && (mVisibleRunning > 0 || !mPrefetchQueues[Visible].empty());
+}
+
+bool Cache::acquirePrefetch(int64_t size)
+{
+	int maxBlocks = int(PrefetchMaxBlocks.toInt());
+	int64_t maxBytes = PrefetchMaxSize.toInt();	// MiB
+	maxBytes*= 1024*1024;
+
+	// A single block is always allowed so oversized blocks can't stall
+	if(mPrefetchStats.blocks > 0
+		&& (mPrefetchStats.blocks >= maxBlocks || mPrefetchStats.bytes + size > maxBytes))
+		return false;
+
+	++mPrefetchStats.blocks;
+	mPrefetchStats.bytes+= size;
+	return true;
+}
+
+void Cache::releasePrefetch(int64_t size)
+{
+	{
+		std::unique_lock<std::mutex> lock(mPrefetchMutex);
+		--mPrefetchStats.blocks;
+		mPrefetchStats.bytes-= size;
+	}
+
+	mPrefetchCondition.notify_all();
+}
+
+sptr<Cache::Prefetch> Cache::popPrefetch(void)
+{
+	// Visible targets first, speculative ones only when no visible target is running
+	for(int priority = Visible; priority >= Speculative; --priority)
+	{
+		if(priority == Speculative && mVisibleRunning > 0)
+			break;
+
+		auto &queue = mPrefetchQueues[priority];
+		while(!queue.empty())
+		{
+			sptr<Prefetch> p = queue.front();
+			queue.pop_front();
+
+			// Skip stale entries
+			if(!p->cancelled && !p->running && p->priority == priority)
+				return p;
+		}
+	}
+
+	return NULL;
 }
 
 }
@@ -24,10 +24,14 @@
 
 #include "tpn/include.hpp"
 
-#include "pla/scheduler.hpp"
+#include "pla/threadpool.hpp"
 #include "pla/string.hpp"
 #include "pla/binarystring.hpp"
 #include "pla/set.hpp"
+#include "pla/map.hpp"
+#include "pla/list.hpp"
+
+#include <condition_variable>
 
 namespace tpn
 {
@@ -40,16 +44,79 @@ public:
 	Cache(void);
 	~Cache(void);
 
-	bool prefetch(const BinaryString &target);	// Asynchronous resource prefetching (true is already available)
+	enum Priority { Speculative, Visible };
+
+	struct PrefetchStats
+	{
+		int queued;		// waiting targets
+		int running;		// targets being fetched
+		int blocks;		// blocks in flight
+		int64_t bytes;		// bytes in flight
+		int64_t completed;
+		int64_t failed;
+		int64_t cancelled;
+	};
+
+	bool prefetch(const BinaryString &target, Priority priority = Speculative, int blocks = -1);	// Asynchronous resource prefetching, blocks limits data blocks fetched after the index (-1 is all, true if already available)
+	void cancel(const BinaryString &target);
+	PrefetchStats prefetchStats(void);
+
 	String move(const String &filename, BinaryString *fileDigest = NULL);
+	String move(const String &filename, const BinaryString &fileDigest);	// digest is already known
 	String path(const BinaryString &digest) const;
 
+	void insert(const String &path);	// file was written in place in the cache
+	void retain(const String &path);	// pinned files are never evicted
+	void release(const String &path);
+
 private:
-	int64_t freeSpace(const String &path, int64_t maxSize, int64_t space);
+	int64_t freeSpace(int64_t maxSize, int64_t space);
+	void reserve(const String &filename);
+	void load(void);
+	void add(const String &path, int64_t size);
+
+	static const int PrefetchThreads = 4;
+	struct Prefetch
+	{
+		BinaryString target;
+		Priority priority;
+		bool running;
+		bool cancelled;
+		int next;		// next block index to fetch
+		int limit;		// blocks to fetch, -1 for all
+	};
 
+	void runPrefetch(void);
+	bool fetchBlocks(sptr<Prefetch> p);	// false if interrupted
+	bool waitPrefetchBlock(sptr<Prefetch> p, const BinaryString &digest);	// false if interrupted
+	bool isInterrupted(sptr<Prefetch> p);	// mPrefetchMutex must be locked
+	bool acquirePrefetch(int64_t size);	// mPrefetchMutex must be locked
+	void releasePrefetch(int64_t size);
+	sptr<Prefetch> popPrefetch(void);	// mPrefetchMutex must be locked
+
+	// In-memory index, least recently used files are at the back
+	struct Entry
+	{
+		int64_t size;
+		List<String>::iterator lru;
+	};
 
 	String mDirectory;
-	Scheduler mScheduler;
+	Map<String, Entry> mEntries;
+	List<String> mLru;
+	Map<String, int> mPins;
+	int64_t mTotalSize;
+	std::mutex mMutex;
+
+	// Prefetching, visible targets are always served first
+	Map<BinaryString, sptr<Prefetch> > mPrefetches;
+	Deque<sptr<Prefetch> > mPrefetchQueues[2];	// indexed by priority
+	PrefetchStats mPrefetchStats;
+	int mVisibleRunning;
+	bool mPrefetchStop;
+	std::mutex mPrefetchMutex;
+	std::condition_variable mPrefetchCondition;
+	ThreadPool mPrefetchPool;	// must be destroyed first
 };
 
 }
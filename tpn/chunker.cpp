@@ -0,0 +1,118 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#include "tpn/chunker.hpp"
+
+namespace tpn
+{
+
+const size_t Chunker::MinSize;
+const size_t Chunker::AvgSize;
+const size_t Chunker::MaxSize;
+
+Chunker::Chunker(Stream *stream) :
+	mStream(stream),
+	mBuffer(new char[MaxSize]),
+	mBegin(0),
+	mEnd(0),
+	mEof(false)
+{
+	Assert(mStream);
+}
+
+Chunker::~Chunker(void)
+{
+	delete[] mBuffer;
+}
+
+size_t Chunker::next(void)
+{
+	// Refill so that a whole maximum-size chunk is available
+	if(!mEof && mEnd - mBegin < MaxSize)
+	{
+		std::memmove(mBuffer, mBuffer + mBegin, mEnd - mBegin);
+		mEnd-= mBegin;
+		mBegin = 0;
+
+		size_t len = size_t(mStream->readBinary(mBuffer + mEnd, MaxSize - mEnd));
+		if(len < MaxSize - mEnd) mEof = true;
+		mEnd+= len;
+	}
+
+	size_t size = Cut(reinterpret_cast<const uint8_t*>(mBuffer + mBegin), mEnd - mBegin);
+	mBegin+= size;
+	return size;
+}
+
+const uint64_t *Chunker::GearTable(void)
+{
+	// Fixed seed, boundaries must be identical on every node
+	static const struct Table
+	{
+		uint64_t values[256];
+
+		Table(void)
+		{
+			uint64_t seed = 0x7465617061746e74ULL;
+			for(int i = 0; i < 256; ++i)
+			{
+				// splitmix64
+				uint64_t z = (seed+= 0x9E3779B97F4A7C15ULL);
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+				values[i] = z ^ (z >> 31);
+			}
+		}
+	} table;
+
+	return table.values;
+}
+
+size_t Chunker::Cut(const uint8_t *data, size_t size)
+{
+	// Normalized chunking: a stricter mask before AvgSize, a looser one after
+	// Masks use high bits, which depend on the last 64 bytes
+	const uint64_t maskS = ~(~uint64_t(0) >> 21);	// AvgSize is 2^19
+	const uint64_t maskL = ~(~uint64_t(0) >> 17);
+
+	if(size <= MinSize) return size;
+	size = std::min(size, MaxSize);
+	size_t normal = std::min(size, AvgSize);
+
+	const uint64_t *gear = GearTable();
+	uint64_t fp = 0;
+	size_t i = MinSize;
+	for(; i < normal; ++i)
+	{
+		fp = (fp << 1) + gear[data[i]];
+		if(!(fp & maskS)) return i + 1;
+	}
+
+	for(; i < size; ++i)
+	{
+		fp = (fp << 1) + gear[data[i]];
+		if(!(fp & maskL)) return i + 1;
+	}
+
+	return size;
+}
+
+}
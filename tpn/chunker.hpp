@@ -0,0 +1,59 @@
+/*************************************************************************
+ *   Copyright (C) 2011-2017 by Paul-Louis Ageneau                       *
+ *   paul-louis (at) ageneau (dot) org                                   *
+ *                                                                       *
+ *   This file is part of Teapotnet.                                     *
+ *                                                                       *
+ *   Teapotnet is free software: you can redistribute it and/or modify   *
+ *   it under the terms of the GNU Affero General Public License as      *
+ *   published by the Free Software Foundation, either version 3 of      *
+ *   the License, or (at your option) any later version.                 *
+ *                                                                       *
+ *   Teapotnet is distributed in the hope that it will be useful, but    *
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the        *
+ *   GNU Affero General Public License for more details.                 *
+ *                                                                       *
+ *   You should have received a copy of the GNU Affero General Public    *
+ *   License along with Teapotnet.                                       *
+ *   If not, see <http://www.gnu.org/licenses/>.                         *
+ *************************************************************************/
+
+#ifndef TPN_CHUNKER_H
+#define TPN_CHUNKER_H
+
+#include "tpn/include.hpp"
+#include "tpn/block.hpp"
+
+#include "pla/stream.hpp"
+
+namespace tpn
+{
+
+// Content-defined chunking (FastCDC with gear rolling hash)
+// Boundaries depend only on content, so unchanged regions keep their block digests
+class Chunker
+{
+public:
+	static const size_t MinSize = Block::Size/4;	// 256 KiB
+	static const size_t AvgSize = Block::Size/2;	// 512 KiB
+	static const size_t MaxSize = Block::Size;	// blocks can't be larger
+
+	Chunker(Stream *stream);
+	~Chunker(void);
+
+	size_t next(void);	// returns the size of the next chunk, 0 at end
+
+private:
+	static const uint64_t *GearTable(void);
+	static size_t Cut(const uint8_t *data, size_t size);
+
+	Stream *mStream;
+	char *mBuffer;
+	size_t mBegin, mEnd;
+	bool mEof;
+};
+
+}
+
+#endif
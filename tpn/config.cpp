@@ -30,16 +30,85 @@
 namespace tpn
 {
 
-StringMap Config::Params;
-std::mutex Config::ParamsMutex;
+struct Config::State
+{
+	std::mutex mutex;
+	StringMap params;
+	Map<String, size_t> slots;
+	std::vector<String> keys;	// by slot
+	std::vector<std::function<void(void)> > watchers;
+};
+
+std::shared_ptr<const Config::Snapshot> Config::Current;
+const Config::Entry Config::EmptyEntry;
 bool Config::UpdateAvailableFlag = false;
 
+Config::Value::Value(const String &key)
+{
+	State &state = GetState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+
+	if(!state.slots.get(key, mSlot))
+	{
+		mSlot = state.keys.size();
+		state.keys.push_back(key);
+		state.slots.insert(key, mSlot);
+		Publish(state);
+	}
+}
+
+Config::State &Config::GetState(void)
+{
+	// Function-local so static Value handles can be constructed before main()
+	static State state;
+	return state;
+}
+
+void Config::Publish(State &state)
+{
+	auto snapshot = std::make_shared<Snapshot>();
+	snapshot->params = state.params;
+	snapshot->entries.resize(state.keys.size());
+	for(size_t i=0; i<state.keys.size(); ++i)
+	{
+		Entry &entry = snapshot->entries[i];
+		if(!state.params.get(state.keys[i], entry.string) || entry.string.empty())
+			continue;
+
+		// Values are parsed for every type, mismatching ones are left to default
+		try {
+			entry.number = entry.string.toDouble();
+			entry.integer = int64_t(entry.number);
+		}
+		catch(const Exception &e) {}
+
+		try {
+			entry.boolean = entry.string.toBool();
+		}
+		catch(const Exception &e) {}
+	}
+
+	std::atomic_store(&Current, std::shared_ptr<const Snapshot>(std::move(snapshot)));
+}
+
+void Config::Notify(State &state)
+{
+	std::vector<std::function<void(void)> > watchers;
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		watchers = state.watchers;
+	}
+
+	for(auto &f : watchers)
+		f();
+}
+
 String Config::Get(const String &key)
 {
-	std::lock_guard<std::mutex> lock(ParamsMutex);
+	const std::shared_ptr<const Snapshot> snapshot = std::atomic_load(&Current);
 
 	String value;
-	if(Params.get(key, value))
+	if(snapshot && snapshot->params.get(key, value))
 		return value;
 
 	//throw Exception("Config: no entry for \""+key+"\"");
@@ -48,49 +117,87 @@ String Config::Get(const String &key)
 
 void Config::Put(const String &key, const String &value)
 {
-	std::lock_guard<std::mutex> lock(ParamsMutex);
+	State &state = GetState();
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+
+		String current;
+		if(state.params.get(key, current) && current == value)
+			return;
 
-	Params.insert(key, value);
+		state.params[key] = value;
+		Publish(state);
+	}
+
+	Notify(state);
 }
 
 void Config::Default(const String &key, const String &value)
 {
-	std::lock_guard<std::mutex> lock(ParamsMutex);
+	State &state = GetState();
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
 
-	if(!Params.contains(key)) Params.insert(key, value);
+		if(state.params.contains(key)) return;
+		state.params.insert(key, value);
+		Publish(state);
+	}
+
+	Notify(state);
 }
 
 void Config::Load(const String &filename)
 {
-	std::lock_guard<std::mutex> lock(ParamsMutex);
-
-	try {
-		File file(filename, File::Read);
-		LineSerializer serializer(&file);
-		serializer >> Params;
-		file.close();
-	}
-	catch(const Exception &e)
+	State &state = GetState();
 	{
-		LogError("Config", String("Unable to load config: ") + e.what());
+		std::lock_guard<std::mutex> lock(state.mutex);
+
+		try {
+			File file(filename, File::Read);
+			LineSerializer serializer(&file);
+			serializer >> state.params;
+			file.close();
+		}
+		catch(const Exception &e)
+		{
+			LogError("Config", String("Unable to load config: ") + e.what());
+		}
+
+		Publish(state);
 	}
+
+	Notify(state);
 }
 
 void Config::Save(const String &filename)
 {
-	std::lock_guard<std::mutex> lock(ParamsMutex);
+	State &state = GetState();
+	std::lock_guard<std::mutex> lock(state.mutex);
 
 	File file(filename, File::Truncate);
 	LineSerializer serializer(&file);
-	serializer << Params;
+	serializer << state.params;
 	file.close();
 }
 
 void Config::Clear(void)
 {
-	std::lock_guard<std::mutex> lock(ParamsMutex);
+	State &state = GetState();
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+
+		state.params.clear();
+		Publish(state);
+	}
 
-	Params.clear();
+	Notify(state);
+}
+
+void Config::Watch(std::function<void(void)> callback)
+{
+	State &state = GetState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	state.watchers.push_back(std::move(callback));
 }
 
 void Config::GetExternalAddresses(Set<Address> &set)
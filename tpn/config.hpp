@@ -30,12 +30,40 @@
 #include "pla/set.hpp"
 #include "pla/address.hpp"
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
 namespace tpn
 {
 
 class Config
 {
+	struct Entry;
+	struct Snapshot;
+
 public:
+	// Handle on a config value, parsed once per change so that reading it needs no lookup or parsing
+	// Handles may be static, they are valid before Load() and follow later changes
+	class Value
+	{
+	public:
+		explicit Value(const String &key);
+
+		String toString(void) const		{ return get(&Entry::string); }
+		int64_t toInt(void) const		{ return get(&Entry::integer); }
+		double toDouble(void) const		{ return get(&Entry::number); }
+		bool toBool(void) const			{ return get(&Entry::boolean); }
+		duration toSeconds(void) const		{ return seconds(get(&Entry::number)); }
+		duration toMilliseconds(void) const	{ return milliseconds(get(&Entry::number)); }
+
+	private:
+		template<typename T> T get(T Entry::*member) const;
+
+		size_t mSlot;
+	};
+
 	static String Get(const String &key);
 	static void Put(const String &key, const String &value);
 	static void Default(const String &key, const String &value);
@@ -43,6 +71,9 @@ public:
 	static void Save(const String &filename);
 	static void Clear(void);
 
+	// Callback is called after each change
+	static void Watch(std::function<void(void)> callback);
+
 	static bool IsUpdateAvailable(void);
 	static bool CheckUpdate(void);
 	static bool LaunchUpdater(String *commandLine = NULL);
@@ -50,14 +81,41 @@ public:
 	static void GetExternalAddresses(Set<Address> &set);
 
 private:
-	static StringMap Params;
-	static std::mutex ParamsMutex;
+	struct Entry
+	{
+		String string;
+		int64_t integer = 0;
+		double number = 0.;
+		bool boolean = false;
+	};
+
+	// Immutable, replaced as a whole on change and freed when the last reader releases it
+	struct Snapshot
+	{
+		StringMap params;
+		std::vector<Entry> entries;	// indexed by Value slot
+	};
+
+	struct State;
+	static State &GetState(void);
+	static void Publish(State &state);	// state mutex must be locked
+	static void Notify(State &state);
+
+	static std::shared_ptr<const Snapshot> Current;	// accessed with atomic_load() and atomic_store()
+	static const Entry EmptyEntry;
 	static bool UpdateAvailableFlag;
 
 	Config(void);
 	~Config(void);
 };
 
+template<typename T>
+T Config::Value::get(T Entry::*member) const
+{
+	const std::shared_ptr<const Snapshot> snapshot = std::atomic_load(&Current);
+	return snapshot && mSlot < snapshot->entries.size() ? snapshot->entries[mSlot].*member : EmptyEntry.*member;
+}
+
 }
 
 #endif
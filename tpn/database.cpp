@@ -36,6 +36,9 @@ Database::Database(const String &filename) :
 	if(sqlite3_open(filename.c_str(), &mDb) != SQLITE_OK)
 		throw DatabaseException(mDb, String("Unable to open database file \"")+filename+"\"");
 
+	// Wait instead of failing when another connection to the same file holds a lock
+	sqlite3_busy_timeout(mDb, 10000);
+
 	execute("PRAGMA synchronous = OFF");
 	execute("PRAGMA journal_mode = TRUNCATE");
 	execute("PRAGMA case_sensitive_like = 1");
@@ -33,6 +33,7 @@ namespace tpn
 String Html::escape(const String &str)
 {
 	String result;
+	result.reserve(str.size());
 	for(int i=0; i<str.size(); ++i)
 	{
 		char chr = str[i];
@@ -129,7 +130,8 @@ void Html::raw(const String &str)
 
 void Html::text(const String &str)
 {
-	mStream->write(escape(str));
+	if(str.find_first_of("\"'<>&") == String::npos) mStream->write(str);	// nothing to escape
+	else mStream->write(escape(str));
 }
 
 void Html::object(const Serializable &s)
@@ -44,7 +44,7 @@ duration HttpTunnel::SockTimeout = seconds(10.);
 duration HttpTunnel::FlushTimeout = seconds(0.2);
 duration HttpTunnel::ReadTimeout = seconds(60.);
 
-std::map<uint32_t, HttpTunnel::Server*> HttpTunnel::Sessions;
+HashMap<uint32_t, HttpTunnel::Server*> HttpTunnel::Sessions;
 std::mutex HttpTunnel::SessionsMutex;
 
 HttpTunnel::Server* HttpTunnel::Incoming(Socket *sock)
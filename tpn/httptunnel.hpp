@@ -29,6 +29,7 @@
 #include "pla/address.hpp"
 #include "pla/http.hpp"
 #include "pla/alarm.hpp"
+#include "pla/hashmap.hpp"
 
 namespace tpn
 {
@@ -110,7 +111,7 @@ public:
 private:
 	HttpTunnel(void);
 
-	static std::map<uint32_t, Server*> Sessions;
+	static HashMap<uint32_t, Server*> Sessions;
 	static std::mutex SessionsMutex;
 
 	static const uint8_t TunnelOpen			= 0x01;
@@ -35,6 +35,7 @@
 #include "pla/include.hpp"
 #include "pla/string.hpp"
 #include "pla/binarystring.hpp"
+#include "pla/digest.hpp"
 
 using namespace pla;
 
@@ -42,6 +43,7 @@ namespace tpn
 {
 	typedef BinaryString Identifier;
 	typedef std::pair<Identifier, Identifier> IdentifierPair;
+	typedef std::pair<Digest, Digest> DigestPair;
 }
 
 #endif
@@ -36,6 +36,11 @@
 #include "pla/object.hpp"
 #include "pla/time.hpp"
 #include "pla/mime.hpp"
+#include "pla/poller.hpp"
+
+#ifdef LINUX
+#include <sys/inotify.h>
+#endif
 
 namespace tpn
 {
@@ -46,6 +51,10 @@ Indexer::Indexer(User *user) :
 	Publisher(Network::Link(user->identifier(), Identifier::Empty)),
 	mUser(user),
 	mRunning(false)
+#ifdef LINUX
+	, mInotify(-1),
+	mWatchStop(false)
+#endif
 {
 	Assert(mUser);
 	mDatabase = new Database(mUser->profilePath() + "files.db");
@@ -57,11 +66,17 @@ Indexer::Indexer(User *user) :
 		path TEXT,\
 		digest BLOB,\
 		time INTEGER(8),\
-		seen INTEGER(1))");
+		seen INTEGER(1),\
+		size INTEGER(8),\
+		inode INTEGER(8))");
 	mDatabase->execute("CREATE UNIQUE INDEX IF NOT EXISTS path ON resources (path)");
 	mDatabase->execute("CREATE INDEX IF NOT EXISTS digest ON resources (digest)");
 	mDatabase->execute("CREATE VIRTUAL TABLE IF NOT EXISTS names USING FTS3(name)");
 
+	// Signature columns are missing from older databases
+	try { mDatabase->execute("ALTER TABLE resources ADD COLUMN size INTEGER(8)"); } catch(...) {}
+	try { mDatabase->execute("ALTER TABLE resources ADD COLUMN inode INTEGER(8)"); } catch(...) {}
+
 	// Fix: "IF NOT EXISTS" is not available for virtual tables with old sqlite3 versions
 	//Database::Statement statement = mDatabase->prepare("select DISTINCT tbl_name from sqlite_master where tbl_name = 'names'");
 	//if(!statement.step()) mDatabase->execute("CREATE VIRTUAL TABLE names USING FTS3(name)");
@@ -119,6 +134,13 @@ Indexer::Indexer(User *user) :
 	Interface::Instance->add(mUser->urlPrefix()+"/files", this);
 	Interface::Instance->add(mUser->urlPrefix()+"/explore", this);
 
+#ifdef LINUX
+	// Watch for changes, full passes are then only a safety net
+	mInotify = inotify_init1(IN_CLOEXEC);
+	if(mInotify >= 0) mWatchThread = std::thread([this]() { watchRun(); });
+	else LogWarn("Indexer", "Unable to initialize inotify, changes will be detected on full passes only");
+#endif
+
 	// Save and run
 	save();
 	start(seconds(60.));
@@ -126,6 +148,17 @@ Indexer::Indexer(User *user) :
 
 Indexer::~Indexer(void)
 {
+#ifdef LINUX
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWatchStop = true;
+	}
+
+	if(mWatchThread.joinable()) mWatchThread.join();
+	if(mInotify >= 0) ::close(mInotify);
+#endif
+
+	mUpdateAlarm.cancel();
 	unpublish(prefix());
 
 	Interface::Instance->remove(mUser->urlPrefix()+"/files");
@@ -338,6 +371,11 @@ bool Indexer::query(const Query &q, Resource &resource)
 }
 
 bool Indexer::process(String path, Resource &resource)
+{
+	return process(path, resource, true);
+}
+
+bool Indexer::process(String path, Resource &resource, bool recursive)
 {
 	// Sanitize path
 	if(!path.empty() && path[path.size() - 1] == Directory::Separator)
@@ -357,11 +395,11 @@ bool Indexer::process(String path, Resource &resource)
 
 	String realPath = this->realPath(path);
 	Time   fileTime = File::Time(realPath);
-
-	// This should be a background process, so sleep for a bit
-	std::this_thread::sleep_for(milliseconds(100));
+	int64_t fileSize = -1;
+	int64_t fileInode = -1;
 
 	// Recursively process if it's a directory
+	// If not recursive, subdirectories are taken from the index when present
 	bool isDirectory = false;
 	if(path == "/")	// Top-level: Indexer directories
 	{
@@ -389,11 +427,20 @@ bool Indexer::process(String path, Resource &resource)
 				Directory::Create(realSubPath);
 
 			if(pathAccessLevel(subPath) != Resource::Public)
-				continue;	// put only public directories in root
+			{
+				// put only public directories in root
+				if(recursive)
+				{
+					Resource subResource;
+					process(subPath, subResource, true);
+				}
+				continue;
+			}
 
 			Resource subResource;
-			if(!process(subPath, subResource))
-				continue;	// ignore this directory
+			if(recursive || !get(subPath, subResource))
+				if(!process(subPath, subResource, recursive))
+					continue;	// ignore this directory
 
 			Time time = File::Time(realSubPath);
 			fileTime = std::max(fileTime, time);
@@ -412,6 +459,10 @@ bool Indexer::process(String path, Resource &resource)
 	{
 		isDirectory = true;
 
+#ifdef LINUX
+		watch(path, realPath);
+#endif
+
 		String tempFileName = File::TempName();
 		File tempFile(tempFileName, File::Truncate);
 
@@ -432,8 +483,9 @@ bool Indexer::process(String path, Resource &resource)
 			String realSubPath = this->realPath(subPath);
 
 			Resource subResource;
-			if(!process(subPath, subResource))
-				continue;	// ignore this file
+			if(recursive || it->first[0] != '0' || !get(subPath, subResource))
+				if(!process(subPath, subResource, recursive))
+					continue;	// ignore this file
 
 			Time time = File::Time(realSubPath);
 			Resource::DirectoryRecord record;
@@ -454,17 +506,35 @@ bool Indexer::process(String path, Resource &resource)
 			LogWarn("Indexer::process", String("Indexing failed: File does not exist: ") + realPath);
 			return false;
 		}
+
+		// Both throw if the file was removed meanwhile, the caller logs the failure
+		// The inode is 0 on filesystems without inode numbers, mtime and size still apply
+		fileSize = int64_t(File::Size(realPath));
+		fileInode = int64_t(File::Inode(realPath));
+	}
+
+	// Files are only re-hashed if their (mtime, size, inode) signature changed
+	bool changed;
+	if(isDirectory)
+	{
+		Time time(0);
+		changed = (!get(path, resource, &time) || time < fileTime || path == "/");
+	}
+	else {
+		changed = (hasChanged(path, fileTime, fileSize, fileInode) || !get(path, resource));
 	}
 
-	Time time(0);
-	if(!get(path, resource, &time) || time < fileTime || path == "/")
+	if(changed)
 	{
 		LogInfo("Indexer::process", "Processing: " + path);
 
 		resource.process(realPath, name, (isDirectory ? "directory" : "file"));
-		notify(path, resource, fileTime);
+		notify(path, resource, fileTime, fileSize, fileInode);
 
 		//LogDebug("Indexer::process", "Processed: digest is " + resource.digest().toString());
+
+		// This should be a background process, so sleep for a bit
+		if(!isDirectory) std::this_thread::sleep_for(milliseconds(100));
 	}
 
 	// Publish into DHT right now
@@ -479,6 +549,27 @@ bool Indexer::process(String path, Resource &resource)
 	return true;
 }
 
+bool Indexer::hasChanged(const String &path, const Time &time, int64_t size, int64_t inode)
+{
+	Database::Statement statement = mDatabase->prepare("SELECT time, size, inode FROM resources WHERE path = ?1 LIMIT 1");
+	statement.bind(1, path);
+	if(!statement.step())
+	{
+		statement.finalize();
+		return true;
+	}
+
+	Time storedTime(0);
+	int64_t storedSize = -1;
+	int64_t storedInode = -1;
+	statement.value(0, storedTime);
+	if(statement.type(1) != Database::Statement::Null) statement.value(1, storedSize);
+	if(statement.type(2) != Database::Statement::Null) statement.value(2, storedInode);
+	statement.finalize();
+
+	return (storedTime != time || storedSize != size || storedInode != inode);
+}
+
 bool Indexer::get(String path, Resource &resource, Time *time)
 {
 	// Sanitize path
@@ -514,7 +605,7 @@ bool Indexer::get(String path, Resource &resource, Time *time)
 	return false;
 }
 
-void Indexer::notify(String path, const Resource &resource, const Time &time)
+void Indexer::notify(String path, const Resource &resource, const Time &time, int64_t size, int64_t inode)
 {
 	// Sanitize path
 	if(!path.empty() && path[path.size() - 1] == Directory::Separator)
@@ -532,11 +623,13 @@ void Indexer::notify(String path, const Resource &resource, const Time &time)
 	statement.bind(1, name);
 	statement.execute();
 
-	statement = mDatabase->prepare("INSERT OR REPLACE INTO resources (name_rowid, path, digest, time, seen) VALUES ((SELECT rowid FROM names WHERE name = ?1 LIMIT 1), ?2, ?3, ?4, 1)");
+	statement = mDatabase->prepare("INSERT OR REPLACE INTO resources (name_rowid, path, digest, time, seen, size, inode) VALUES ((SELECT rowid FROM names WHERE name = ?1 LIMIT 1), ?2, ?3, ?4, 1, ?5, ?6)");
 	statement.bind(1, name);
 	statement.bind(2, path);
 	statement.bind(3, resource.digest());
 	statement.bind(4, time);
+	if(size >= 0) statement.bind(5, size);		// unbound parameters are NULL
+	if(inode >= 0) statement.bind(6, inode);
 	statement.execute();
 
 	// Resource has changed, re-publish it
@@ -1326,38 +1419,9 @@ void Indexer::update(String path)
 	//LogDebug("Indexer::update", "Updating: " + path);
 
 	try {
-		if(path == "/")	// Top-level: Indexer directories
-		{
-			Array<String> names;
-
-			{
-				std::unique_lock<std::mutex> lock(mMutex);
-				mDirectories.getKeys(names);
-			}
-
-			// Iterate on directories
-			for(int i=0; i<names.size(); ++i)
-			{
-				String subpath = "/" + names[i];
-				update(subpath);
-			}
-		}
-		else {
-			String realPath = this->realPath(path);
-			if(Directory::Exist(realPath))
-			{
-				// Iterate on files
-				Directory dir(realPath);
-				while(dir.nextFile())
-				{
-					String subpath = path + '/' + dir.fileName();
-					update(subpath);
-				}
-			}
-		}
-
+		// Single recursive visit, children are processed before their parent's record is built
 		Resource dummy;
-		process(path, dummy);
+		process(path, dummy, true);
 	}
 	catch(const Exception &e)
 	{
@@ -1443,6 +1507,168 @@ void Indexer::run(void)
 	start(seconds(6*3600));
 }
 
+void Indexer::runUpdates(void)
+{
+	Set<String> dirty, removed;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		if(mRunning)
+		{
+			// Retry after the current pass
+			mUpdateAlarm.schedule(seconds(10.));
+			return;
+		}
+
+		mRunning = true;
+		std::swap(dirty, mDirtyPaths);
+		std::swap(removed, mRemovedPaths);
+	}
+
+	try {
+		// Forget removed entries and their subtrees
+		for(auto it = removed.begin(); it != removed.end(); ++it)
+		{
+			Database::Statement statement = mDatabase->prepare("DELETE FROM resources WHERE path = ?1 OR path LIKE ?2");
+			statement.bind(1, *it);
+			statement.bind(2, *it + "/%");
+			statement.execute();
+		}
+
+		// Dirty directories and their ancestors are rebuilt bottom-up, each exactly once
+		Set<String> paths;
+		for(auto it = dirty.begin(); it != dirty.end(); ++it)
+		{
+			String path = *it;
+			while(paths.insert(path).second && path != "/")
+			{
+				path = path.beforeLast('/');
+				if(path.empty()) path = "/";
+			}
+		}
+
+		Array<std::pair<int, String> > sorted;
+		for(auto it = paths.begin(); it != paths.end(); ++it)
+		{
+			int depth = (*it == "/" ? 0 : int(std::count(it->begin(), it->end(), '/')));
+			sorted.append(std::make_pair(-depth, *it));
+		}
+		std::sort(sorted.begin(), sorted.end());
+
+		LogDebug("Indexer::runUpdates", "Updating " + String::number(int(sorted.size())) + " directories");
+
+		for(auto it = sorted.begin(); it != sorted.end(); ++it)
+		{
+			try {
+				Resource dummy;
+				process(it->second, dummy, false);
+			}
+			catch(const Exception &e)
+			{
+				LogWarn("Indexer::runUpdates", String("Processing failed for ") + it->second + ": " + e.what());
+			}
+		}
+	}
+	catch(const std::exception &e)
+	{
+		LogWarn("Indexer::runUpdates", e.what());
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mRunning = false;
+	}
+}
+
+void Indexer::markDirty(const String &path, const String &removed)
+{
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mDirtyPaths.insert(path);
+		if(!removed.empty()) mRemovedPaths.insert(removed);
+	}
+
+	// Debounce bursts of changes
+	mUpdateAlarm.schedule(Alarm::clock::now() + seconds(2.), [this]()
+	{
+		runUpdates();
+	});
+}
+
+#ifdef LINUX
+
+void Indexer::watch(const String &path, const String &realPath)
+{
+	if(mInotify < 0) return;
+
+	const uint32_t mask = IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_ONLYDIR;
+	int wd = inotify_add_watch(mInotify, realPath.pathEncode().c_str(), mask);
+	if(wd < 0)
+	{
+		LogWarn("Indexer::watch", "Unable to watch " + realPath + " (error " + String::number(errno) + ")");
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mWatches[wd] = path;
+}
+
+void Indexer::watchRun(void)
+{
+	char buffer[64*1024] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			if(mWatchStop) break;
+		}
+
+		try {
+			if(!Poller::Wait(mInotify, Poller::Read, seconds(1.)))
+				continue;
+
+			ssize_t len = ::read(mInotify, buffer, sizeof(buffer));
+			if(len <= 0) continue;
+
+			for(char *ptr = buffer; ptr < buffer + len; )
+			{
+				const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(ptr);
+				ptr+= sizeof(struct inotify_event) + event->len;
+
+				if(event->mask & IN_Q_OVERFLOW)
+				{
+					// Events were lost, fall back to a full pass
+					start(seconds(10.));
+					continue;
+				}
+
+				String path;
+				{
+					std::unique_lock<std::mutex> lock(mMutex);
+					if(!mWatches.get(event->wd, path)) continue;
+					if(event->mask & IN_IGNORED) mWatches.erase(event->wd);
+				}
+
+				if(event->mask & (IN_IGNORED | IN_DELETE_SELF)) continue;	// parent gets its own event
+
+				String name = (event->len ? String(event->name) : String());
+				if(name.empty()) continue;
+
+				String subPath = path + '/' + name;
+				if(event->mask & (IN_DELETE | IN_MOVED_FROM)) markDirty(path, subPath);
+				else markDirty(path);
+			}
+		}
+		catch(const std::exception &e)
+		{
+			LogWarn("Indexer::watchRun", e.what());
+			std::this_thread::sleep_for(seconds(1.));
+		}
+	}
+}
+
+#endif
+
 Indexer::Query::Query(const String &path) :
 	mPath(path),
 	mOffset(0), mCount(-1),
@@ -62,7 +62,7 @@ public:
 
 	bool process(String path, Resource &resource);
 	bool get(String path, Resource &resource, Time *time = NULL);
-	void notify(String path, const Resource &resource, const Time &time);
+	void notify(String path, const Resource &resource, const Time &time, int64_t size = -1, int64_t inode = -1);
 
 	// Publisher
 	bool anounce(const Network::Link &link, const String &prefix, const String &path, List<BinaryString> &targets);
@@ -108,6 +108,11 @@ private:
 	static const String UploadDirectoryName;
 
 	void run(void);
+	void runUpdates(void);
+
+	bool process(String path, Resource &resource, bool recursive);
+	bool hasChanged(const String &path, const Time &time, int64_t size, int64_t inode);
+	void markDirty(const String &path, const String &removed = "");
 
 	bool prepareQuery(Database::Statement &statement, const Query &query, const String &fields);
 	void update(String path = "/");
@@ -138,8 +143,24 @@ private:
 	String mBaseDirectory;
 	Map<String, Entry> mDirectories;
 	Alarm mRunAlarm;
+	Alarm mUpdateAlarm;
 	bool mRunning;
 
+	// Changes waiting for an incremental update
+	Set<String> mDirtyPaths;
+	Set<String> mRemovedPaths;
+
+#ifdef LINUX
+	// inotify watches on shared directories
+	void watch(const String &path, const String &realPath);
+	void watchRun(void);
+
+	int mInotify;
+	Map<int, String> mWatches;
+	std::thread mWatchThread;
+	bool mWatchStop;
+#endif
+
 	mutable std::mutex mMutex;
 };
 
@@ -297,7 +297,8 @@ void Interface::http(const String &prefix, Http::Request &request)
 			String tmp = request.url;
 			if(!tmp.empty() && tmp[0] == '/') tmp.ignore();
 			if(!tmp.empty() && tmp[tmp.size()-1] == '/') tmp.resize(tmp.size()-1);
-			if(tmp.empty() || tmp.contains('/')) throw 404;
+			if(tmp.empty()) throw 404;
+			String path = tmp.cut('/');
 
 			BinaryString digest;
 			try { tmp >> digest; }
@@ -307,6 +308,20 @@ void Interface::http(const String &prefix, Http::Request &request)
 			Resource resource;
 			resource.fetch(digest);		// this can take some time
 
+			// Resolve subpath, names are looked up in directory indexes
+			while(!path.empty())
+			{
+				String name = path;
+				path = name.cut('/');
+				if(name.empty()) continue;
+				if(!resource.isDirectory()) throw 404;
+
+				Resource::DirectoryIndex index(&resource);
+				Resource::DirectoryRecord record;
+				if(!index.find(name, record)) throw 404;
+				resource.fetch(record.digest);
+			}
+
 			// Playlist
 			if(request.get.contains("play") || request.get.contains("playlist"))
 			{
@@ -448,18 +463,13 @@ void Interface::process(Http::Request &request)
 	// URL must begin with /
 	if(request.url.empty() || request.url[0] != '/') throw 404;
 
-	List<String> list;
-	request.url.explode(list,'/');
-	list.pop_front();	// first element is empty because url begin with '/'
-	if(list.empty()) throw 500;
+	// Segments after the leading '/'
+	const StringView segments = request.url.view().mid(1);
 
-	if(list.front() == "user" && list.size() >= 2)
+	if(segments.contains('/') && segments.before('/') == "user")
 	{
 		sptr<User> user;
-		String name;
-
-		if(list.size() >= 2)
-			name = *(++list.begin());
+		String name(segments.after('/').before('/'));
 
 		String auth;
 		if(request.headers.get("Authorization", auth))
@@ -526,23 +536,22 @@ void Interface::process(Http::Request &request)
 		}
 	}
 
-	while(!list.empty())
+	// Match prefixes of the url, longest first, cutting at each '/' except the leading one
+	const StringView url = request.url.view();
+	size_t end = url.size();
+	while(true)
 	{
 		std::unique_lock<std::mutex> lock(mMutex);
 
-		String prefix;
-		prefix.implode(list,'/');
-		if(!prefix.empty())
-			prefix = "/" + prefix;
-
-		list.pop_back();
-
-		auto it = mPrefixes.find(prefix);
+		StringView candidate = (end > 1 ? url.left(end) : StringView());	// "/" matches the empty prefix
+		auto it = mPrefixes.find(candidate);
 		if(it != mPrefixes.end())
 		{
 			HttpInterfaceable *interfaceable = it->second;
 			lock.unlock();
 
+			String prefix(candidate);	// url is modified below
+
 			//LogDebug("Interface", "Matched prefix \""+prefix+"\"");
 			request.url.ignore(prefix.size());
 			if(request.url.empty())
@@ -551,6 +560,10 @@ void Interface::process(Http::Request &request)
 			interfaceable->http(prefix, request);
 			return;
 		}
+
+		end = url.left(end).lastIndexOf('/');
+		if(end == StringView::NotFound || end == 0)
+			break;
 	}
 
 	throw 404;
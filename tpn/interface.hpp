@@ -26,6 +26,7 @@
 
 #include "pla/http.hpp"
 #include "pla/map.hpp"
+#include "pla/hashmap.hpp"
 
 namespace tpn
 {
@@ -59,7 +60,7 @@ private:
 	void process(Http::Request &request);
 	void generate(Stream &out, int code, const String &message);
 
-	Map<String,HttpInterfaceable*> mPrefixes;
+	HashMap<String,HttpInterfaceable*> mPrefixes;
 	std::mutex mMutex;
 
   String mBadPasswordsString;
@@ -38,6 +38,7 @@
 #include "pla/random.hpp"
 #include "pla/securetransport.hpp"
 #include "pla/proxy.hpp"
+#include "pla/datagramsocket.hpp"
 #include "pla/file.hpp"
 
 #include <signal.h>
@@ -383,8 +384,15 @@ int run(String &commandLine, StringMap &args)
 	Config::Default("min_connections", "8");
 	Config::Default("max_connections", "256");
 	Config::Default("store_max_age", "21600");	// 6h
+	Config::Default("store_publish_period", "3600");	// 1h
+	Config::Default("read_ahead_blocks", "16");
+	Config::Default("prefetch_max_blocks", "8");
+	Config::Default("prefetch_max_size", "32");	// MiB
+	Config::Default("content_defined_chunking", "false");
 	Config::Default("user_global_shares", "true");
 	Config::Default("force_http_tunnel", "false");
+	Config::Default("datagram_receive_buffer", "4");	// MiB
+	Config::Default("datagram_queue_size", "4");	// MiB
 
 #ifdef ANDROID
 	Config::Default("cache_max_size", "200");		// MiB
@@ -627,6 +635,17 @@ int run(String &commandLine, StringMap &args)
 	Http::RequestTimeout = milliseconds(Config::Get("http_timeout").toInt());
 	Proxy::HttpProxy = Config::Get("http_proxy").trimmed();
 
+	// Datagram settings live in the platform library, they follow config changes
+	const Config::Value datagramReceiveBuffer("datagram_receive_buffer");
+	const Config::Value datagramQueueSize("datagram_queue_size");
+	auto applyDatagramConfig = [datagramReceiveBuffer, datagramQueueSize]()
+	{
+		DatagramSocket::ReceiveBufferSize = int(datagramReceiveBuffer.toDouble()*1024*1024);
+		DatagramStream::MaxQueueSize = size_t(datagramQueueSize.toDouble()*1024*1024);
+	};
+	applyDatagramConfig();
+	Config::Watch(applyDatagramConfig);
+
 	Tracker *tracker = NULL;
 	if(args.contains("tracker"))
 	{
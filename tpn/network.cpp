@@ -37,6 +37,11 @@
 namespace tpn
 {
 
+static const Config::Value RequestTimeout("request_timeout");
+static const Config::Value IdleTimeout("idle_timeout");
+static const Config::Value RetransmitTimeout("retransmit_timeout");
+static const Config::Value KeepaliveTimeout("keepalive_timeout");
+
 const duration Network::CallerFallbackTimeout = seconds(10.);
 const unsigned Network::DefaultTokens = 8;
 const unsigned Network::DefaultThreshold = Network::DefaultTokens*128;
@@ -47,10 +52,100 @@ const duration Network::CallPeriod = seconds(1.);
 
 Network *Network::Instance = NULL;
 const Network::Link Network::Link::Null;
+const Network::RecordType Network::InvalidType = Network::RecordType(-1);
+
+// Listeners are keyed by (remote, local), links with malformed identifiers have none
+static bool ListenerKey(const Identifier &remote, const Identifier &local, DigestPair &key)
+{
+	if(remote.size() != Digest::Size || local.size() != Digest::Size)
+		return false;
+
+	key = DigestPair(Digest(remote), Digest(local));
+	return true;
+}
+
+// Interned record types, only added so lookups read immutable snapshots without locking
+// There are few of them and names are short, so a lookup is a linear scan over packed names
+struct RecordTypeEntry
+{
+	String name;
+	uint64_t words[2];
+};
+
+typedef std::vector<RecordTypeEntry> RecordTypeTable;	// indexed by record type
+static std::mutex RecordTypesMutex;
+static std::vector<std::unique_ptr<const RecordTypeTable> > RecordTypesSnapshots;	// never freed
+static std::atomic<const RecordTypeTable*> RecordTypes(NULL);
+
+static bool LookupType(const RecordTypeTable *table, const String &name, Network::RecordType &type)
+{
+	if(!table) return false;
+
+	uint64_t words[2] = {0, 0};
+	const size_t size = name.size();
+	const bool packed = (size <= sizeof(words));
+	if(packed) std::memcpy(words, name.data(), size);
+
+	for(size_t i = 0; i < table->size(); ++i)
+	{
+		const RecordTypeEntry &entry = (*table)[i];
+		if(entry.name.size() != size) continue;
+		if(packed ? (entry.words[0] == words[0] && entry.words[1] == words[1]) : entry.name == name)
+		{
+			type = Network::RecordType(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+Network::RecordType Network::InternType(const String &name)
+{
+	std::unique_lock<std::mutex> lock(RecordTypesMutex);
+
+	const RecordTypeTable *current = RecordTypes.load(std::memory_order_acquire);
+	RecordType type;
+	if(LookupType(current, name, type)) return type;
+
+	RecordTypeEntry entry;
+	entry.name = name;
+	entry.words[0] = entry.words[1] = 0;
+	std::memcpy(entry.words, name.data(), std::min(name.size(), sizeof(entry.words)));
+
+	auto next = std::unique_ptr<RecordTypeTable>(current ? new RecordTypeTable(*current) : new RecordTypeTable);
+	type = RecordType(next->size());
+	next->push_back(entry);
+
+	RecordTypes.store(next.get(), std::memory_order_release);
+	RecordTypesSnapshots.push_back(std::move(next));
+	return type;
+}
+
+bool Network::FindType(const String &name, RecordType &type)
+{
+	return LookupType(RecordTypes.load(std::memory_order_acquire), name, type);
+}
 
 Network::Network(int port) :
 		mOverlay(port)
 {
+	setRecordHandler("pull", [this](const Link &link, Serializer &serializer) {
+		return incomingPull(link, serializer);
+	});
+	setRecordHandler("push", [this](const Link &link, Serializer &serializer) {
+		return incomingPush(link, serializer);
+	});
+	setRecordHandler("publish", [this](const Link &link, Serializer &serializer) {
+		return incomingPublish(link, serializer);
+	});
+	setRecordHandler("subscribe", [this](const Link &link, Serializer &serializer) {
+		return incomingSubscribe(link, serializer);
+	});
+	setRecordHandler("invite", [this](const Link &link, Serializer &serializer) {
+		return incomingInvite(link, serializer);
+	});
+
 	// Start network thread
 	mThread = std::thread([this]()
 	{
@@ -86,11 +181,13 @@ void Network::registerCaller(const BinaryString &target, Caller *caller)
 
 	LogDebug("Network::registerCaller", "Calling " + target.toString());
 
+	const Digest id(target);	// throws on invalid target
+
 	bool first = false;
 	{
 		std::unique_lock<std::mutex> lock(mCallersMutex);
-		first = !mCallers.contains(target);
-		mCallers[target].insert(caller);
+		first = !mCallers.contains(id);
+		mCallers[id].insert(caller);
 	}
 
 	if(first) directCall(target, Store::Instance->missing(target));
@@ -100,11 +197,13 @@ void Network::unregisterCaller(const BinaryString &target, Caller *caller)
 {
 	Assert(caller);
 
+	if(target.size() != Digest::Size) return;
+
 	bool last = false;
 	{
 		std::unique_lock<std::mutex> lock(mCallersMutex);
 
-		auto it = mCallers.find(target);
+		auto it = mCallers.find(Digest(target));
 		if(it != mCallers.end())
 		{
 			it->second.erase(caller);
@@ -121,8 +220,10 @@ void Network::unregisterCaller(const BinaryString &target, Caller *caller)
 
 void Network::unregisterAllCallers(const BinaryString &target)
 {
+	if(target.size() != Digest::Size) return;
+
 	std::unique_lock<std::mutex> lock(mCallersMutex);
-	mCallers.erase(target);
+	mCallers.erase(Digest(target));
 }
 
 void Network::registerListener(const Identifier &local, const Identifier &remote, Listener *listener)
@@ -131,7 +232,7 @@ void Network::registerListener(const Identifier &local, const Identifier &remote
 
 	{
 		std::unique_lock<std::recursive_mutex> lock(mListenersMutex);
-		mListeners[IdentifierPair(remote, local)].insert(listener);
+		mListeners[DigestPair(Digest(remote), Digest(local))].insert(listener);	// throws on invalid identifiers
 	}
 
 	Link link(local, remote);
@@ -157,19 +258,20 @@ void Network::registerListener(const Identifier &local, const Identifier &remote
 	{
 		std::unique_lock<std::recursive_mutex> lock(mSubscribersMutex);
 
-		for(auto it = mSubscribers.begin(); it != mSubscribers.end(); ++it)
+		mSubscribers.forEach([this, &link](const String &prefix, const Set<Subscriber*> &subscribers)
 		{
-			for(auto jt = it->second.begin(); jt != it->second.end(); ++jt)
+			for(Subscriber *subscriber : subscribers)
 			{
-				if((*jt)->link() == link)
+				if(subscriber->link() == link)
 				{
 					send(link, "subscribe",
 						Object()
-							.insert("path", it->first));
+							.insert("path", prefix)
+							.insert("trees", true));
 					break;
 				}
 			}
-		}
+		});
 	}
 }
 
@@ -177,10 +279,14 @@ void Network::unregisterListener(const Identifier &local, const Identifier &remo
 {
 	Assert(listener);
 
+	DigestPair key;
+	if(!ListenerKey(remote, local, key))
+		return;
+
 	{
 		std::unique_lock<std::recursive_mutex> lock(mListenersMutex);
 
-		auto it = mListeners.find(IdentifierPair(remote, local));
+		auto it = mListeners.find(key);
 		if(it != mListeners.end())
 		{
 			it->second.erase(listener);
@@ -201,7 +307,7 @@ void Network::publish(String prefix, Publisher *publisher)
 
 	{
 		std::unique_lock<std::recursive_mutex> lock(mPublishersMutex);
-		mPublishers[prefix].insert(publisher);
+		mPublishers.insert(prefix, publisher);
 	}
 }
 
@@ -214,14 +320,7 @@ void Network::unpublish(String prefix, Publisher *publisher)
 
 	{
 		std::unique_lock<std::recursive_mutex> lock(mPublishersMutex);
-
-		auto it = mPublishers.find(prefix);
-		if(it != mPublishers.end())
-		{
-			it->second.erase(publisher);
-			if(it->second.empty())
-				mPublishers.erase(it);
-		}
+		mPublishers.erase(prefix, publisher);
 	}
 }
 
@@ -236,7 +335,7 @@ void Network::subscribe(String prefix, Subscriber *subscriber)
 
 	{
 		std::unique_lock<std::recursive_mutex> lock(mSubscribersMutex);
-		mSubscribers[prefix].insert(subscriber);
+		mSubscribers.insert(prefix, subscriber);
 	}
 
 	// Local publishers
@@ -246,9 +345,11 @@ void Network::subscribe(String prefix, Subscriber *subscriber)
 	if(!subscriber->localOnly())
 	{
 		// Immediatly send subscribe message
+		// Advertise that board trees are understood, older nodes only read flat boards
 		send(subscriber->link(), "subscribe",
 			Object()
-				.insert("path", prefix));
+				.insert("path", prefix)
+				.insert("trees", true));
 
 		// Retrieve from cache
 		Set<BinaryString> targets;
@@ -269,14 +370,7 @@ void Network::unsubscribe(String prefix, Subscriber *subscriber)
 
 	{
 		std::unique_lock<std::recursive_mutex> lock(mSubscribersMutex);
-
-		auto it = mSubscribers.find(prefix);
-		if(it != mSubscribers.end())
-		{
-			it->second.erase(subscriber);
-			if(it->second.empty())
-				mSubscribers.erase(it);
-		}
+		mSubscribers.erase(prefix, subscriber);
 	}
 }
 
@@ -351,6 +445,11 @@ void Network::storeValue(const BinaryString &key, const BinaryString &value)
 	mOverlay.store(key, value);
 }
 
+void Network::storeValues(const Set<BinaryString> &keys, const BinaryString &value)
+{
+	mOverlay.store(keys, value);
+}
+
 bool Network::retrieveValue(const BinaryString &key, Set<BinaryString> &values)
 {
 	return mOverlay.retrieve(key, values);
@@ -375,9 +474,11 @@ bool Network::hasLink(const Link &link) const
 
 bool Network::getLinkFromNode(const BinaryString &node, Link &link) const
 {
+	if(node.size() != Digest::Size) return false;
+
 	std::unique_lock<std::mutex> lock(mLinksFromNodesMutex);
 
-	auto it = mLinksFromNodes.find(node);
+	auto it = mLinksFromNodes.find(Digest(node));
 	if(it != mLinksFromNodes.end() && !it->second.empty())
 	{
 		link = it->second.back();
@@ -386,6 +487,12 @@ bool Network::getLinkFromNode(const BinaryString &node, Link &link) const
 	else return false;
 }
 
+bool Network::isLegacy(const Link &link) const
+{
+	std::unique_lock<std::mutex> lock(mLegacyLinksMutex);
+	return mLegacyLinks.contains(link);
+}
+
 void Network::run(void)
 {
 	const duration period = CallPeriod;
@@ -418,8 +525,9 @@ void Network::run(void)
 					const BinaryString &key = message.source;
 
 					uint64_t ts = 0;
-					BinaryString value = message.content;
-					Assert(value.readBinary(ts) && !value.empty());
+					Buffer content(message.content);
+					Assert(content.readBinary(ts) && !content.empty());
+					const BinaryString value = content.toBinary();
 
 					// It can be about a block
 					matchCallers(key, value);
@@ -435,8 +543,9 @@ void Network::run(void)
 				{
 					uint16_t tokens = 0;
 					BinaryString target;
-					message.content.readBinary(tokens);
-					message.content.readBinary(target);
+					Buffer content(message.content);
+					content.readBinary(tokens);
+					content.readBinary(target);
 
 					if(Store::Instance->hasBlock(target))
 					{
@@ -454,8 +563,10 @@ void Network::run(void)
 				{
 					const BinaryString &target = message.source;
 					Fountain::Combination combination;
-					BinarySerializer(&message.content) >> combination;
-					combination.setCodedData(message.content);
+					BinarySerializer serializer(message.content.data(), message.content.size());
+					serializer >> combination;
+					const size_t left = serializer.left();
+					combination.setCodedData(message.content.data() + (message.content.size() - left), left);
 
 					//LogDebug("Network::run", "Data for " + target.toString() + " (" + combination.toString() + ")");
 
@@ -491,6 +602,26 @@ void Network::run(void)
 
 		// Send beacons
 		if(loops % 10 == 0) sendBeacons();
+
+		// Log non-empty send queues every minute
+		if(loops % 60 == 0)
+		{
+			Map<BinaryString, Array<size_t> > depths;
+			mOverlay.getQueueDepths(depths);
+			for(const auto &p : depths)
+			{
+				String text;
+				size_t total = 0;
+				for(size_t bytes : p.second)
+				{
+					if(!text.empty()) text+= ", ";
+					text+= String::number(uint64_t(bytes));
+					total+= bytes;
+				}
+
+				if(total) LogDebug("Network::run", "Queued bytes for " + p.first.toString() + " by traffic class: " + text);
+			}
+		}
 	}
 	catch(const std::exception &e)
 	{
@@ -506,13 +637,11 @@ void Network::sendCalls(void)
 
 		for(auto it = mCallers.begin(); it != mCallers.end(); ++it)
 		{
-			const BinaryString &target = it->first;
-
 			for(const Caller *caller : it->second)
 			{
 				if(caller->elapsed() >= CallerFallbackTimeout)
 				{
-					targets.insert(target);
+					targets.insert(it->first.toBinary());
 					break;
 				}
 			}
@@ -531,15 +660,12 @@ void Network::sendBeacons(void)
 
 	for(auto &p : mListeners)
 	{
-		localIds.insert(p.first.second);
-		remoteIds.insert(p.first.first);
+		localIds.insert(p.first.second.toBinary());
+		remoteIds.insert(p.first.first.toBinary());
 	}
 
-	for(auto &id : localIds)
-		storeValue(id, node);
-
-	for(auto &id : remoteIds)
-		mOverlay.retrieve(id);
+	storeValues(localIds, node);
+	mOverlay.retrieve(remoteIds);
 
 	//LogDebug("Network::run", "Identifiers: stored " + String::number(localIds.size()) + ", queried " + String::number(remoteIds.size()));
 
@@ -568,25 +694,26 @@ void Network::registerHandler(const Link &link, sptr<Handler> handler)
 	{
 		std::unique_lock<std::mutex> lock(mLinksFromNodesMutex);
 
-		mLinksFromNodes[link.node].push_back(link);
+		mLinksFromNodes[Digest(link.node)].push_back(link);	// node is checked by the overlay
 	}
 
 	{
 		std::unique_lock<std::recursive_mutex> lock(mSubscribersMutex);
 
-		for(auto it = mSubscribers.begin(); it != mSubscribers.end(); ++it)
+		mSubscribers.forEach([this, &link](const String &prefix, const Set<Subscriber*> &subscribers)
 		{
-			for(Subscriber *subscriber : it->second)
+			for(Subscriber *subscriber : subscribers)
 			{
 				if(subscriber->link() == link)
 				{
 					send(link, "subscribe",
 						Object()
-							.insert("path", it->first));
+							.insert("path", prefix)
+							.insert("trees", true));
 					break;
 				}
 			}
-		}
+		});
 	}
 
 	onConnected(link, true);
@@ -612,7 +739,7 @@ void Network::unregisterHandler(const Link &link, Handler *handler)
 	{
                 std::unique_lock<std::mutex> lock(mLinksFromNodesMutex);
 
-		auto it = mLinksFromNodes.find(link.node);
+		auto it = mLinksFromNodes.find(Digest(link.node));
 		if(it != mLinksFromNodes.end())
 		{
 			it->second.remove(link);
@@ -626,6 +753,11 @@ void Network::unregisterHandler(const Link &link, Handler *handler)
 		mRemoteSubscribers.erase(link);
 	}
 
+	{
+		std::unique_lock<std::mutex> lock(mLegacyLinksMutex);
+		mLegacyLinks.erase(link);
+	}
+
 	onConnected(link, false);
 }
 
@@ -646,14 +778,17 @@ bool Network::outgoing(const Link &link, const String &type, const Serializable
 		std::unique_lock<std::recursive_mutex> lock2(mListenersMutex, std::defer_lock);
 		std::lock(lock1, lock2);
 
+		const bool trustedOnly = (type == "subscribe");
+
 		for(auto it = mHandlers.lower_bound(link);
 			it != mHandlers.end() && it->first == link;
 			++it)
 		{
-			if(type == "subscribe")
+			if(trustedOnly)
 			{
 				// If link is not trusted, do not send subscriptions
-				if(!mListeners.contains(IdentifierPair(it->first.remote, it->first.local)))
+				DigestPair key;
+				if(!ListenerKey(it->first.remote, it->first.local, key) || !mListeners.contains(key))
 					continue;
 			}
 
@@ -711,102 +846,134 @@ bool Network::incoming(const Link &link, const String &type, Serializer &seriali
 {
 	LogDebug("Network::incoming", "Incoming command (type=\"" + type + "\")");
 
-	if(type == "pull")	// equivalent to call between users
-	{
-		BinaryString target;
-		unsigned tokens = 0;
-		serializer >> Object()
-				.insert("target", target)
-				.insert("tokens", tokens);
+	RecordType id;
+	if(!FindType(type, id)) id = InvalidType;
 
-		if(tokens) LogDebug("Network::incoming", "Pulled " + target.toString() + " (" + String::number(tokens) + " tokens)");
+	if(id < mRecordHandlers.size() && mRecordHandlers[id])
+		return mRecordHandlers[id](link, serializer);
 
-		if(!push(link, target, tokens))
-			LogWarn("Network::incoming", "Failed to push " + target.toString());
-	}
-	else if(type == "push")
-	{
-		BinaryString target;
-		serializer >> Object()
-				.insert("target", target);
-
-		unsigned tokens = Store::Instance->missing(target);
-		if(tokens) directCall(target, tokens);
-	}
-	else if(type == "publish")
-	{
-		// If link is not trusted, ignore publications
-		// Subscriptions are filtered in outgoing()
-		{
-			std::unique_lock<std::recursive_mutex> lock(mListenersMutex);
-			if(!mListeners.contains(IdentifierPair(link.remote, link.local)))
-				return false;
-		}
+	return onRecv(link, id, type, serializer);
+}
 
-		String path;
-		Mail mail;
-		List<BinaryString> targets;
-		serializer >> Object()
-				.insert("path", path)
-				.insert("message", mail)
-				.insert("targets", targets);
+bool Network::incomingPull(const Link &link, Serializer &serializer)
+{
+	// Equivalent to call between users
+	BinaryString target;
+	unsigned tokens = 0;
+	serializer >> Object()
+			.insert("target", target)
+			.insert("tokens", tokens);
 
-		if(!path.empty() && path[path.size()-1] == '/')
-			path.resize(path.size()-1);
+	if(tokens) LogDebug("Network::incoming", "Pulled " + target.toString() + " (" + String::number(tokens) + " tokens)");
 
-		BinaryString key = Store::Hash(path);
+	if(!push(link, target, tokens))
+		LogWarn("Network::incoming", "Failed to push " + target.toString());
 
-		// Message
-		if(!mail.empty() && !Store::Instance->hasValue(key, mail.digest()))
-		{
-			Store::Instance->storeValue(key, mail.digest(), Store::Temporary);
-			matchSubscribers(path, link, mail);
-		}
+	return true;
+}
 
-		// Targets
-		bool hasNew = false;
-		for(auto target : targets)
-		{
-			// We check in cache to prevent publishing loops
-			hasNew|= !Store::Instance->hasValue(key, target);
+bool Network::incomingPush(const Link &link, Serializer &serializer)
+{
+	BinaryString target;
+	serializer >> Object()
+			.insert("target", target);
 
-			Store::Instance->storeValue(key, target, Store::Temporary);		// cache path resolution
-			Store::Instance->storeValue(target, link.node, Store::Temporary);	// cache candidate node
-		}
+	unsigned tokens = Store::Instance->missing(target);
+	if(tokens) directCall(target, tokens);
+	return true;
+}
 
-		if(hasNew)
-		{
-			RemotePublisher publisher(targets, link);
-			matchSubscribers(path, link, &publisher);
-		}
-	}
-	else if(type == "subscribe")
+bool Network::incomingPublish(const Link &link, Serializer &serializer)
+{
+	// If link is not trusted, ignore publications
+	// Subscriptions are filtered in outgoing()
 	{
-		String path;
-		serializer >> Object()
-				.insert("path", path);
+		DigestPair key;
+		std::unique_lock<std::recursive_mutex> lock(mListenersMutex);
+		if(!ListenerKey(link.remote, link.local, key) || !mListeners.contains(key))
+			return false;
+	}
 
-		if(!path.empty() && path[path.size()-1] == '/')
+	String path;
+	Mail mail;
+	List<BinaryString> targets;
+	serializer >> Object()
+			.insert("path", path)
+			.insert("message", mail)
+			.insert("targets", targets);
+
+	if(!path.empty() && path[path.size()-1] == '/')
 		path.resize(path.size()-1);
 
-		addRemoteSubscriber(link, path);
+	BinaryString key = Store::Hash(path);
+
+	// Message
+	if(!mail.empty() && !Store::Instance->hasValue(key, mail.digest()))
+	{
+		Store::Instance->storeValue(key, mail.digest(), Store::Temporary);
+		matchSubscribers(path, link, mail);
 	}
-	else if(type == "invite")
+
+	// Targets
+	bool hasNew = false;
+	for(auto target : targets)
 	{
-		String name;
-		serializer >> Object()
-				.insert("name", name);
+		// We check in cache to prevent publishing loops
+		hasNew|= !Store::Instance->hasValue(key, target);
 
-		sptr<User> user = User::GetByIdentifier(link.local);
-		if(user && !name.empty()) user->invite(link.remote, name);
+		Store::Instance->storeValue(key, target, Store::Temporary);		// cache path resolution
+		Store::Instance->storeValue(target, link.node, Store::Temporary);	// cache candidate node
 	}
-	else {
-		return onRecv(link, type, serializer);
+
+	if(hasNew)
+	{
+		RemotePublisher publisher(targets, link);
+		matchSubscribers(path, link, &publisher);
+	}
+
+	return true;
+}
+
+bool Network::incomingSubscribe(const Link &link, Serializer &serializer)
+{
+	String path;
+	bool trees = false;
+	serializer >> Object()
+			.insert("path", path)
+			.insert("trees", trees);
+
+	if(!path.empty() && path[path.size()-1] == '/')
+		path.resize(path.size()-1);
+
+	{
+		std::unique_lock<std::mutex> lock(mLegacyLinksMutex);
+		if(trees) mLegacyLinks.erase(link);
+		else mLegacyLinks.insert(link);
 	}
 
+	addRemoteSubscriber(link, path);
 	return true;
 }
 
+bool Network::incomingInvite(const Link &link, Serializer &serializer)
+{
+	String name;
+	serializer >> Object()
+			.insert("name", name);
+
+	sptr<User> user = User::GetByIdentifier(link.local);
+	if(user && !name.empty()) user->invite(link.remote, name);
+	return true;
+}
+
+void Network::setRecordHandler(const String &type, RecordHandler handler)
+{
+	// Only called on construction, so the table is read without locking
+	RecordType id = InternType(type);
+	if(mRecordHandlers.size() <= id) mRecordHandlers.resize(id + 1);
+	mRecordHandlers[id] = handler;
+}
+
 bool Network::directCall(const BinaryString &target, unsigned tokens)
 {
 	// Get hints from Store
@@ -873,63 +1040,53 @@ bool Network::fallbackCall(const BinaryString &target, unsigned tokens)
 	return success;
 }
 
+// Path relative to a matched prefix
+static String TruncatePath(const String &path, const String &prefix)
+{
+	if(path.size() <= prefix.size()) return "/";
+	return String(path.data() + prefix.size(), path.size() - prefix.size());
+}
+
 bool Network::matchPublishers(const String &path, const Link &link, Subscriber *subscriber)
 {
 	if(path.empty() || path[0] != '/') return false;
 
-	List<String> list;
-	path.before('?').explode(list,'/');
-	if(list.empty()) return false;
-	list.pop_front();
-
-	// Match prefixes, longest first
-	while(true)
+	// Match prefixes of the path without query, longest first
+	std::unique_lock<std::recursive_mutex> lock(mPublishersMutex);
+	mPublishers.match(path.data(), std::min(path.find('?'), path.size()), [&](const String &prefix, const Set<Publisher*> &publishers)
 	{
-		std::unique_lock<std::recursive_mutex> lock(mPublishersMutex);
-
-		String prefix;
-		prefix.implode(list, '/');
-		prefix = "/" + prefix;
-
-		String truncatedPath(path.substr(prefix.size()));
-		if(truncatedPath.empty()) truncatedPath = "/";
-
+		String truncatedPath;	// built on first use
 		List<BinaryString> targets;
-		auto it = mPublishers.find(prefix);
-		if(it != mPublishers.end())
+		for(Publisher *publisher : publishers)
 		{
-			for(Publisher *publisher : it->second)
-			{
-				if(publisher->link() != link)
-					continue;
+			if(publisher->link() != link)
+				continue;
+
+			if(truncatedPath.empty()) truncatedPath = TruncatePath(path, prefix);
 
-				List<BinaryString> result;
-				if(publisher->anounce(link, prefix, truncatedPath, result))
+			List<BinaryString> result;
+			if(publisher->anounce(link, prefix, truncatedPath, result))
+			{
+				Assert(!result.empty());
+				if(subscriber) 	// local
 				{
-					Assert(!result.empty());
-					if(subscriber) 	// local
-					{
-						for(const auto &t : result)
-							subscriber->incoming(publisher->link(), prefix, truncatedPath, t);
-					}
-					else targets.splice(targets.end(), result);	// remote
+					for(const auto &t : result)
+						subscriber->incoming(publisher->link(), prefix, truncatedPath, t);
 				}
+				else targets.splice(targets.end(), result);	// remote
 			}
+		}
 
-			if(!targets.empty())	// remote
-			{
-				LogDebug("Network::matchPublishers", "Anouncing " + path);
+		if(!targets.empty())	// remote
+		{
+			LogDebug("Network::matchPublishers", "Anouncing " + path);
 
-				send(link, "publish",
-					Object()
-						.insert("path", path)
-						.insert("targets", targets));
-			}
+			send(link, "publish",
+				Object()
+					.insert("path", path)
+					.insert("targets", targets));
 		}
-
-		if(list.empty()) break;
-		list.pop_back();
-	}
+	});
 
 	return true;
 }
@@ -938,47 +1095,31 @@ bool Network::matchSubscribers(const String &path, const Link &link, Publisher *
 {
 	if(path.empty() || path[0] != '/') return false;
 
-	List<String> list;
-	path.explode(list,'/');
-	if(list.empty()) return false;
-	list.pop_front();
-
 	// Match prefixes, longest first
-	while(true)
+	std::unique_lock<std::recursive_mutex> lock(mSubscribersMutex);
+	mSubscribers.match(path, [&](const String &prefix, const Set<Subscriber*> &subscribers)
 	{
-		std::unique_lock<std::recursive_mutex> lock(mSubscribersMutex);
-
-		String prefix;
-		prefix.implode(list, '/');
-		prefix = "/" + prefix;
-
-		String truncatedPath(path.substr(prefix.size()));
-		if(truncatedPath.empty()) truncatedPath = "/";
+		String truncatedPath;	// built on first use
 
 		// Pass to subscribers
-		auto it = mSubscribers.find(prefix);
-		if(it != mSubscribers.end())
+		for(Subscriber *subscriber : subscribers)
 		{
-			for(Subscriber *subscriber : it->second)
-			{
-				if(subscriber->link() != link)
-					continue;
+			if(subscriber->link() != link)
+				continue;
+
+			if(truncatedPath.empty()) truncatedPath = TruncatePath(path, prefix);
 
-				List<BinaryString> targets;
-				if(publisher->anounce(link, prefix, truncatedPath, targets))
+			List<BinaryString> targets;
+			if(publisher->anounce(link, prefix, truncatedPath, targets))
+			{
+				for(const auto &t : targets)
 				{
-					for(const auto &t : targets)
-					{
-						// TODO: should prevent forwarding in case we want to republish another content
-						subscriber->incoming(publisher->link(), prefix, truncatedPath, t);
-					}
+					// TODO: should prevent forwarding in case we want to republish another content
+					subscriber->incoming(publisher->link(), prefix, truncatedPath, t);
 				}
 			}
 		}
-
-		if(list.empty()) break;
-		list.pop_back();
-	}
+	});
 
 	return true;
 }
@@ -987,39 +1128,23 @@ bool Network::matchSubscribers(const String &path, const Link &link, const Mail
 {
 	if(path.empty() || path[0] != '/') return false;
 
-	List<String> list;
-	path.explode(list,'/');
-	if(list.empty()) return false;
-	list.pop_front();
-
 	// Match prefixes, longest first
-	while(true)
+	std::unique_lock<std::recursive_mutex> lock(mSubscribersMutex);
+	mSubscribers.match(path, [&](const String &prefix, const Set<Subscriber*> &subscribers)
 	{
-		std::unique_lock<std::recursive_mutex> lock(mSubscribersMutex);
-
-		String prefix;
-		prefix.implode(list, '/');
-		prefix = "/" + prefix;
-
-		String truncatedPath(path.substr(prefix.size()));
-		if(truncatedPath.empty()) truncatedPath = "/";
+		String truncatedPath;	// built on first use
 
 		// Pass to subscribers
-		auto it = mSubscribers.find(prefix);
-		if(it != mSubscribers.end())
+		for(Subscriber *subscriber : subscribers)
 		{
-			for(Subscriber *subscriber : it->second)
-			{
-				if(subscriber->link() != link)
-					continue;
+			if(subscriber->link() != link)
+				continue;
 
-				subscriber->incoming(link, prefix, truncatedPath, mail);
-			}
-		}
+			if(truncatedPath.empty()) truncatedPath = TruncatePath(path, prefix);
 
-		if(list.empty()) break;
-		list.pop_back();
-	}
+			subscriber->incoming(link, prefix, truncatedPath, mail);
+		}
+	});
 
 	return true;
 }
@@ -1029,15 +1154,20 @@ bool Network::matchCallers(const Identifier &target, const Identifier &node)
 	if(node == mOverlay.localNode())
 		return false;
 
+	if(target.size() != Digest::Size || node.size() != Digest::Size)
+		return false;
+
+	const Digest targetId(target), nodeId(node);
+
 	std::unique_lock<std::mutex> lock(mCallersMutex);
 
-	if(!mCallers.contains(target))
+	if(!mCallers.contains(targetId))
 		return false;
 
-	if(mCallCandidates[target].contains(node))
+	if(mCallCandidates[targetId].contains(nodeId))
 		return true;
 
-	mCallCandidates[target].insert(node);
+	mCallCandidates[targetId].insert(nodeId);
 
 	LogDebug("Network::run", "Got candidate for " + target.toString());
 
@@ -1055,18 +1185,22 @@ bool Network::matchListeners(const Identifier &identifier, const Identifier &nod
 	if(node == mOverlay.localNode())
 		return false;
 
+	if(identifier.size() != Digest::Size)
+		return false;
+
 	std::unique_lock<std::recursive_mutex> lock(mListenersMutex);
 
-	auto it = mListeners.lower_bound(IdentifierPair(identifier, Identifier::Empty));	// pair is (remote, local)
+	const Digest remote(identifier);
+	auto it = mListeners.lower_bound(DigestPair(remote, Digest::Empty));	// pair is (remote, local)
 	if(it == mListeners.end())
 		return false;
 
 	//LogDebug("Network::run", "Got instance for " + identifier.toString());
 
-	while(it != mListeners.end() && it->first.first == identifier)
+	while(it != mListeners.end() && it->first.first == remote)
 	{
 		for(auto listener : it->second)
-			listener->seen(Link(it->first.second, it->first.first, node));
+			listener->seen(Link(it->first.second.toBinary(), identifier, node));
 		++it;
 	}
 
@@ -1077,10 +1211,13 @@ void Network::onConnected(const Link &link, bool status) const
 {
 	std::unique_lock<std::recursive_mutex> lock(mListenersMutex);
 
-	auto it = mListeners.find(IdentifierPair(link.remote, link.local));
+	DigestPair key;
+	if(!ListenerKey(link.remote, link.local, key)) return;
+
+	auto it = mListeners.find(key);
 	if(it == mListeners.end()) return;
 
-	while(it != mListeners.end() && it->first.first == link.remote && it->first.second == link.local)
+	while(it != mListeners.end() && it->first == key)
 	{
 		for(auto listener : it->second)
 		{
@@ -1091,18 +1228,21 @@ void Network::onConnected(const Link &link, bool status) const
 	}
 }
 
-bool Network::onRecv(const Link &link, const String &type, Serializer &serializer) const
+bool Network::onRecv(const Link &link, RecordType type, const String &name, Serializer &serializer) const
 {
 	std::unique_lock<std::recursive_mutex> lock(mListenersMutex);
 
-	auto it = mListeners.find(IdentifierPair(link.remote, link.local));
+	DigestPair key;
+	if(!ListenerKey(link.remote, link.local, key)) return false;
+
+	auto it = mListeners.find(key);
 	if(it == mListeners.end()) return false;
 
 	bool ret = false;
-	while(it != mListeners.end() && it->first.first == link.remote && it->first.second == link.local)
+	while(it != mListeners.end() && it->first == key)
 	{
 		for(auto listener : it->second)
-			ret|= listener->recv(link, type, serializer);
+			ret|= listener->dispatch(link, type, name, serializer);
 		++it;
 	}
 
@@ -1113,10 +1253,13 @@ bool Network::onAuth(const Link &link, const Rsa::PublicKey &pubKey) const
 {
 	std::unique_lock<std::recursive_mutex> lock(mListenersMutex);
 
-	auto it = mListeners.find(IdentifierPair(link.remote, link.local));
+	DigestPair key;
+	if(!ListenerKey(link.remote, link.local, key)) return false;
+
+	auto it = mListeners.find(key);
 	if(it == mListeners.end()) return false;
 
-	while(it != mListeners.end() && it->first.first == link.remote && it->first.second == link.local)
+	while(it != mListeners.end() && it->first == key)
 	{
 		for(auto listener : it->second)
 			if(!listener->auth(link, pubKey))
@@ -1464,6 +1607,21 @@ void Network::Listener::ignore(void)
 	mPairs.clear();
 }
 
+void Network::Listener::handle(const String &type, RecordHandler handler)
+{
+	RecordType id = InternType(type);
+	if(mRecordHandlers.size() <= id) mRecordHandlers.resize(id + 1);
+	mRecordHandlers[id] = handler;
+}
+
+bool Network::Listener::dispatch(const Link &link, RecordType type, const String &name, Serializer &serializer)
+{
+	if(type < mRecordHandlers.size() && mRecordHandlers[type])
+		return mRecordHandlers[type](link, serializer);
+
+	return recv(link, name, serializer);
+}
+
 Network::Tunneler::Tunneler(void) :
 	mPool(10),
 	mStop(false)
@@ -1574,7 +1732,7 @@ SecureTransport *Network::Tunneler::listen(BinaryString *source)
 			mQueue.pop();
 		}
 
-		// Read tunnel ID
+		// Read tunnel ID, message is our own copy so its cursor then skips the ID for the tunnel
 		uint64_t tunnelId = 0;
 		if(!message.content.readBinary(tunnelId))
 			continue;
@@ -1719,7 +1877,7 @@ bool Network::Tunneler::handshake(SecureTransport *transport, const Link &link)
 				transport->setDatagramMtu(TunnelMtu);
 
 				// Set timeout
-				duration timeout = milliseconds(Config::Get("request_timeout").toDouble());
+				duration timeout = RequestTimeout.toMilliseconds();
 				transport->setHandshakeTimeout(timeout);
 
 				// Do handshake
@@ -1790,7 +1948,7 @@ Network::Tunneler::Tunnel::Tunnel(Tunneler *tunneler, uint64_t id, const BinaryS
 	mId(id),
 	mNode(node),
 	mOffset(0),
-	mTimeout(milliseconds(Config::Get("idle_timeout").toDouble())),
+	mTimeout(IdleTimeout.toMilliseconds()),
 	mClosed(false)
 {
 	mBuffer.writeBinary(mId);
@@ -1925,8 +2083,8 @@ Network::Handler::Handler(Stream *stream, const Link &link) :
 	mSideSeen(0),
 	mSideCount(0),
 	mCongestion(false),
-	mTimeout(milliseconds(Config::Get("retransmit_timeout").toDouble())),
-	mKeepaliveTimeout(milliseconds(Config::Get("keepalive_timeout").toDouble())),	// so the tunnel should not time out
+	mTimeout(RetransmitTimeout.toMilliseconds()),
+	mKeepaliveTimeout(KeepaliveTimeout.toMilliseconds()),	// so the tunnel should not time out
 	mClosed(false)
 {
 	// Set timeout alarm
@@ -2494,13 +2652,16 @@ void Network::Pusher::run(void)
 					Store::Instance->pull(target, combination, &rank);
 
 					tokens = std::min(tokens, rank + mRedundant);
-					--tokens;
 
-					Overlay::Message data(Overlay::Message::Data, "", destination, target);
-					BinarySerializer(&data.content) << combination;
-					data.content.writeBinary(combination.data(), combination.codedSize());
+					BinaryString content;
+					BinarySerializer(&content) << combination;
+					content.writeBinary(combination.data(), combination.codedSize());
+
+					Overlay::Message data(Overlay::Message::Data, std::move(content), destination, target);
 
-					congestion|= !Network::Instance->overlay()->send(data);
+					// Only consume a token if the combination was actually queued
+					if(Network::Instance->overlay()->send(data)) --tokens;
+					else congestion = true;
 				}
 
 				if(!tokens) list.pop_front();
@@ -2512,8 +2673,8 @@ void Network::Pusher::run(void)
 
 		if(congestion)
 		{
-			lock.unlock();
-			std::this_thread::yield();
+			// Overlay send queues are full, back off
+			mCondition.wait_for(lock, milliseconds(10.));
 		}
 	}
 	catch(const std::exception &e)
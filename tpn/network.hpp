@@ -36,6 +36,8 @@
 #include "pla/scheduler.hpp"
 #include "pla/alarm.hpp"
 #include "pla/map.hpp"
+#include "pla/hashmap.hpp"
+#include "pla/pathtree.hpp"
 #include "pla/array.hpp"
 
 namespace tpn
@@ -77,6 +79,14 @@ public:
 		bool operator != (const Network::Link &l) const;
 	};
 
+	// Record types are interned to small integers and dispatched through tables
+	typedef unsigned RecordType;
+	typedef std::function<bool(const Link &link, Serializer &serializer)> RecordHandler;
+	static const RecordType InvalidType;
+
+	static RecordType InternType(const String &name);
+	static bool FindType(const String &name, RecordType &type);
+
 	class Publisher
 	{
 	public:
@@ -151,11 +161,20 @@ public:
 
 		virtual void seen(const Link &link) {}
 		virtual void connected(const Link &link, bool status) {}
-		virtual bool recv(const Link &link, const String &type, Serializer &serializer) = 0;
+		virtual bool recv(const Link &link, const String &type, Serializer &serializer) { return false; }
 		virtual bool auth(const Link &link, const Rsa::PublicKey &pubKey) { return false; }
 
+	protected:
+		// Typed handlers take precedence over recv(), they must be set before listen()
+		void handle(const String &type, RecordHandler handler);
+
 	private:
+		bool dispatch(const Link &link, RecordType type, const String &name, Serializer &serializer);
+
 		Set<IdentifierPair> mPairs;
+		std::vector<RecordHandler> mRecordHandlers;	// indexed by record type
+
+		friend class Network;
 	};
 
 	Network(int port);
@@ -195,6 +214,7 @@ public:
 
 	// DHT
 	void storeValue(const BinaryString &key, const BinaryString &value);
+	void storeValues(const Set<BinaryString> &keys, const BinaryString &value);
   bool retrieveValue(const BinaryString &key, Set<BinaryString> &values);
 	bool retrieveValue(const BinaryString &key, Set<BinaryString> &values, duration timeout);
 
@@ -202,6 +222,7 @@ public:
 	bool hasLink(const Identifier &local, const Identifier &remote) const;
 	bool hasLink(const Link &link) const;
 	bool getLinkFromNode(const Identifier &node, Link &link) const;
+	bool isLegacy(const Link &link) const;	// remote did not advertise board trees in its subscriptions
 
 	void sendCalls(void);
 	void sendBeacons(void);
@@ -363,6 +384,12 @@ private:
 	bool outgoing(const String &type, const Serializable &content);
 	bool outgoing(const Link &link, const String &type, const Serializable &content);
 	bool incoming(const Link &link, const String &type, Serializer &serializer);
+	bool incomingPull(const Link &link, Serializer &serializer);
+	bool incomingPush(const Link &link, Serializer &serializer);
+	bool incomingPublish(const Link &link, Serializer &serializer);
+	bool incomingSubscribe(const Link &link, Serializer &serializer);
+	bool incomingInvite(const Link &link, Serializer &serializer);
+	void setRecordHandler(const String &type, RecordHandler handler);
 
 	bool directCall(const BinaryString &target, unsigned tokens);
 	bool fallbackCall(const BinaryString &target, unsigned tokens);
@@ -374,7 +401,7 @@ private:
 	bool matchListeners(const Identifier &identifier, const Identifier &node);
 
 	void onConnected(const Link &link, bool status = true) const;
-	bool onRecv(const Link &link, const String &type, Serializer &serializer) const;
+	bool onRecv(const Link &link, RecordType type, const String &name, Serializer &serializer) const;
 	bool onAuth(const Link &link, const Rsa::PublicKey &pubKey) const;
 
 	Overlay mOverlay;
@@ -382,13 +409,15 @@ private:
 	Scheduler mScheduler;
 
 	Map<Link, sptr<Handler> > mHandlers;
-	Map<String, Set<Publisher*> > mPublishers;
-	Map<String, Set<Subscriber*> > mSubscribers;
-	Map<BinaryString, Set<Caller*> > mCallers;
-	Map<BinaryString, Set<BinaryString> > mCallCandidates;
-	Map<IdentifierPair, Set<Listener*> > mListeners;
+	std::vector<RecordHandler> mRecordHandlers;	// indexed by record type, set on construction
+	PathTree<Publisher*> mPublishers;
+	PathTree<Subscriber*> mSubscribers;
+	HashMap<Digest, Set<Caller*> > mCallers;
+	HashMap<Digest, Set<Digest> > mCallCandidates;
+	Map<DigestPair, Set<Listener*> > mListeners;	// keyed by (remote, local)
 	Map<Link, Map<String, sptr<RemoteSubscriber> > > mRemoteSubscribers;
-	Map<Identifier, List<Link> > mLinksFromNodes;
+	HashMap<Digest, List<Link> > mLinksFromNodes;
+	Set<Link> mLegacyLinks;
 
 	mutable std::recursive_mutex mHandlersMutex;	// recursive so listeners can call network on event
 	mutable std::recursive_mutex mListenersMutex;	// idem
@@ -397,6 +426,7 @@ private:
 	mutable std::mutex mRemoteSubscribersMutex;
 	mutable std::mutex mCallersMutex;
 	mutable std::mutex mLinksFromNodesMutex;
+	mutable std::mutex mLegacyLinksMutex;
 
 	std::thread mThread;
 
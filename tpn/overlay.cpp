@@ -43,9 +43,30 @@
 namespace tpn
 {
 
-const int Overlay::MaxQueueSize = 128;
+static const Config::Value RequestTimeout("request_timeout");
+static const Config::Value ConnectTimeout("connect_timeout");
+static const Config::Value IdleTimeout("idle_timeout");
+static const Config::Value KeepaliveTimeout("keepalive_timeout");
+static const Config::Value ForceHttpTunnel("force_http_tunnel");
+static const Config::Value MinConnections("min_connections");
+
 const int Overlay::StoreNeighbors = 3;
 const int Overlay::DefaultTtl = 16;
+const size_t Overlay::MaxBatchSize = 1024;	// bytes, so batches fit in a datagram
+
+const size_t Overlay::MaxQueueBytes[Overlay::TrafficClasses] = {
+	16*1024,	// control
+	64*1024,	// DHT
+	128*1024,	// tunnel
+	128*1024	// data
+};
+
+const size_t Overlay::QueueQuantum[Overlay::TrafficClasses] = {
+	0,		// control (strict priority)
+	2*1500,		// DHT
+	2*1500,		// tunnel
+	1500		// data
+};
 
 Overlay::Overlay(int port) :
 		mPool(2 + 3)
@@ -64,6 +85,7 @@ Overlay::Overlay(int port) :
 
 	// Generate local node id
 	mLocalNode = mPublicKey.digest();
+	mLocalId = Digest(mLocalNode);
 
 	// Create certificate
 	mCertificate = std::make_shared<SecureTransport::RsaCertificate>(mPublicKey, mPrivateKey, localNode().toString());
@@ -184,10 +206,10 @@ int Overlay::getRemoteAddresses(const BinaryString &remote, Set<Address> &set) c
 	std::unique_lock<std::mutex> lock(mMutex);
 
 	set.clear();
-	if(remote.empty()) return 0;
+	if(remote.size() != Digest::Size) return 0;
 
 	sptr<Handler> handler;
-	if(mHandlers.get(remote, handler))
+	if(mHandlers.get(Digest(remote), handler))
 		handler->getAddresses(set);
 
 	return set.size();
@@ -285,8 +307,10 @@ bool Overlay::connect(const Address &addr, const BinaryString &remote, bool asyn
 
 bool Overlay::isConnected(const BinaryString &remote) const
 {
+	if(remote.size() != Digest::Size) return false;
+
 	std::unique_lock<std::mutex> lock(mMutex);
-	return mHandlers.contains(remote);
+	return mHandlers.contains(Digest(remote));
 }
 
 bool Overlay::waitConnection(void) const
@@ -297,7 +321,7 @@ bool Overlay::waitConnection(void) const
 bool Overlay::waitConnection(duration timeout) const
 {
 	if(timeout <= duration(0))
-		timeout = milliseconds(Config::Get("request_timeout").toDouble());
+		timeout = RequestTimeout.toMilliseconds();
 
 	std::unique_lock<std::mutex> lock(mMutex);
 	if(!mHandlers.empty())
@@ -314,6 +338,15 @@ int Overlay::connectionsCount(void) const
 	return mHandlers.size();
 }
 
+void Overlay::getQueueDepths(Map<BinaryString, Array<size_t> > &result) const
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	result.clear();
+	for(const auto &p : mHandlers)
+		p.second->getQueueDepths(result[p.first.toBinary()]);
+}
+
 bool Overlay::recv(Message &message, duration timeout)
 {
 	std::unique_lock<std::mutex> lock(mIncomingMutex);
@@ -342,37 +375,76 @@ void Overlay::store(const BinaryString &key, const BinaryString &value)
 {
 	Store::Instance->storeValue(key, value, Store::Distributed);
 
+	// Only identifier-sized keys can be routed
+	if(key.size() != Digest::Size) return;
+
 	Message message(Message::Store, value, key);
-	Array<BinaryString> nodes;
-	if(getRoutes(key, StoreNeighbors, nodes))
+	Array<Digest> nodes;
+	if(getRoutes(Digest(key), StoreNeighbors, nodes))
 	{
 		for(int i=0; i<nodes.size(); ++i)
 		{
-			if(nodes[i] != localNode())
+			if(nodes[i] != mLocalId)
 				sendTo(message, nodes[i]);
 		}
 	}
 }
 
+void Overlay::store(const Set<BinaryString> &keys, const BinaryString &value)
+{
+	Array<Digest> neighbors;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mHandlers.getKeys(neighbors);
+	}
+
+	// Group keys by closest nodes
+	Map<Digest, Set<BinaryString> > batches;
+	for(const BinaryString &key : keys)
+	{
+		Store::Instance->storeValue(key, value, Store::Distributed);
+		if(key.size() != Digest::Size) continue;
+
+		Array<Digest> nodes;
+		if(getRoutes(Digest(key), StoreNeighbors, neighbors, nodes))
+		{
+			for(int i=0; i<nodes.size(); ++i)
+			{
+				if(nodes[i] != mLocalId)
+					batches[nodes[i]].insert(key);
+			}
+		}
+	}
+
+	for(const auto &p : batches)
+		sendBatch(Message::StoreBatch, p.first, p.second, value);
+}
+
 void Overlay::retrieve(const BinaryString &key)
 {
 	send(Message(Message::Retrieve, "", key));
 
 	// Push Value messages in local queue
-	BinaryString node(localNode());
-	List<BinaryString> values;
-	List<Time> times;
-	if(Store::Instance->retrieveValue(key, values, times))
+	pushValues(key);
+}
+
+void Overlay::retrieve(const Set<BinaryString> &keys)
+{
+	// Group keys by next hop
+	Map<Digest, Set<BinaryString> > batches;
+	for(const BinaryString &key : keys)
 	{
-		while(!values.empty())
-		{
-			Assert(!times.empty());
-			Message message(Message::Value, BinaryString::number(uint64_t(times.front())) + values.front(), node, key);
-			push(message);
-			values.pop_front();
-			times.pop_front();
-		}
+		Digest route;
+		if(key.size() == Digest::Size && getRoute(Digest(key), Digest::Empty, route))
+			batches[route].insert(key);
 	}
+
+	for(const auto &p : batches)
+		sendBatch(Message::RetrieveBatch, p.first, p.second);
+
+	// Push Value messages in local queue
+	for(const BinaryString &key : keys)
+		pushValues(key);
 }
 
 bool Overlay::retrieve(const BinaryString &key, Set<BinaryString> &values)
@@ -383,7 +455,7 @@ bool Overlay::retrieve(const BinaryString &key, Set<BinaryString> &values)
 bool Overlay::retrieve(const BinaryString &key, Set<BinaryString> &values, duration timeout)
 {
 	if(timeout <= duration(0))
-		timeout = milliseconds(Config::Get("request_timeout").toDouble());
+		timeout = RequestTimeout.toMilliseconds();
 
   waitConnection(timeout);
 
@@ -436,7 +508,7 @@ bool Overlay::incoming(Message &message, const BinaryString &from)
 		{
 			// Read addresses
 			Set<Address> addrs;
-			BinarySerializer(&message.content) >> addrs;
+			BinarySerializer(message.content.data(), message.content.size()) >> addrs;
 
 			// Add known addresses
 			Set<Address> remoteAddresses;
@@ -444,20 +516,22 @@ bool Overlay::incoming(Message &message, const BinaryString &from)
 			addrs.insertAll(remoteAddresses);
 
 			// Send suggest message
-			Message suggest(Message::Suggest);
+			BinaryString payload;
+			BinarySerializer(&payload) << addrs;
+			Message suggest(Message::Suggest, std::move(payload));
 			suggest.ttl = message.ttl;
 			suggest.source = message.source;
-			BinarySerializer(&suggest.content) << addrs;
 
-			BinaryString distance = message.source ^ localNode();
-			Array<BinaryString> neighbors;
+			const Digest source(message.source);
+			const Digest distance = source ^ mLocalId;
+			Array<Digest> neighbors;
 			mHandlers.getKeys(neighbors);
 			for(int i=0; i<neighbors.size(); ++i)
 			{
-				if(message.source != neighbors[i]
-					&& (message.source ^ neighbors[i]) <= distance)
+				if(source != neighbors[i]
+					&& (source ^ neighbors[i]) <= distance)
 				{
-					suggest.destination = neighbors[i];
+					suggest.destination = neighbors[i].toBinary();
 					send(suggest);
 				}
 			}
@@ -473,7 +547,7 @@ bool Overlay::incoming(Message &message, const BinaryString &from)
 				LogDebug("Overlay::Incoming", "Suggest " + message.source.toString());
 
 				Set<Address> addrs;
-				BinarySerializer(&message.content) >> addrs;
+				BinarySerializer(message.content.data(), message.content.size()) >> addrs;
 				connect(addrs, message.source);
 			}
 			break;
@@ -509,7 +583,7 @@ bool Overlay::incoming(Message &message, const BinaryString &from)
 		{
 			// In Store messages, key is in the destination field
 			const BinaryString &key = message.destination;
-			const BinaryString &value = message.content;
+			const BinaryString value = message.content.toBinary();
 
 			//LogDebug("Overlay::Incoming", "Store " + key.toString());
 
@@ -518,32 +592,50 @@ bool Overlay::incoming(Message &message, const BinaryString &from)
 
 			if(now - oldTime >= seconds(60.)) // 1 min
         		{
-				Array<BinaryString> nodes;
-				if(getRoutes(key, StoreNeighbors, nodes))
+				const Digest fromId(from);
+				Array<Digest> nodes;
+				if(getRoutes(Digest(key), StoreNeighbors, nodes))
 				{
 					for(int i=0; i<nodes.size(); ++i)
 					{
-						if(nodes[i] == localNode()) Store::Instance->storeValue(key, value, Store::Distributed, now);
-						else if(nodes[i] != from) sendTo(message, nodes[i]);
+						if(nodes[i] == mLocalId) Store::Instance->storeValue(key, value, Store::Distributed, now);
+						else if(nodes[i] != fromId) sendTo(message, nodes[i]);
 					}
 				}
 			}
 
-			{
-				std::unique_lock<std::mutex> lock(mRetrieveMutex);
-
-				if(mRetrievePending.contains(key))
-				{
-					mRetrievePending.erase(key);
-					lock.unlock();
-					mRetrieveCondition.notify_all();
-				}
-			}
+			notifyRetrieved(key);
 
 			//push(message);	// useless
 			break;
 		}
 
+	// Store batch of values in DHT
+	case Message::StoreBatch:
+		{
+			BinaryString value;
+			Array<BinaryString> keys;
+			if(!ParseBatch(message, keys, value)) return false;
+
+			//LogDebug("Overlay::Incoming", "Store batch (" + String::number(keys.size()) + " keys)");
+
+			storeBatch(keys, value, from);
+			break;
+		}
+
+	// Retrieve batch of values from DHT
+	case Message::RetrieveBatch:
+		{
+			BinaryString value;
+			Array<BinaryString> keys;
+			if(!ParseBatch(message, keys, value)) return false;
+
+			//LogDebug("Overlay::Incoming", "Retrieve batch (" + String::number(keys.size()) + " keys)");
+
+			retrieveBatch(keys, message.source, message.ttl, from);
+			break;
+		}
+
 	// Response to retrieve from DHT
 	case Message::Value:
 		{
@@ -553,21 +645,12 @@ bool Overlay::incoming(Message &message, const BinaryString &from)
 			//LogDebug("Overlay::Incoming", "Value " + key.toString());
 
 			uint64_t ts = 0;
-			BinaryString value = message.content;
-			if(!value.readBinary(ts) || value.empty()) return false;
-
-			Store::Instance->storeValue(key, value, Store::Distributed, Time(ts));
+			Buffer content(message.content);
+			if(!content.readBinary(ts) || content.empty()) return false;
 
-			{
-				std::unique_lock<std::mutex> lock(mRetrieveMutex);
+			Store::Instance->storeValue(key, content.toBinary(), Store::Distributed, Time(ts));
 
-				if(mRetrievePending.contains(key))
-				{
-					mRetrievePending.erase(key);
-					lock.unlock();
-					mRetrieveCondition.notify_all();
-				}
-			}
+			notifyRetrieved(key);
 
 			route(message, from);
 			push(message);
@@ -624,26 +707,14 @@ bool Overlay::route(const Message &message, const BinaryString &from)
 	// Drop if TTL is zero
 	if(message.ttl == 0) return false;
 
-	// Drop if self
-	if(message.destination == localNode()) return false;
-
-	// Drop if not connected
-	if(mHandlers.empty()) return false;
-
-	// Neighbor
-	if(mHandlers.contains(message.destination))
-		return sendTo(message, message.destination);
-
-	Array<BinaryString> neigh;
-	getNeighbors(message.destination, neigh);
-	if(neigh.size() >= 2) neigh.remove(from);
+	// Drop if not a valid identifier
+	if(!message.destination.empty() && message.destination.size() != Digest::Size) return false;
+	if(!from.empty() && from.size() != Digest::Size) return false;
 
-	BinaryString route;
-	for(int i=0; i<neigh.size(); ++i)
-	{
-		route = neigh[i];
-		if(Random().uniformInt()%2 == 0) break;
-	}
+	// Drop if self or not connected
+	Digest route;
+	if(!getRoute(Digest(message.destination), Digest(from), route))
+		return false;
 
 	return sendTo(message, route);
 }
@@ -652,13 +723,14 @@ bool Overlay::broadcast(const Message &message, const BinaryString &from)
 {
 	//LogDebug("Overlay::sendTo", "Broadcasting message");
 
-	Array<BinaryString> neighbors;
+	const Digest fromId(from);
+	Array<Digest> neighbors;
 	mHandlers.getKeys(neighbors);
 
 	bool success = false;
 	for(int i=0; i<neighbors.size(); ++i)
 	{
-		if(!from.empty() && neighbors[i] == from) continue;
+		if(!fromId.empty() && neighbors[i] == fromId) continue;
 
 		sptr<Handler> handler;
 		if(mHandlers.get(neighbors[i], handler))
@@ -670,7 +742,7 @@ bool Overlay::broadcast(const Message &message, const BinaryString &from)
 	return success;
 }
 
-bool Overlay::sendTo(const Message &message, const BinaryString &to)
+bool Overlay::sendTo(const Message &message, const Digest &to)
 {
 	if(to.empty())
 	{
@@ -682,42 +754,75 @@ bool Overlay::sendTo(const Message &message, const BinaryString &to)
 	if(mHandlers.get(to, handler))
 	{
 		//LogDebug("Overlay::sendTo", "Sending message via " + to.toString());
-		handler->send(message);
-		return true;
+		return handler->send(message);	// false on backpressure
 	}
 
 	return false;
 }
 
-int Overlay::getRoutes(const BinaryString &destination, int count, Array<BinaryString> &result)
+bool Overlay::getRoute(const Digest &destination, const Digest &from, Digest &result)
 {
-	result.clear();
+	// Drop if self
+	if(destination == mLocalId) return false;
+
+	// Drop if not connected
+	if(mHandlers.empty()) return false;
+
+	// Neighbor
+	if(mHandlers.contains(destination))
+	{
+		result = destination;
+		return true;
+	}
+
+	Array<Digest> neigh;
+	getNeighbors(destination, neigh);
+	if(neigh.size() >= 2) neigh.remove(from);
+
+	result = Digest::Empty;
+	for(int i=0; i<neigh.size(); ++i)
+	{
+		result = neigh[i];
+		if(Random().uniformInt()%2 == 0) break;
+	}
+
+	return true;
+}
 
-	Map<BinaryString, BinaryString> sorted;
-	Array<BinaryString> neighbors;
+int Overlay::getRoutes(const Digest &destination, int count, Array<Digest> &result)
+{
+	Array<Digest> neighbors;
 
 	{
 		std::unique_lock<std::mutex> lock(mMutex);
 		mHandlers.getKeys(neighbors);
 	}
 
+	return getRoutes(destination, count, neighbors, result);
+}
+
+int Overlay::getRoutes(const Digest &destination, int count, const Array<Digest> &neighbors, Array<Digest> &result)
+{
+	result.clear();
+
+	Map<Digest, Digest> sorted;
 	for(int i=0; i<neighbors.size(); ++i)
 		sorted.insert(destination ^ neighbors[i], neighbors[i]);
 
 	// local node
-	sorted.insert(destination ^ localNode(), localNode());
+	sorted.insert(destination ^ mLocalId, mLocalId);
 
 	sorted.getValues(result);
 	if(count > 0 && result.size() > count) result.resize(count);
 	return result.size();
 }
 
-int Overlay::getNeighbors(const BinaryString &destination, Array<BinaryString> &result)
+int Overlay::getNeighbors(const Digest &destination, Array<Digest> &result)
 {
 	result.clear();
 
-	Map<BinaryString, BinaryString> sorted;
-	Array<BinaryString> neighbors;
+	Map<Digest, Digest> sorted;
+	Array<Digest> neighbors;
 
 	{
 		std::unique_lock<std::mutex> lock(mMutex);
@@ -731,10 +836,197 @@ int Overlay::getNeighbors(const BinaryString &destination, Array<BinaryString> &
 	return result.size();
 }
 
+void Overlay::sendBatch(uint8_t type, const Digest &to, const Set<BinaryString> &keys, const BinaryString &value, const BinaryString &source, uint8_t ttl)
+{
+	// Peers which did not advertise batch support get per-key messages
+	sptr<Handler> handler;
+	bool batchCapable = (!to.empty() && mHandlers.get(to, handler) && handler->isBatchCapable());
+
+	Array<Message> messages;
+	MakeBatch(type, keys, value, batchCapable, messages);
+	for(Message &message : messages)
+	{
+		message.ttl = ttl;
+		message.source = source;
+		sendTo(message, to);
+	}
+}
+
+int Overlay::MakeBatch(uint8_t type, const Set<BinaryString> &keys, const BinaryString &value, bool batchCapable, Array<Message> &result)
+{
+	Assert(type == Message::StoreBatch || type == Message::RetrieveBatch);
+
+	result.clear();
+
+	if(!batchCapable)
+	{
+		for(const BinaryString &key : keys)
+		{
+			if(type == Message::StoreBatch) result.append(Message(Message::Store, BinaryString(value), key));
+			else result.append(Message(Message::Retrieve, "", key));
+		}
+
+		return result.size();
+	}
+
+	// Split keys so each message content stays under MaxBatchSize
+	auto it = keys.begin();
+	while(it != keys.end())
+	{
+		size_t size = sizeof(uint32_t);	// array size
+		if(type == Message::StoreBatch) size+= sizeof(uint32_t) + value.size();
+
+		Array<BinaryString> batch;
+		while(it != keys.end() && (batch.empty() || size + sizeof(uint32_t) + it->size() <= MaxBatchSize))
+		{
+			size+= sizeof(uint32_t) + it->size();
+			batch.append(*it);
+			++it;
+		}
+
+		BinaryString content;
+		BinarySerializer s(&content);
+		if(type == Message::StoreBatch) s << value;
+		s << batch;
+
+		result.append(Message(type, std::move(content)));
+	}
+
+	return result.size();
+}
+
+bool Overlay::ParseBatch(const Message &message, Array<BinaryString> &keys, BinaryString &value)
+{
+	keys.clear();
+	value.clear();
+
+	try {
+		BinarySerializer s(message.content.data(), message.content.size());
+		switch(message.type)
+		{
+		case Message::StoreBatch:
+			if(!(s >> value) || !(s >> keys)) return false;
+			return !value.empty();
+
+		case Message::RetrieveBatch:
+			if(!(s >> keys)) return false;
+			return true;
+
+		default:
+			return false;
+		}
+	}
+	catch(const IOException &e)
+	{
+		return false;	// truncated
+	}
+}
+
+void Overlay::storeBatch(const Array<BinaryString> &keys, const BinaryString &value, const BinaryString &from)
+{
+	Array<Digest> neighbors;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mHandlers.getKeys(neighbors);
+	}
+
+	const Time now = Time::Now();
+	const Digest fromId(from);
+
+	Map<Digest, Set<BinaryString> > batches;
+	for(const BinaryString &key : keys)
+	{
+		Time oldTime = Store::Instance->getValueTime(key, value);
+		if(now - oldTime >= seconds(60.) && key.size() == Digest::Size) // 1 min
+		{
+			Array<Digest> nodes;
+			if(getRoutes(Digest(key), StoreNeighbors, neighbors, nodes))
+			{
+				for(int i=0; i<nodes.size(); ++i)
+				{
+					if(nodes[i] == mLocalId) Store::Instance->storeValue(key, value, Store::Distributed, now);
+					else if(nodes[i] != fromId) batches[nodes[i]].insert(key);
+				}
+			}
+		}
+
+		notifyRetrieved(key);
+	}
+
+	for(const auto &p : batches)
+		sendBatch(Message::StoreBatch, p.first, p.second, value);
+}
+
+void Overlay::retrieveBatch(const Array<BinaryString> &keys, const BinaryString &source, uint8_t ttl, const BinaryString &from)
+{
+	// Forward keys grouped by next hop
+	if(ttl > 0)
+	{
+		const Digest fromId(from);
+		Map<Digest, Set<BinaryString> > batches;
+		for(const BinaryString &key : keys)
+		{
+			Digest route;
+			if(key.size() == Digest::Size && getRoute(Digest(key), fromId, route))
+				batches[route].insert(key);
+		}
+
+		for(const auto &p : batches)
+			sendBatch(Message::RetrieveBatch, p.first, p.second, "", source, ttl);
+	}
+
+	// Answer with local values
+	for(const BinaryString &key : keys)
+	{
+		List<BinaryString> values;
+		List<Time> times;
+		Store::Instance->retrieveValue(key, values, times);
+		while(!values.empty())
+		{
+			Assert(!times.empty());
+			send(Message(Message::Value, BinaryString::number(uint64_t(times.front())) + values.front(), source, key));
+			values.pop_front();
+			times.pop_front();
+		}
+	}
+}
+
+void Overlay::pushValues(const BinaryString &key)
+{
+	BinaryString node(localNode());
+	List<BinaryString> values;
+	List<Time> times;
+	if(Store::Instance->retrieveValue(key, values, times))
+	{
+		while(!values.empty())
+		{
+			Assert(!times.empty());
+			Message message(Message::Value, BinaryString::number(uint64_t(times.front())) + values.front(), node, key);
+			push(message);
+			values.pop_front();
+			times.pop_front();
+		}
+	}
+}
+
+void Overlay::notifyRetrieved(const BinaryString &key)
+{
+	std::unique_lock<std::mutex> lock(mRetrieveMutex);
+
+	if(mRetrievePending.contains(key))
+	{
+		mRetrievePending.erase(key);
+		lock.unlock();
+		mRetrieveCondition.notify_all();
+	}
+}
+
 void Overlay::registerHandler(const BinaryString &node, const Address &addr, sptr<Overlay::Handler> handler)
 {
 	Assert(handler);
 
+	const Digest id(node);	// node is a public key digest
+
 	sptr<Handler> currentHandler;
 	Set<Address>  currentAddrs;
 	bool isFirst = false;
@@ -743,16 +1035,16 @@ void Overlay::registerHandler(const BinaryString &node, const Address &addr, spt
 
 		isFirst = (mHandlers.empty());
 
-		if(mHandlers.get(node, currentHandler))
+		if(mHandlers.get(id, currentHandler))
 		{
-			mHandlers.erase(node);
+			mHandlers.erase(id);
 			LogDebug("Overlay::registerHandler", "Replacing handler for " + node.toString());
 
 			currentHandler->getAddresses(currentAddrs);
 			currentHandler->stop();
 		}
 
-		mHandlers.insert(node, handler);
+		mHandlers.insert(id, handler);
 		handler->addAddresses(currentAddrs);
 		handler->start();
 
@@ -780,10 +1072,11 @@ void Overlay::unregisterHandler(const BinaryString &node, const Set<Address> &ad
 	{
 		std::unique_lock<std::mutex> lock(mMutex);
 
-		if(!mHandlers.get(node, currentHandler) || currentHandler.get() != handler)
+		const Digest id(node);
+		if(!mHandlers.get(id, currentHandler) || currentHandler.get() != handler)
 			return;
 
-		mHandlers.erase(node);
+		mHandlers.erase(id);
 
 		for(auto &a : addrs)
 			mRemoteAddresses.erase(a);
@@ -905,6 +1198,7 @@ bool Overlay::deserialize(Serializer &s)
 	mPublicKey.clear();
 	mPrivateKey.clear();
 	mLocalNode.clear();
+	mLocalId = Digest::Empty;
 
 	Map<Address, BinaryString> peers;
 
@@ -917,6 +1211,7 @@ bool Overlay::deserialize(Serializer &s)
 	// TODO: Sanitize
 
 	mLocalNode = mPublicKey.digest();
+	mLocalId = Digest(mLocalNode);
 	mKnownPeers.insertAll(peers);
 	return true;
 }
@@ -924,7 +1219,7 @@ bool Overlay::deserialize(Serializer &s)
 void Overlay::run(void)
 {
 	try {
-		const int minConnectionsCount = Config::Get("min_connections").toInt();
+		const int minConnectionsCount = int(MinConnections.toInt());
 
 		Set<Address> externalAddrs;
 		Config::GetExternalAddresses(externalAddrs);
@@ -936,7 +1231,7 @@ void Overlay::run(void)
 			{
 				std::unique_lock<std::mutex> lock(mMutex);
 				for(const auto &p : mKnownPeers)
-					if(!mHandlers.contains(p.second))
+					if(p.second.size() != Digest::Size || !mHandlers.contains(Digest(p.second)))
 						peers.insert(p.first, p.second);
 			}
 
@@ -987,7 +1282,7 @@ Overlay::Message::Message(void)
 	clear();
 }
 
-Overlay::Message::Message(uint8_t type, const BinaryString &content, const BinaryString &destination, const BinaryString &source)
+Overlay::Message::Message(uint8_t type, const Buffer &content, const BinaryString &destination, const BinaryString &source)
 {
 	clear();
 
@@ -997,6 +1292,16 @@ Overlay::Message::Message(uint8_t type, const BinaryString &content, const Binar
 	this->content = content;
 }
 
+Overlay::Message::Message(uint8_t type, BinaryString &&content, const BinaryString &destination, const BinaryString &source)
+{
+	clear();
+
+	this->type = type;
+	this->source = source;
+	this->destination = destination;
+	if(!content.empty()) this->content = Buffer(std::move(content));
+}
+
 Overlay::Message::~Message(void)
 {
 
@@ -1014,6 +1319,33 @@ void Overlay::Message::clear(void)
 	content.clear();
 }
 
+size_t Overlay::Message::size(void) const
+{
+	return 8 + source.size() + destination.size() + content.size();	// 64-bit header
+}
+
+Overlay::TrafficClass Overlay::Message::trafficClass(void) const
+{
+	switch(type)
+	{
+	case Retrieve:
+	case Store:
+	case Value:
+	case StoreBatch:
+	case RetrieveBatch:
+		return DhtClass;
+
+	case Tunnel:
+		return TunnelClass;
+
+	case Data:
+		return DataClass;
+
+	default:
+		return ControlClass;
+	}
+}
+
 Overlay::Backend::Backend(Overlay *overlay) :
 	mOverlay(overlay)
 {
@@ -1048,7 +1380,7 @@ bool Overlay::Backend::handshake(SecureTransport *transport, const Address &addr
 	transport->setVerifier(&verifier);
 
 	// Set timeout
-	transport->setHandshakeTimeout(milliseconds(Config::Get("connect_timeout").toInt()));
+	transport->setHandshakeTimeout(ConnectTimeout.toMilliseconds());
 
 	// Do handshake
 	transport->handshake();
@@ -1118,8 +1450,8 @@ Overlay::StreamBackend::~StreamBackend(void)
 
 bool Overlay::StreamBackend::connect(const Address &addr, const BinaryString &remote)
 {
-	const duration timeout = milliseconds(Config::Get("idle_timeout").toDouble());
-	const duration connectTimeout = milliseconds(Config::Get("connect_timeout").toDouble());
+	const duration timeout = IdleTimeout.toMilliseconds();
+	const duration connectTimeout = ConnectTimeout.toMilliseconds();
 
 	try {
 		Set<Address> localAddrs;
@@ -1127,7 +1459,7 @@ bool Overlay::StreamBackend::connect(const Address &addr, const BinaryString &re
 		if(localAddrs.contains(addr))
 			return false;
 
-		if(Config::Get("force_http_tunnel").toBool())
+		if(ForceHttpTunnel.toBool())
 			return connectHttp(addr, remote);
 
 		LogDebug("Overlay::StreamBackend::connect", "Trying address " + addr.toString() + " (TCP)");
@@ -1189,7 +1521,7 @@ bool Overlay::StreamBackend::connect(const Address &addr, const BinaryString &re
 
 bool Overlay::StreamBackend::connectHttp(const Address &addr, const BinaryString &remote)
 {
-	const duration connectTimeout = milliseconds(Config::Get("connect_timeout").toDouble());
+	const duration connectTimeout = ConnectTimeout.toMilliseconds();
 
 	LogDebug("Overlay::StreamBackend::connectHttp", "Trying address " + addr.toString() + " (HTTP)");
 
@@ -1217,8 +1549,8 @@ bool Overlay::StreamBackend::connectHttp(const Address &addr, const BinaryString
 
 SecureTransport *Overlay::StreamBackend::listen(Address *addr)
 {
-	const duration timeout = milliseconds(Config::Get("idle_timeout").toDouble());
-	const duration dataTimeout = milliseconds(Config::Get("connect_timeout").toDouble());
+	const duration timeout = IdleTimeout.toMilliseconds();
+	const duration dataTimeout = ConnectTimeout.toMilliseconds();
 
 	while(true)
 	{
@@ -1289,7 +1621,7 @@ Overlay::DatagramBackend::~DatagramBackend(void)
 
 bool Overlay::DatagramBackend::connect(const Address &addr, const BinaryString &remote)
 {
-	const duration timeout = milliseconds(Config::Get("idle_timeout").toDouble());
+	const duration timeout = IdleTimeout.toMilliseconds();
 	const unsigned int mtu = 1452; // UDP over IPv6 on ethernet
 
 	try {
@@ -1298,7 +1630,7 @@ bool Overlay::DatagramBackend::connect(const Address &addr, const BinaryString &
 		if(localAddrs.contains(addr))
 			return false;
 
-		if(Config::Get("force_http_tunnel").toBool())
+		if(ForceHttpTunnel.toBool())
 			return false;
 
 		LogDebug("Overlay::DatagramBackend::connect", "Trying address " + addr.toString() + " (UDP)");
@@ -1344,7 +1676,7 @@ bool Overlay::DatagramBackend::connect(const Address &addr, const BinaryString &
 
 SecureTransport *Overlay::DatagramBackend::listen(Address *addr)
 {
-	const duration timeout = milliseconds(Config::Get("idle_timeout").toDouble());
+	const duration timeout = IdleTimeout.toMilliseconds();
 	const unsigned int mtu = 1452; // UDP over IPv6 on ethernet
 
 	while(true)
@@ -1369,6 +1701,7 @@ Overlay::Handler::Handler(Overlay *overlay, Stream *stream, const BinaryString &
 	mStream(stream),
 	mNode(node),
 	mStop(false),
+	mBatchCapable(false),
 	mSender(overlay, stream)
 {
 	if(node == mOverlay->localNode())
@@ -1420,12 +1753,24 @@ bool Overlay::Handler::recv(Message &message)
 			message.content.clear();
 			AssertIO(mStream->readBinary(message.source, sourceSize) == sourceSize);
 			AssertIO(mStream->readBinary(message.destination, destinationSize) == destinationSize);
-			AssertIO(mStream->readBinary(message.content, contentSize) == contentSize);
+
+			// Read content directly into its shared buffer
+			BinaryString content(contentSize, '\0');
+			if(contentSize) AssertIO(mStream->readBinary(content.ptr(), contentSize) == contentSize);
+			message.content = Buffer(std::move(content));
 
 			mStream->nextRead();	// switch to next datagram if this is a datagram stream
 
+			// Capabilities are advertised by the neighbor on every message
+			if(message.flags & Message::BatchFlag) mBatchCapable = true;
+			message.flags&= ~Message::BatchFlag;
+
 			if(message.source.empty())	continue;
 			if(message.ttl == 0)		continue;
+
+			// Identifiers are converted to digests for routing
+			if(message.source.size() != Digest::Size) continue;
+			if(!message.destination.empty() && message.destination.size() != Digest::Size) continue;
 			--message.ttl;
 
 			if(message.destination == node())
@@ -1470,14 +1815,20 @@ void Overlay::Handler::start(void)
 	{
 		mSender.run();
 	});
+
+	// Advertise capabilities right away
+	mSender.push(Message(Message::Dummy));
 }
 
 void Overlay::Handler::stop(void)
 {
-	std::unique_lock<std::mutex> lock(mMutex);
-	mStop = true;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+
+	// The stream is only shut down here, it is closed on destruction once threads are joined
 	mSender.stop();
-	mStream->close();
 }
 
 void Overlay::Handler::addAddress(const Address &addr)
@@ -1504,6 +1855,16 @@ BinaryString Overlay::Handler::node(void) const
 	return mNode;
 }
 
+void Overlay::Handler::getQueueDepths(Array<size_t> &depths) const
+{
+	mSender.getQueueDepths(depths);
+}
+
+bool Overlay::Handler::isBatchCapable(void) const
+{
+	return mBatchCapable;
+}
+
 void Overlay::Handler::run(void)
 {
 	LogDebug("Overlay::Handler::run", "Starting handler");
@@ -1527,16 +1888,24 @@ void Overlay::Handler::process(void)
 	while(recv(message) && !mStop)
 	{
 		//LogDebug("Overlay::Handler", "Received message");
-		mOverlay->incoming(message, mNode);
+		try {
+			mOverlay->incoming(message, mNode);
+		}
+		catch(const InvalidData &e)
+		{
+			LogDebug("Overlay::Handler", String("Dropping invalid message: ") + e.what());
+		}
 	}
 }
 
 Overlay::Handler::Sender::Sender(Overlay *overlay, Stream *stream) :
 	mOverlay(overlay),
 	mStream(stream),
+	mCurrentClass(1),
 	mStop(false)
 {
-
+	std::fill(mQueueBytes, mQueueBytes + TrafficClasses, 0);
+	std::fill(mDeficits, mDeficits + TrafficClasses, 0);
 }
 
 Overlay::Handler::Sender::~Sender(void)
@@ -1546,11 +1915,15 @@ Overlay::Handler::Sender::~Sender(void)
 
 bool Overlay::Handler::Sender::push(const Message &message)
 {
+	const TrafficClass c = message.trafficClass();
+	const size_t size = message.size();
+
 	std::unique_lock<std::mutex> lock(mMutex);
 
-	if(mQueue.size() < Overlay::MaxQueueSize)
+	if(mQueues[c].empty() || mQueueBytes[c] + size <= Overlay::MaxQueueBytes[c])
 	{
-		mQueue.push(message);
+		mQueues[c].push(message);
+		mQueueBytes[c]+= size;
 		lock.unlock();
 		mCondition.notify_all();
 		return true;
@@ -1567,6 +1940,10 @@ void Overlay::Handler::Sender::stop(void)
 	}
 
 	mCondition.notify_all();
+
+	// Shutting down makes a pending write fail, then wait for it to return
+	mStream->shutdown();
+	std::unique_lock<std::mutex> sendLock(mSendMutex);
 }
 
 void Overlay::Handler::Sender::run(void)
@@ -1576,25 +1953,29 @@ void Overlay::Handler::Sender::run(void)
 	try {
 		while(!mStop)
 		{
-			const duration timeout = milliseconds(Config::Get("keepalive_timeout").toDouble());
+			const duration timeout = KeepaliveTimeout.toMilliseconds();
 
-			if(mQueue.empty())
+			if(empty())
 			{
 				mCondition.wait_for(lock, timeout, [this]() {
-					return !mQueue.empty() || mStop;
+					return !empty() || mStop;
 				});
 			}
 
 			if(mStop) break;
 
-			if(!mQueue.empty())
+			Message message;
+			if(!pop(message))
+				message = Message(Message::Dummy);
+
+			// Do not block producers while writing
+			lock.unlock();
 			{
-				send(mQueue.front());
-				mQueue.pop();
-			}
-			else {
-				send(Message(Message::Dummy));
+				std::unique_lock<std::mutex> sendLock(mSendMutex);
+				if(mStop) break;
+				send(message);
 			}
+			lock.lock();
 		}
 	}
 	catch(std::exception &e)
@@ -1604,6 +1985,66 @@ void Overlay::Handler::Sender::run(void)
 	}
 }
 
+void Overlay::Handler::Sender::getQueueDepths(Array<size_t> &depths) const
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	depths.assign(mQueueBytes, mQueueBytes + TrafficClasses);
+}
+
+bool Overlay::Handler::Sender::pop(Message &message)
+{
+	// Must be called with mMutex locked
+
+	int c;
+	if(!mQueues[ControlClass].empty())
+	{
+		// Strict priority for control
+		c = ControlClass;
+	}
+	else {
+		if(empty()) return false;
+
+		// Deficit round robin on other classes
+		while(true)
+		{
+			c = mCurrentClass;
+			if(!mQueues[c].empty())
+			{
+				const size_t size = mQueues[c].front().size();
+				if(mDeficits[c] >= size)
+				{
+					mDeficits[c]-= size;
+					break;
+				}
+
+				mDeficits[c]+= Overlay::QueueQuantum[c];
+			}
+			else {
+				mDeficits[c] = 0;
+			}
+
+			mCurrentClass = 1 + mCurrentClass % (TrafficClasses - 1);
+		}
+	}
+
+	message = mQueues[c].front();
+	mQueues[c].pop();
+	mQueueBytes[c]-= std::min(mQueueBytes[c], message.size());
+	if(mQueues[c].empty()) mDeficits[c] = 0;
+	return true;
+}
+
+bool Overlay::Handler::Sender::empty(void) const
+{
+	// Must be called with mMutex locked
+
+	for(int c = 0; c < TrafficClasses; ++c)
+		if(!mQueues[c].empty())
+			return false;
+
+	return true;
+}
+
 void Overlay::Handler::Sender::send(const Message &message)
 {
 	BinaryString source = message.source;
@@ -1615,7 +2056,7 @@ void Overlay::Handler::Sender::send(const Message &message)
 
 	// 32-bit control block
 	s << message.version;
-	s << message.flags;
+	s << uint8_t(message.flags | Message::BatchFlag);
 	s << message.ttl;
 	s << message.type;
 
@@ -1629,7 +2070,7 @@ void Overlay::Handler::Sender::send(const Message &message)
 	// data
 	mStream->writeBinary(source);
 	mStream->writeBinary(message.destination);
-	mStream->writeBinary(message.content);
+	if(!message.content.empty()) mStream->writeBinary(message.content.data(), message.content.size());
 
 	mStream->nextWrite();	// switch to next datagram if this is a datagram stream
 }
@@ -27,7 +27,9 @@
 #include "pla/address.hpp"
 #include "pla/stream.hpp"
 #include "pla/bytearray.hpp"
+#include "pla/buffer.hpp"
 #include "pla/binarystring.hpp"
+#include "pla/digest.hpp"
 #include "pla/string.hpp"
 #include "pla/socket.hpp"
 #include "pla/serversocket.hpp"
@@ -38,10 +40,13 @@
 #include "pla/serializable.hpp"
 #include "pla/object.hpp"
 #include "pla/map.hpp"
+#include "pla/hashmap.hpp"
 #include "pla/set.hpp"
 #include "pla/array.hpp"
 #include "pla/http.hpp"
 
+#include <atomic>
+
 namespace tpn
 {
 
@@ -49,9 +54,22 @@ namespace tpn
 class Overlay : public Serializable
 {
 public:
-	static const int MaxQueueSize;
 	static const int StoreNeighbors;
 	static const int DefaultTtl;
+	static const size_t MaxBatchSize;
+
+	// Traffic classes for send queues, by decreasing priority
+	enum TrafficClass
+	{
+		ControlClass = 0,	// strict priority
+		DhtClass     = 1,
+		TunnelClass  = 2,
+		DataClass    = 3
+	};
+
+	static const int TrafficClasses = 4;
+	static const size_t MaxQueueBytes[TrafficClasses];	// per-connection limit
+	static const size_t QueueQuantum[TrafficClasses];	// weight for fair queueing
 
 	struct Message
 	{
@@ -62,6 +80,8 @@ public:
 		static const uint8_t Retrieve   = 0x03;
 		static const uint8_t Store	= 0x04;
 		static const uint8_t Value	= 0x05;
+		static const uint8_t StoreBatch	= 0x06;
+		static const uint8_t RetrieveBatch = 0x07;
 
 		// Routable messages
 		static const uint8_t Call	= 0x80|0x01;
@@ -70,14 +90,23 @@ public:
 		static const uint8_t Ping	= 0x80|0x04;
 		static const uint8_t Pong	= 0x80|0x05;
 
+		// Hop-by-hop flags
+		static const uint8_t BatchFlag	= 0x01;	// sender accepts StoreBatch and RetrieveBatch
+
 		Message(void);
 		Message(uint8_t type,
-			const BinaryString &content = "",
+			const Buffer &content,
+			const BinaryString &destination = "",
+			const BinaryString &source = "");
+		Message(uint8_t type,
+			BinaryString &&content = "",
 			const BinaryString &destination = "",
 			const BinaryString &source = "");
 		~Message(void);
 
 		void clear(void);
+		size_t size(void) const;		// size on the wire
+		TrafficClass trafficClass(void) const;
 
 		// Fields
 		uint8_t version;
@@ -86,7 +115,7 @@ public:
 		uint8_t type;
 		BinaryString source;
 		BinaryString destination;
-		BinaryString content;
+		Buffer content;		// shared between copies, read with a cursor
 	};
 
 	Overlay(int port);
@@ -116,6 +145,7 @@ public:
 	bool waitConnection(void) const;
 	bool waitConnection(duration timeout) const;
 	int connectionsCount(void) const;
+	void getQueueDepths(Map<BinaryString, Array<size_t> > &result) const;	// queued bytes per traffic class, by neighbor
 
 	// Message interface
 	bool recv(Message &message, duration timeout);
@@ -123,22 +153,37 @@ public:
 
 	// DHT
 	void store(const BinaryString &key, const BinaryString &value);
+	void store(const Set<BinaryString> &keys, const BinaryString &value);	// batched
 	void retrieve(const BinaryString &key);					// async
+	void retrieve(const Set<BinaryString> &keys);				// async, batched
 	bool retrieve(const BinaryString &key, Set<BinaryString> &values);	// sync
 	bool retrieve(const BinaryString &key, Set<BinaryString> &values, duration timeout);
 
 	void serialize(Serializer &s) const;
 	bool deserialize(Serializer &s);
 
+	// Batch encoding, falls back to per-key Store or Retrieve messages if the peer can't batch
+	static int MakeBatch(uint8_t type, const Set<BinaryString> &keys, const BinaryString &value, bool batchCapable, Array<Message> &result);
+	static bool ParseBatch(const Message &message, Array<BinaryString> &keys, BinaryString &value);
+
 private:
 	// Routing
 	bool incoming(Message &message, const BinaryString &from);
 	bool push(Message &message);
 	bool route(const Message &message, const BinaryString &from = "");
 	bool broadcast(const Message &message, const BinaryString &from = "");
-	bool sendTo(const Message &message, const BinaryString &to);
-	int getRoutes(const BinaryString &destination, int count, Array<BinaryString> &result);
-	int getNeighbors(const BinaryString &destination, Array<BinaryString> &result);
+	bool sendTo(const Message &message, const Digest &to);
+	bool getRoute(const Digest &destination, const Digest &from, Digest &result);
+	int getRoutes(const Digest &destination, int count, Array<Digest> &result);
+	int getRoutes(const Digest &destination, int count, const Array<Digest> &neighbors, Array<Digest> &result);
+	int getNeighbors(const Digest &destination, Array<Digest> &result);
+
+	// Batching
+	void sendBatch(uint8_t type, const Digest &to, const Set<BinaryString> &keys, const BinaryString &value = "", const BinaryString &source = "", uint8_t ttl = DefaultTtl);
+	void storeBatch(const Array<BinaryString> &keys, const BinaryString &value, const BinaryString &from);
+	void retrieveBatch(const Array<BinaryString> &keys, const BinaryString &source, uint8_t ttl, const BinaryString &from);
+	void pushValues(const BinaryString &key);
+	void notifyRetrieved(const BinaryString &key);
 
 	void run(void);
 
@@ -207,6 +252,8 @@ private:
 		void addAddresses(const Set<Address> &addrs);
 		void getAddresses(Set<Address> &set) const;
 		BinaryString node(void) const;
+		void getQueueDepths(Array<size_t> &depths) const;
+		bool isBatchCapable(void) const;	// true once the peer advertised batch support
 
 	private:
 		void run(void);
@@ -217,6 +264,7 @@ private:
 		BinaryString mNode;
 		Set<Address> mAddrs;
 		bool mStop;
+		std::atomic<bool> mBatchCapable;
 
 		mutable std::mutex mMutex;
 
@@ -229,20 +277,27 @@ private:
 			Sender(Overlay *overlay, Stream *stream);
 			~Sender(void);
 
-			bool push(const Message &message);
+			bool push(const Message &message);	// false if the queue is full
 			void stop(void);
 
 			void run(void);
+			void getQueueDepths(Array<size_t> &depths) const;
 
 		private:
+			bool pop(Message &message);
+			bool empty(void) const;
 			void send(const Message &message);
 
 			Overlay *mOverlay;
 			Stream *mStream;
-			Queue<Message> mQueue;
+			Queue<Message> mQueues[TrafficClasses];
+			size_t mQueueBytes[TrafficClasses];
+			size_t mDeficits[TrafficClasses];
+			int mCurrentClass;
 			bool mStop;
 
 			mutable std::mutex mMutex;
+			mutable std::mutex mSendMutex;
 			mutable std::condition_variable mCondition;
 		};
 
@@ -261,10 +316,11 @@ private:
 	Rsa::PublicKey	mPublicKey;
 	Rsa::PrivateKey	mPrivateKey;
 	BinaryString mLocalNode;
+	Digest mLocalId;	// mLocalNode as a fixed-size value for routing
 	sptr<SecureTransport::Certificate> mCertificate;
 
 	List<sptr<Backend> > mBackends;
-	Map<BinaryString, sptr<Handler> > mHandlers;
+	HashMap<Digest, sptr<Handler> > mHandlers;
 	Set<Address> mRemoteAddresses, mLocalAddresses;
 	Map<Address, BinaryString> mKnownPeers;
 
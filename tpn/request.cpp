@@ -21,6 +21,7 @@
 
 #include "tpn/request.hpp"
 #include "tpn/config.hpp"
+#include "tpn/cache.hpp"
 
 #include "pla/jsonserializer.hpp"
 #include "pla/mime.hpp"
@@ -28,10 +29,15 @@
 namespace tpn
 {
 
+static const Config::Value RequestTimeout("request_timeout");
+
 Request::Request(Resource &resource) :
+	mResultsCount(0),
 	mListDirectories(true),
 	mFinished(false),
 	mFinishedAfterTarget(false),
+	mFinishRequested(false),
+	mPendingListings(0),
 	mAutoDeleteTimeout(-1.)
 {
 	mUrlPrefix = "/request/" + String::random(32);
@@ -41,9 +47,12 @@ Request::Request(Resource &resource) :
 
 Request::Request(const String &path, bool listDirectories) :
 	mPath(path),
+	mResultsCount(0),
 	mListDirectories(listDirectories),
 	mFinished(false),
 	mFinishedAfterTarget(false),
+	mFinishRequested(false),
+	mPendingListings(0),
 	mAutoDeleteTimeout(-1.)
 {
 	mUrlPrefix = "/request/" + String::random(32);
@@ -54,9 +63,12 @@ Request::Request(const String &path, bool listDirectories) :
 Request::Request(const String &path, const Identifier &local, const Identifier &remote, bool listDirectories) :
 	Subscriber(Network::Link(local, remote)),
 	mPath(path),
+	mResultsCount(0),
 	mListDirectories(listDirectories),
 	mFinished(false),
 	mFinishedAfterTarget(false),
+	mFinishRequested(false),
+	mPendingListings(0),
 	mAutoDeleteTimeout(-1.)
 {
 	mUrlPrefix = "/request/" + String::random(32);
@@ -67,9 +79,12 @@ Request::Request(const String &path, const Identifier &local, const Identifier &
 Request::Request(const String &path, const Network::Link &link, bool listDirectories) :
 	Subscriber(link),
 	mPath(path),
+	mResultsCount(0),
 	mListDirectories(listDirectories),
 	mFinished(false),
 	mFinishedAfterTarget(false),
+	mFinishRequested(false),
+	mPendingListings(0),
 	mAutoDeleteTimeout(-1.)
 {
 	mUrlPrefix = "/request/" + String::random(32);
@@ -79,6 +94,15 @@ Request::Request(const String &path, const Network::Link &link, bool listDirecto
 
 Request::~Request(void)
 {
+	// Wait for pending index builds
+	sptr<ThreadPool> pool;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		pool = mIndexPool;
+	}
+
+	if(pool) pool->join();
+
 	Interface::Instance->remove(mUrlPrefix, this);
 	unsubscribeAll();
 
@@ -92,6 +116,10 @@ Request::~Request(void)
 	mCondition.notify_all();
 	std::this_thread::sleep_for(seconds(1.));	// TODO
 	std::unique_lock<std::mutex> lock(mMutex);
+
+	// Nobody is looking at the results anymore
+	for(const BinaryString &digest : mPrefetched)
+		Cache::Instance->cancel(digest);
 }
 
 bool Request::addTarget(const BinaryString &target, bool finished)
@@ -116,18 +144,42 @@ String Request::urlPrefix(void) const
 int Request::resultsCount(void) const
 {
 	std::unique_lock<std::mutex> lock(mMutex);
-	return int(mResults.size());
+	return mResultsCount;
 }
 
 void Request::addResult(Resource &resource, bool finish)
 {
 	if(resource.isDirectory() && mListDirectories)
 	{
-		// List directory and add records
-		Resource::Reader reader(&resource);
-		Resource::DirectoryRecord record;
-		while(reader.readDirectory(record))
-			addResult(record);
+		// Map directory listing instead of copying records
+		if(Resource::DirectoryIndex::IsCached(resource.digest()))
+		{
+			addListing(std::make_shared<Resource::DirectoryIndex>(&resource));
+		}
+		else {
+			// Indexing a large directory takes a while, build it in the background
+			std::unique_lock<std::mutex> lock(mMutex);
+			if(!mIndexPool) mIndexPool = std::make_shared<ThreadPool>(1);
+			++mPendingListings;
+			mFinishRequested|= finish;
+
+			Resource copy(resource);
+			mIndexPool->enqueue([this, copy]() mutable
+			{
+				try {
+					addListing(std::make_shared<Resource::DirectoryIndex>(&copy));
+				}
+				catch(const std::exception &e)
+				{
+					LogWarn("Request", "Unable to list directory " + copy.digest().toString() + ": " + e.what());
+				}
+
+				std::unique_lock<std::mutex> lock(mMutex);
+				--mPendingListings;
+				if(mFinishRequested) finishUnlocked();
+			});
+			return;
+		}
 	}
 	else {
 		// Do not list, just add corresponding record
@@ -137,7 +189,17 @@ void Request::addResult(Resource &resource, bool finish)
 	if(finish)
 	{
 		std::unique_lock<std::mutex> lock(mMutex);
+		finishUnlocked();
+	}
+}
+
+void Request::finishUnlocked(void)
+{
+	mFinishRequested = true;
+	if(mPendingListings == 0)
+	{
 		mFinished = true;
+		mCondition.notify_all();
 	}
 }
 
@@ -145,12 +207,20 @@ void Request::addResult(const Resource::DirectoryRecord &record)
 {
 	std::unique_lock<std::mutex> lock(mMutex);
 
-	if(!mDigests.contains(record.digest))
+	if(!containsResult(record.digest))
 	{
 		LogDebug("Request", "Adding result: " + record.digest.toString() + " (" + record.name + ")");
 
-		mResults.append(record);
+		if(mSegments.empty() || mSegments.back().listing)
+		{
+			Segment segment;
+			segment.first = mResultsCount;
+			mSegments.push_back(std::move(segment));
+		}
+
+		mSegments.back().records.append(record);
 		mDigests.insert(record.digest);
+		++mResultsCount;
 		lock.unlock();
 		mCondition.notify_all();
 	}
@@ -159,8 +229,7 @@ void Request::addResult(const Resource::DirectoryRecord &record)
 void Request::getResult(int i, Resource::DirectoryRecord &record) const
 {
 	std::unique_lock<std::mutex> lock(mMutex);
-	Assert(i < resultsCount());
-	record = mResults.at(i);
+	getResultUnlocked(i, record);
 }
 
 void Request::autoDelete(duration timeout)
@@ -179,16 +248,17 @@ void Request::http(const String &prefix, Http::Request &request)
 	if(request.get.contains("next"))
 		request.get["next"].extract(next);
 
-	duration timeout = milliseconds(Config::Get("request_timeout").toDouble());
+	duration timeout = RequestTimeout.toMilliseconds();
 	if(request.get.contains("timeout"))
 		timeout = milliseconds(request.get["timeout"].toDouble());
 
-	if(int(mResults.size()) <= next && !mFinished)
+	next = std::max(next, 0);
+	if(mResultsCount <= next && !mFinished)
 	{
 		mAutoDeleter.cancel();
 
 		mCondition.wait_for(lock, timeout, [this, next]() {
-			return int(mResults.size()) > next || mFinished;
+			return mResultsCount > next || mFinished;
 		});
 	}
 
@@ -224,15 +294,118 @@ void Request::http(const String &prefix, Http::Request &request)
 		response.headers["Content-Type"] = "application/json";
 		response.send();
 
-		std::list<Resource::DirectoryRecord*> tmp;
-		if(int(mResults.size()) > next)
-			for(int i = next; i < int(mResults.size()); ++i)
-				tmp.push_back(&mResults[i]);
+		int count = mResultsCount - next;
+		if(request.get.contains("count"))
+			request.get["count"].extract(count);
+
+		count = std::max(std::min(count, mResultsCount - next), 0);
+
+		// Records are copied into the reused page buffer and serialized page by page,
+		// so memory stays bounded whatever the number of results
+		Array<BinaryString> targets;
+		response.stream->writeData("[", 1);
+		for(int first = 0; first < count; first+= PageSize)
+		{
+			int size = std::min(count - first, PageSize);
+			mPage.resize(size);
+			for(int i = 0; i < size; ++i)
+				getResultUnlocked(next + first + i, mPage[i]);
+
+			JsonSerializer serializer(response.stream);
+			for(int i = 0; i < size; ++i)
+			{
+				if(first + i > 0) response.stream->writeData(",", 1);
+				serializer << mPage[i];
+			}
+
+			// The first results are displayed, prefetch their index and first block only
+			for(int i = 0; i < size && int(targets.size()) < PrefetchCount; ++i)
+			{
+				if(!mPage[i].digest.empty() && !mPrefetched.contains(mPage[i].digest))
+				{
+					targets.append(mPage[i].digest);
+					mPrefetched.insert(mPage[i].digest);
+				}
+			}
+		}
+		response.stream->writeData("]\n", 2);
+
+		lock.unlock();
 
-		JsonSerializer(response.stream) << tmp;
+		for(const BinaryString &target : targets)
+			Cache::Instance->prefetch(target, Cache::Speculative, PrefetchBlocks);
 	}
 }
 
+void Request::addListing(sptr<Resource::DirectoryIndex> listing)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	Segment segment;
+	segment.first = mResultsCount;
+	segment.listing = listing;
+
+	// Entries are only filtered if some could be duplicates
+	if(mResultsCount > 0 || listing->uniqueCount() < listing->count())
+	{
+		for(size_t i = 0; i < listing->count(); ++i)
+		{
+			StringView digest = listing->recordDigest(i);
+			if(listing->findDigest(digest) == i && !containsResult(digest))
+				segment.entries.push_back(uint32_t(i));
+		}
+
+		if(segment.entries.empty()) return;
+		if(segment.entries.size() == listing->count()) segment.entries.clear();	// all kept
+	}
+	else if(listing->count() == 0) return;
+
+	LogDebug("Request", "Adding " + String::number(segment.count()) + " results from listing " + listing->digest().toString());
+
+	mResultsCount+= segment.count();
+	mSegments.push_back(std::move(segment));
+	lock.unlock();
+	mCondition.notify_all();
+}
+
+void Request::getResultUnlocked(int i, Resource::DirectoryRecord &record) const
+{
+	Assert(i >= 0 && i < mResultsCount);
+
+	// Find the last segment starting before i
+	auto it = std::upper_bound(mSegments.begin(), mSegments.end(), i, [](int i, const Segment &segment) {
+		return i < segment.first;
+	});
+
+	--it;
+	it->get(i - it->first, record);
+}
+
+bool Request::containsResult(const StringView &digest) const
+{
+	if(mDigests.contains(digest))
+		return true;
+
+	// Entries filtered out of a listing are duplicates of kept results
+	for(const Segment &segment : mSegments)
+		if(segment.listing && segment.listing->contains(digest))
+			return true;
+
+	return false;
+}
+
+int Request::Segment::count(void) const
+{
+	if(!listing) return int(records.size());
+	return entries.empty() ? int(listing->count()) : int(entries.size());
+}
+
+void Request::Segment::get(int i, Resource::DirectoryRecord &record) const
+{
+	if(!listing) record = records.at(i);
+	else listing->get(entries.empty() ? size_t(i) : size_t(entries.at(i)), record);
+}
+
 bool Request::incoming(const Network::Link &link, const String &prefix, const String &path, const BinaryString &target)
 {
 	// Ignore subdirectories
@@ -257,9 +430,10 @@ void Request::createPlaylist(Stream *output, String host, int start, int stop)
 		host = String("localhost:") + Config::Get("interface_port");
 
 	output->writeLine("#EXTM3U");
-	for(int i = 0; i < int(mResults.size()); ++i)
+	Resource::DirectoryRecord record;
+	for(int i = 0; i < mResultsCount; ++i)
 	{
-		const Resource::DirectoryRecord &record = mResults[i];
+		getResultUnlocked(i, record);
 		if(record.type == "directory" || record.digest.empty()) continue;
 		if(!Mime::IsAudio(record.name) && !Mime::IsVideo(record.name)) continue;
 		String link = "http://" + host + "/file/" + record.digest.toString();
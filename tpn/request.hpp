@@ -28,7 +28,9 @@
 #include "tpn/resource.hpp"
 
 #include "pla/binarystring.hpp"
+#include "pla/hashset.hpp"
 #include "pla/alarm.hpp"
+#include "pla/threadpool.hpp"
 
 namespace tpn
 {
@@ -64,12 +66,39 @@ protected:
 private:
 	static int timeParamToSeconds(String param);
 
+	// Results are runs of single records or mapped directory listings, in insertion order
+	struct Segment
+	{
+		int first;					// index of the first result
+		sptr<Resource::DirectoryIndex> listing;
+		std::vector<uint32_t> entries;			// listing entries kept, all if empty
+		Array<Resource::DirectoryRecord> records;	// single records if no listing
+
+		int count(void) const;
+		void get(int i, Resource::DirectoryRecord &record) const;
+	};
+
+	void addListing(sptr<Resource::DirectoryIndex> listing);
+	void finishUnlocked(void);	// mMutex must be locked
+	void getResultUnlocked(int i, Resource::DirectoryRecord &record) const;	// mMutex must be locked
+	bool containsResult(const StringView &digest) const;	// mMutex must be locked
+
+	static const int PageSize = 1000;	// results serialized at once in JSON responses
+	static const int PrefetchCount = 16;	// results of each JSON response prefetched
+	static const int PrefetchBlocks = 1;	// data blocks prefetched per result after the index
+
 	String mPath;
 	String mUrlPrefix;
-	Array<Resource::DirectoryRecord> mResults;	// We don't store resources but durectory records (see addResult)
-	Set<BinaryString> mDigests;
+	std::vector<Segment> mSegments;	// We don't store resources but directory records (see addResult)
+	int mResultsCount;
+	HashSet<BinaryString> mDigests;	// digests of single records
+	std::vector<Resource::DirectoryRecord> mPage;	// reused between JSON responses
+	Set<BinaryString> mPrefetched;	// cancelled on deletion
 	bool mListDirectories;
 	bool mFinished, mFinishedAfterTarget;
+	bool mFinishRequested;		// finished once pending listings are added
+	int mPendingListings;		// directory indexes being built
+	sptr<ThreadPool> mIndexPool;	// builds uncached directory indexes, created on demand
 	duration mAutoDeleteTimeout;
 	Alarm mAutoDeleter;
 
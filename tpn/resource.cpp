@@ -23,6 +23,7 @@
 #include "tpn/cache.hpp"
 #include "tpn/store.hpp"
 #include "tpn/config.hpp"
+#include "tpn/chunker.hpp"
 
 #include "pla/binaryserializer.hpp"
 #include "pla/object.hpp"
@@ -31,6 +32,9 @@
 namespace tpn
 {
 
+static const Config::Value ContentDefinedChunking("content_defined_chunking");
+static const Config::Value ReadAheadBlocks("read_ahead_blocks");
+
 Resource::Resource(void) :
 	mIndexBlock(NULL),
 	mIndexRecord(NULL),
@@ -118,40 +122,68 @@ void Resource::process(const String &filename, const String &name, const String
 	mIndexRecord->salt = salt;
 	mIndexRecord->blockDigests.reserve(size/Block::Size);
 
-	// Process blocks
-	File file(filename, File::Read);
-	BinaryString blockDigest;
-
+	BinaryString key;
 	if(!secret.empty())
-	{
-		BinaryString key;
 		Sha256().pbkdf2_hmac(secret, salt, key, 32, 100000);
 
-		uint64_t i = 0;
-		while(true)
+	// Blocks are cut at fixed offsets, or at content-defined boundaries if enabled
+	sptr<File> chunkedFile;
+	sptr<Chunker> chunker;
+	if(ContentDefinedChunking.toBool())
+	{
+		chunkedFile = std::make_shared<File>(filename, File::Read);
+		chunker = std::make_shared<Chunker>(chunkedFile.get());
+	}
+
+	// Process blocks in parallel, registration is done in order and in batches
+	const size_t maxPending = 2*ProcessThreads();
+
+	Queue<std::pair<int64_t, std::future<Store::BlockLocation> > > pending;	// expected block size and location
+	List<Store::BlockLocation> processed;
+	uint64_t index = 0;
+	int64_t offset = 0;
+	bool finished = false;
+	while(!finished || !pending.empty())
+	{
+		while(!finished && pending.size() < maxPending)
 		{
-			BinaryString subsalt;
-			subsalt.writeBinary(i);
+			int64_t blockSize = (chunker ? int64_t(chunker->next()) : std::min(int64_t(Block::Size), size - offset));
+			if(blockSize <= 0)
+			{
+				finished = true;
+				break;
+			}
 
-			// Generate subkey
-			BinaryString subkey;
-			Sha256().pbkdf2_hmac(key, subsalt, subkey, 32, 100);
+			pending.push(std::make_pair(blockSize, ProcessPool().enqueue([filename, index, offset, blockSize, key, salt, cache]()
+			{
+				return ProcessBlock(filename, index, offset, blockSize, key, salt, cache);
+			})));
 
-			// Generate IV
-			BinaryString iv;
-			Sha256().pbkdf2_hmac(salt, subsalt, iv, 16, 100);
+			++index;
+			offset+= blockSize;
+		}
 
-			if(!Block::EncryptFile(file, subkey, iv, blockDigest))
-				break;
+		if(pending.empty()) break;
+
+		const int64_t blockSize = pending.front().first;
+		Store::BlockLocation location = pending.front().second.get();
+		pending.pop();
+
+		// Block sizes and digests must stay in sync, so give up if the file changed meanwhile
+		if(location.size != blockSize)
+			throw Exception("File was modified while processing: " + filename);
 
-			mIndexRecord->blockDigests.append(blockDigest);
-			++i;
+		if(chunker) mIndexRecord->blockSizes.append(location.size);
+		mIndexRecord->blockDigests.append(location.digest);
+		processed.push_back(location);
+		if(processed.size() >= NotifyBatchSize)
+		{
+			Store::Instance->notifyBlocks(processed);
+			processed.clear();
 		}
 	}
-	else {
-		while(Block::ProcessFile(file, blockDigest, cache))
-			mIndexRecord->blockDigests.append(blockDigest);
-	}
+
+	Store::Instance->notifyBlocks(processed);
 
 	// Create index
 	String tempFileName = File::TempName();
@@ -165,6 +197,77 @@ void Resource::process(const String &filename, const String &name, const String
 	mIndexBlock = std::make_shared<Block>(indexFilePath);
 }
 
+Store::BlockLocation Resource::ProcessBlock(const String &filename, uint64_t index, int64_t offset, int64_t size, const BinaryString &key, const BinaryString &salt, bool cache)
+{
+	Store::BlockLocation location;
+	location.offset = offset;
+	location.size = 0;
+
+	File file(filename, File::Read);
+	file.seekRead(location.offset);
+
+	if(key.empty() && !cache)
+	{
+		// Plain block is referenced in place
+		location.filename = filename;
+		location.size = Sha256().compute(file, size, location.digest);
+		return location;
+	}
+
+	BinaryString data;
+	data.resize(size_t(size));
+	data.resize(size_t(file.readBinary(data.ptr(), data.size())));
+	file.close();
+	if(data.empty()) return location;
+
+	if(!key.empty())
+	{
+		BinaryString subsalt;
+		subsalt.writeBinary(index);
+
+		// Generate subkey
+		BinaryString subkey;
+		Sha256().pbkdf2_hmac(key, subsalt, subkey, 32, 100);
+
+		// Generate IV
+		BinaryString iv;
+		Sha256().pbkdf2_hmac(salt, subsalt, iv, 16, 100);
+
+		// Encrypt in memory
+		BinaryString encrypted;
+		AesCtr cipher(&encrypted);
+		cipher.setEncryptionKey(subkey);
+		cipher.setInitializationVector(iv);
+		cipher.writeData(data.data(), data.size());
+		cipher.close();
+		std::swap(data, encrypted);
+	}
+
+	// Hash once while the block is in memory, then move it to cache
+	Sha256().compute(data.data(), data.size(), location.digest);
+
+	String tempFileName = File::TempName();
+	File tempFile(tempFileName, File::Truncate);
+	tempFile.writeData(data.data(), data.size());
+	tempFile.close();
+
+	location.filename = Cache::Instance->move(tempFileName, location.digest);
+	location.offset = 0;
+	location.size = int64_t(data.size());
+	return location;
+}
+
+ThreadPool &Resource::ProcessPool(void)
+{
+	static ThreadPool pool(ProcessThreads());
+	return pool;
+}
+
+size_t Resource::ProcessThreads(void)
+{
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
 void Resource::cache(const String &filename, const String &name, const String &type, const String &secret)
 {
 	// Process in cache mode
@@ -191,6 +294,22 @@ int Resource::blockIndex(int64_t position, size_t *offset) const
 	if(!mIndexBlock || position < 0 || (position > 0 && position >= mIndexRecord->size))
 		throw OutOfBounds("Resource position out of bounds");
 
+	if(!mIndexRecord->blockSizes.empty())
+	{
+		// Variable-size blocks from content-defined chunking
+		int64_t begin = 0;
+		for(int i = 0; i < int(mIndexRecord->blockSizes.size()); ++i)
+		{
+			int64_t end = begin + mIndexRecord->blockSizes[i];
+			if(position < end || i == int(mIndexRecord->blockSizes.size()) - 1)
+			{
+				if(offset) *offset = size_t(position - begin);
+				return i;
+			}
+			begin = end;
+		}
+	}
+
 	if(offset) *offset = size_t(position % Block::Size);
 	return int(position/Block::Size);
 }
@@ -331,10 +450,12 @@ Resource::Reader::Reader(Resource *resource, const String &secret, bool nocheck)
 	mResource(resource),
 	mReadPosition(0),
 	mCurrentBlock(NULL),
-	mNextBlock(NULL)
+	mReadAhead(1)
 {
 	Assert(mResource);
 
+	mMaxReadAhead = std::max(int(ReadAheadBlocks.toInt()), 1);
+
 	if(!secret.empty())
 	{
 		if(!nocheck && mResource->salt().empty())
@@ -384,8 +505,21 @@ size_t Resource::Reader::readData(char *buffer, size_t size)
 	}
 
 	++mCurrentBlockIndex;
-	mCurrentBlock = mNextBlock;
-	mNextBlock = createBlock(mCurrentBlockIndex + 1);
+	mCurrentBlock = NULL;
+	if(!mNextBlocks.empty())
+	{
+		mCurrentBlock = mNextBlocks.front().first;
+		mNextBlocks.pop_front();
+
+		// The window did not hide the fetch latency, widen it
+		if(!Store::Instance->hasBlock(mCurrentBlock->digest()) && mReadAhead < mMaxReadAhead)
+		{
+			mReadAhead = std::min(mReadAhead*2, mMaxReadAhead);
+			LogDebug("Resource::Reader", "Read-ahead window is now " + String::number(mReadAhead) + " blocks");
+		}
+	}
+
+	fillReadAhead();
 	return readData(buffer, size);
 }
 
@@ -399,9 +533,11 @@ void Resource::Reader::seekRead(int64_t position)
 	size_t offset = 0;
 	mCurrentBlockIndex = mResource->blockIndex(position, &offset);
 	mCurrentBlock	= createBlock(mCurrentBlockIndex);
-	mNextBlock	= createBlock(mCurrentBlockIndex + 1);
 	mReadPosition	= position;
 
+	mNextBlocks.clear();
+	fillReadAhead();
+
 	if(mCurrentBlock)
 		mCurrentBlock->seekRead(offset);
 }
@@ -442,6 +578,283 @@ sptr<Block> Resource::Reader::createBlock(int index)
 	return block;
 }
 
+void Resource::Reader::fillReadAhead(void)
+{
+	while(int(mNextBlocks.size()) < mReadAhead)
+	{
+		sptr<Block> block = createBlock(mCurrentBlockIndex + 1 + int(mNextBlocks.size()));
+		if(!block) break;
+
+		sptr<Network::Caller> caller;
+		if(!block->isLocallyAvailable())
+			caller = std::make_shared<Network::Caller>(block->digest());	// start fetching now
+
+		mNextBlocks.push_back(std::make_pair(block, caller));
+	}
+}
+
+const char Resource::DirectoryIndex::Magic[8] = {'t', 'p', 'n', 'd', 'i', 'r', 0, 1};
+
+Resource::DirectoryIndex::DirectoryIndex(Resource *resource) :
+	mRetained(false),
+	mHeader(NULL),
+	mEntries(NULL),
+	mByName(NULL),
+	mByDigest(NULL),
+	mStrings(NULL)
+{
+	Assert(resource);
+	if(!resource->isDirectory())
+		throw Exception("Resource is not a directory");
+
+	mDigest = resource->digest();
+	mPath = Path(mDigest);
+	Cache::Instance->retain(mPath);	// not evicted while mapped
+	mRetained = true;
+
+	try {
+		if(!map(mPath))
+		{
+			Build(resource, mPath);
+			if(!map(mPath))
+				throw Exception("Invalid directory index: " + mPath);
+		}
+	}
+	catch(...)
+	{
+		Cache::Instance->release(mPath);
+		throw;
+	}
+}
+
+Resource::DirectoryIndex::DirectoryIndex(const String &path) :
+	mPath(path),
+	mRetained(false),
+	mHeader(NULL),
+	mEntries(NULL),
+	mByName(NULL),
+	mByDigest(NULL),
+	mStrings(NULL)
+{
+	if(!map(mPath))
+		throw Exception("Invalid directory index: " + mPath);
+}
+
+Resource::DirectoryIndex::~DirectoryIndex(void)
+{
+	mFile.close();
+	if(mRetained) Cache::Instance->release(mPath);
+}
+
+bool Resource::DirectoryIndex::IsCached(const BinaryString &digest)
+{
+	return File::Exist(Path(digest));
+}
+
+void Resource::DirectoryIndex::get(size_t i, DirectoryRecord &record) const
+{
+	Assert(i < count());
+	const Entry &entry = mEntries[i];
+
+	StringView name = pooled(entry.name, entry.nameSize);
+	StringView type = pooled(entry.type, entry.typeSize);
+	StringView digest = pooled(entry.digest, entry.digestSize);
+
+	record.name.assign(name.data(), name.size());
+	record.type.assign(type.data(), type.size());
+	record.size = entry.size;
+	record.digest.assign(digest.data(), digest.size());
+	record.time = Time(time_t(entry.time));
+}
+
+StringView Resource::DirectoryIndex::name(size_t i) const
+{
+	Assert(i < count());
+	return pooled(mEntries[i].name, mEntries[i].nameSize);
+}
+
+StringView Resource::DirectoryIndex::recordDigest(size_t i) const
+{
+	Assert(i < count());
+	return pooled(mEntries[i].digest, mEntries[i].digestSize);
+}
+
+bool Resource::DirectoryIndex::find(const String &name, DirectoryRecord &record) const
+{
+	const StringView key(name);
+	const uint32_t *end = mByName + count();
+	const uint32_t *it = std::lower_bound(mByName, end, key, [this](uint32_t i, const StringView &k) {
+		return this->name(i) < k;
+	});
+
+	if(it == end || this->name(*it) != key) return false;
+	get(*it, record);
+	return true;
+}
+
+size_t Resource::DirectoryIndex::findDigest(const StringView &key) const
+{
+	const uint32_t *end = mByDigest + count();
+	const uint32_t *it = std::lower_bound(mByDigest, end, key, [this](uint32_t i, const StringView &k) {
+		return recordDigest(i) < k;
+	});
+
+	if(it == end || recordDigest(*it) != key) return NotFound;
+	return *it;	// ties are ordered by index
+}
+
+String Resource::DirectoryIndex::Path(const BinaryString &digest)
+{
+	return Cache::Instance->path(digest) + ".index";
+}
+
+void Resource::DirectoryIndex::Build(Resource *resource, const String &path)
+{
+	Reader reader(resource);
+	size_t count = Write([&reader](DirectoryRecord &record) {
+		return reader.readDirectory(record);
+	}, path);
+
+	Cache::Instance->insert(path);
+
+	LogDebug("Resource::DirectoryIndex", "Indexed directory " + resource->digest().toString() + " (" + String::number(int(count)) + " records)");
+}
+
+size_t Resource::DirectoryIndex::Write(const std::function<bool(DirectoryRecord&)> &next, const String &path)
+{
+	std::vector<Entry> entries;
+	std::string strings;
+
+	auto pool = [&strings](const std::string &str, uint32_t &offset, uint32_t &size) {
+		if(strings.size() + str.size() > std::numeric_limits<uint32_t>::max())
+			throw Exception("Directory is too large to index");
+
+		offset = uint32_t(strings.size());
+		size = uint32_t(str.size());
+		strings+= str;
+	};
+
+	DirectoryRecord record;
+	while(next(record))
+	{
+		Entry entry;
+		std::memset(&entry, 0, sizeof(entry));
+		entry.size = record.size;
+		entry.time = int64_t(record.time.toUnixTime());
+		pool(record.name, entry.name, entry.nameSize);
+		pool(record.type, entry.type, entry.typeSize);
+		pool(record.digest, entry.digest, entry.digestSize);
+		entries.push_back(entry);
+	}
+
+	if(entries.size() > std::numeric_limits<uint32_t>::max())
+		throw Exception("Directory is too large to index");
+
+	auto view = [&strings](uint32_t offset, uint32_t size) {
+		return StringView(strings.data() + offset, size);
+	};
+
+	const uint32_t count = uint32_t(entries.size());
+	std::vector<uint32_t> byName(count), byDigest(count);
+	for(uint32_t i = 0; i < count; ++i)
+		byName[i] = byDigest[i] = i;
+
+	std::stable_sort(byName.begin(), byName.end(), [&](uint32_t a, uint32_t b) {
+		return view(entries[a].name, entries[a].nameSize) < view(entries[b].name, entries[b].nameSize);
+	});
+
+	std::stable_sort(byDigest.begin(), byDigest.end(), [&](uint32_t a, uint32_t b) {
+		return view(entries[a].digest, entries[a].digestSize) < view(entries[b].digest, entries[b].digestSize);
+	});
+
+	uint32_t unique = 0;
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		const Entry &entry = entries[byDigest[i]];
+		if(i == 0 || view(entry.digest, entry.digestSize) != view(entries[byDigest[i-1]].digest, entries[byDigest[i-1]].digestSize))
+			++unique;
+	}
+
+	Header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, Magic, sizeof(Magic));
+	header.byteOrder = ByteOrder;
+	header.count = count;
+	header.unique = unique;
+	header.stringsSize = strings.size();
+
+	String tempFileName = File::TempName();
+	File file(tempFileName, File::Truncate);
+	file.writeData(reinterpret_cast<const char*>(&header), sizeof(header));
+	if(count)
+	{
+		file.writeData(reinterpret_cast<const char*>(entries.data()), entries.size()*sizeof(Entry));
+		file.writeData(reinterpret_cast<const char*>(byName.data()), byName.size()*sizeof(uint32_t));
+		file.writeData(reinterpret_cast<const char*>(byDigest.data()), byDigest.size()*sizeof(uint32_t));
+	}
+	file.writeData(strings.data(), strings.size());
+	file.close();
+
+	File::Rename(tempFileName, path);
+	return count;
+}
+
+bool Resource::DirectoryIndex::map(const String &path)
+{
+	if(!File::Exist(path)) return false;
+
+	try {
+		mFile.open(path);
+	}
+	catch(const Exception &e)
+	{
+		return false;	// removed concurrently
+	}
+
+	const char *data = mFile.data();
+	uint64_t size = mFile.size();
+	if(size < sizeof(Header)) return false;
+
+	const Header *header = reinterpret_cast<const Header*>(data);
+	if(std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->byteOrder != ByteOrder)
+		return false;
+
+	uint64_t count = header->count;
+	uint64_t tablesSize = sizeof(Header) + count*sizeof(Entry) + 2*count*sizeof(uint32_t);
+	if(size != tablesSize + header->stringsSize || header->unique > count)
+		return false;
+
+	// Validate every offset once so lookups can't read out of bounds on a corrupted file
+	const Entry *entries = reinterpret_cast<const Entry*>(data + sizeof(Header));
+	const uint32_t *byName = reinterpret_cast<const uint32_t*>(entries + count);
+	const uint32_t *byDigest = byName + count;
+	const uint64_t stringsSize = header->stringsSize;
+	for(uint64_t i = 0; i < count; ++i)
+	{
+		const Entry &entry = entries[i];
+		if(uint64_t(entry.name) + entry.nameSize > stringsSize
+			|| uint64_t(entry.type) + entry.typeSize > stringsSize
+			|| uint64_t(entry.digest) + entry.digestSize > stringsSize)
+			return false;
+
+		if(byName[i] >= count || byDigest[i] >= count)
+			return false;
+	}
+
+	mHeader = header;
+	mEntries = entries;
+	mByName = byName;
+	mByDigest = byDigest;
+	mStrings = data + tablesSize;
+	return true;
+}
+
+StringView Resource::DirectoryIndex::pooled(uint32_t offset, uint32_t size) const
+{
+	AssertIO(uint64_t(offset) + size <= mHeader->stringsSize);
+	return StringView(mStrings + offset, size);
+}
+
 void Resource::MetaRecord::serialize(Serializer &s) const
 {
 	s << Object()
@@ -465,12 +878,18 @@ bool Resource::MetaRecord::isInlineSerializable(void) const
 
 void Resource::IndexRecord::serialize(Serializer &s) const
 {
+	// Sizes are packed in a single binary string, as older nodes can only skip strings
+	BinaryString sizes;
+	for(int64_t blockSize : blockSizes)
+		sizes.writeBinary(uint32_t(blockSize));
+
 	Object object;
 	object.insert("name", name)
 	      .insert("type", type)
 	      .insert("size", size)
 	      .insert("digests", blockDigests);
 
+	if(!sizes.empty()) object.insert("sizes", sizes);
 	if(!signature.empty()) object.insert("signature", signature);
 	if(!salt.empty()) object.insert("salt", salt);
 
@@ -479,13 +898,23 @@ void Resource::IndexRecord::serialize(Serializer &s) const
 
 bool Resource::IndexRecord::deserialize(Serializer &s)
 {
-	return !!(s >> Object()
+	BinaryString sizes;
+	if(!(s >> Object()
 		.insert("name", name)
 		.insert("type", type)
 		.insert("size", size)
 		.insert("digests", blockDigests)
+		.insert("sizes", sizes)
 		.insert("signature", signature)
-		.insert("salt", salt));
+		.insert("salt", salt)))
+		return false;
+
+	blockSizes.clear();
+	uint32_t blockSize;
+	while(sizes.readBinary(blockSize))
+		blockSizes.append(int64_t(blockSize));
+
+	return true;
 }
 
 void Resource::DirectoryRecord::serialize(Serializer &s) const
@@ -24,13 +24,18 @@
 
 #include "tpn/include.hpp"
 #include "tpn/block.hpp"
+#include "tpn/store.hpp"
 
 #include "pla/serializable.hpp"
 #include "pla/binarystring.hpp"
 #include "pla/string.hpp"
 #include "pla/file.hpp"
+#include "pla/mappedfile.hpp"
+#include "pla/stringview.hpp"
 #include "pla/crypto.hpp"
 
+#include <functional>
+
 namespace tpn
 {
 
@@ -98,6 +103,7 @@ public:
 		bool deserialize(Serializer &s);
 
 		Array<BinaryString> blockDigests;
+		Array<int64_t> blockSizes;	// only with content-defined chunking
 		BinaryString signature;
 		BinaryString salt;
 	};
@@ -137,17 +143,88 @@ public:
 
 	private:
 		sptr<Block> createBlock(int index);
+		void fillReadAhead(void);
 
 		Resource *mResource;
 		int64_t mReadPosition;
 
 		int mCurrentBlockIndex;
 		sptr<Block> mCurrentBlock;
-		sptr<Block> mNextBlock;
+
+		// Read-ahead window, missing blocks are called in parallel
+		Deque<std::pair<sptr<Block>, sptr<Network::Caller> > > mNextBlocks;
+		int mReadAhead, mMaxReadAhead;
 
 		BinaryString mKey;
 	};
 
+	// Directory listing converted to a fixed-size record table in the cache,
+	// records are read in place from the mapping and can be accessed by index,
+	// by name (binary search) or by digest (binary search)
+	class DirectoryIndex
+	{
+	public:
+		DirectoryIndex(Resource *resource);	// builds the index if not cached
+		explicit DirectoryIndex(const String &path);	// maps an existing index file, throws if invalid
+		~DirectoryIndex(void);
+
+		static bool IsCached(const BinaryString &digest);	// true if the index file exists
+		static size_t Write(const std::function<bool(DirectoryRecord&)> &next, const String &path);	// writes records until next() returns false, returns the count
+
+		BinaryString digest(void) const	{ return mDigest; }
+		size_t count(void) const		{ return mHeader ? size_t(mHeader->count) : 0; }
+		size_t uniqueCount(void) const	{ return mHeader ? size_t(mHeader->unique) : 0; }	// distinct digests
+
+		void get(size_t i, DirectoryRecord &record) const;	// record buffers are reused
+		StringView name(size_t i) const;
+		StringView recordDigest(size_t i) const;
+		bool find(const String &name, DirectoryRecord &record) const;
+		size_t findDigest(const StringView &digest) const;	// returns the first matching index or NotFound
+		bool contains(const StringView &digest) const { return findDigest(digest) != NotFound; }
+
+		static const size_t NotFound = size_t(-1);
+
+	private:
+		static const char Magic[8];
+
+		static const uint32_t ByteOrder = 0x01020304;	// the index is only read on the host which wrote it
+
+		struct Header
+		{
+			char magic[8];
+			uint32_t byteOrder;
+			uint32_t count;
+			uint32_t unique;
+			uint32_t reserved;
+			uint64_t stringsSize;
+		};
+
+		struct Entry
+		{
+			int64_t size;
+			int64_t time;
+			uint32_t name, nameSize;	// offsets in string pool
+			uint32_t type, typeSize;
+			uint32_t digest, digestSize;
+		};
+
+		// File layout: Header, Entry[count], uint32_t byName[count], uint32_t byDigest[count], string pool
+		static String Path(const BinaryString &digest);
+		static void Build(Resource *resource, const String &path);
+		bool map(const String &path);	// false if missing or invalid
+		StringView pooled(uint32_t offset, uint32_t size) const;
+
+		BinaryString mDigest;
+		String mPath;
+		bool mRetained;	// mPath is retained in the cache
+		MappedFile mFile;
+		const Header *mHeader;
+		const Entry *mEntries;
+		const uint32_t *mByName;
+		const uint32_t *mByDigest;
+		const char *mStrings;
+	};
+
 	// JSON resource importer
 	class ImportTask
 	{
@@ -166,6 +243,11 @@ public:
 	};
 
 protected:
+	static const size_t NotifyBatchSize = 64;	// blocks registered per Store transaction
+	static Store::BlockLocation ProcessBlock(const String &filename, uint64_t index, int64_t offset, int64_t size, const BinaryString &key, const BinaryString &salt, bool cache);
+	static ThreadPool &ProcessPool(void);
+	static size_t ProcessThreads(void);
+
 	sptr<Block> mIndexBlock;
 	sptr<IndexRecord> mIndexRecord;
 	bool mLocalOnly;
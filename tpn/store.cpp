@@ -31,6 +31,10 @@
 namespace tpn
 {
 
+static const Config::Value RequestTimeout("request_timeout");
+static const Config::Value StoreMaxAge("store_max_age");
+static const Config::Value StorePublishPeriod("store_publish_period");
+
 Store *Store::Instance = NULL;
 
 BinaryString Store::Hash(const String &str)
@@ -64,26 +68,32 @@ Store::Store(void) :
 		type INTEGER(1))");
 	mDatabase->execute("CREATE UNIQUE INDEX IF NOT EXISTS pair ON map (key, value)");
 	mDatabase->execute("CREATE INDEX IF NOT EXISTS type ON map (time, type)");
+
+	// Statements on a shared connection would join a pending transaction, so batches get their own
+	mBatchDatabase = new Database("store.db");
 }
 
 Store::~Store(void)
 {
-
+	delete mBatchDatabase;
 }
 
 bool Store::push(const BinaryString &digest, Fountain::Combination &input)
 {
+	if(digest.size() != Digest::Size) return false;
+	const Digest id(digest);
+
 	sptr<Sink> sink;
 	{
 		std::unique_lock<std::mutex> lock(mMutex);
 
 		if(hasBlock(digest)) return true;
 
-		mSinks.get(digest, sink);
+		mSinks.get(id, sink);
 		if(!sink)
 		{
 			sink = std::make_shared<Sink>(digest);
-			mSinks.insert(digest, sink);
+			mSinks.insert(id, sink);
 		}
 	}
 
@@ -93,7 +103,7 @@ bool Store::push(const BinaryString &digest, Fountain::Combination &input)
 	{
 		// Block is decoded !
 		std::unique_lock<std::mutex> lock(mMutex);
-		mSinks.erase(digest);
+		mSinks.erase(id);
 		notifyBlock(digest, sink->path(), 0, sink->size());
 		return true;
 	}
@@ -119,10 +129,11 @@ bool Store::pull(const BinaryString &digest, Fountain::Combination &output, unsi
 unsigned Store::missing(const BinaryString &digest)
 {
 	if(hasBlock(digest)) return 0;
+	if(digest.size() != Digest::Size) return 0;
 
 	std::unique_lock<std::mutex> lock(mMutex);
 
-	auto it = mSinks.find(digest);
+	auto it = mSinks.find(Digest(digest));
 	if(it != mSinks.end()) return it->second->missing();
 	else return Block::MaxChunks;
 }
@@ -150,7 +161,7 @@ bool Store::hasBlock(const BinaryString &digest)
 
 void Store::waitBlock(const BinaryString &digest)
 {
-	const duration timeout = milliseconds(Config::Get("request_timeout").toDouble())*2;
+	const duration timeout = RequestTimeout.toMilliseconds()*2;
 	if(!waitBlock(digest, timeout))
 		throw Timeout();
 }
@@ -230,6 +241,62 @@ void Store::notifyBlock(const BinaryString &digest, const String &filename, int6
 	Network::Instance->storeValue(digest, Network::Instance->overlay()->localNode());
 }
 
+void Store::notifyBlocks(const List<BlockLocation> &blocks)
+{
+	if(blocks.empty()) return;
+
+	Set<BinaryString> digests;
+	auto it = blocks.begin();
+	while(it != blocks.end())
+	{
+		// Commit in short transactions so other connections only wait for a few rows
+		std::unique_lock<std::mutex> lock(mBatchMutex);
+		mBatchDatabase->execute("BEGIN IMMEDIATE TRANSACTION");
+		try {
+			Database::Statement fileStatement = mBatchDatabase->prepare("INSERT OR IGNORE INTO files (name) VALUES (?1)");
+			Database::Statement blockStatement = mBatchDatabase->prepare("INSERT OR REPLACE INTO blocks (file_id, digest, offset, size) VALUES ((SELECT id FROM files WHERE name = ?1 LIMIT 1), ?2, ?3, ?4)");
+
+			try {
+				for(int i = 0; it != blocks.end() && i < BatchTransactionSize; ++it, ++i)
+				{
+					fileStatement.bind(1, it->filename);
+					fileStatement.step();
+					fileStatement.reset();
+
+					blockStatement.bind(1, it->filename);
+					blockStatement.bind(2, it->digest);
+					blockStatement.bind(3, it->offset);
+					blockStatement.bind(4, it->size);
+					blockStatement.step();
+					blockStatement.reset();
+
+					digests.insert(it->digest);
+				}
+			}
+			catch(...)
+			{
+				fileStatement.finalize();
+				blockStatement.finalize();
+				throw;
+			}
+
+			fileStatement.finalize();
+			blockStatement.finalize();
+			mBatchDatabase->execute("COMMIT");
+		}
+		catch(...)
+		{
+			NOEXCEPTION(mBatchDatabase->execute("ROLLBACK"));
+			throw;
+		}
+	}
+
+	mCondition.notify_all();
+
+	// Publish into DHT
+	Network::Instance->storeValues(digests, Network::Instance->overlay()->localNode());
+}
+
 void Store::notifyFileErasure(const String &filename)
 {
 	Database::Statement statement = mDatabase->prepare("DELETE FROM blocks WHERE file_id = (SELECT id FROM files WHERE name = ?1)");
@@ -263,7 +330,7 @@ bool Store::getBlockHints(const BinaryString &digest, Set<BinaryString> &result)
 
 void Store::storeValue(const BinaryString &key, const BinaryString &value, Store::ValueType type, Time time)
 {
-	const duration maxAge = seconds(Config::Get("store_max_age").toDouble());
+	const duration maxAge = StoreMaxAge.toSeconds();
 	time = std::min(time, Time::Now());
 
 	if(type != Permanent && Time::Now() - time >= maxAge)
@@ -401,19 +468,27 @@ void Store::start(void)
 
 void Store::run(void)
 {
-	const duration maxAge = seconds(Config::Get("store_max_age").toDouble());
-
-	// TODO: delay and batch values
-	const duration delay = seconds(1.);
-	const int batch = 10;
+	const duration maxAge = StoreMaxAge.toSeconds();
+	const duration period = StorePublishPeriod.toSeconds();	// target pass duration
+	const int batch = 256;
 
 	LogDebug("Store::run", "Started");
 
 	try {
 		const BinaryString node = Network::Instance->overlay()->localNode();
 
+		using clock = std::chrono::steady_clock;
+		const clock::time_point start = clock::now();
+		const clock::time_point deadline = start + std::chrono::duration_cast<clock::duration>(period);
+
+		Database::Statement statement = mDatabase->prepare("SELECT COUNT(*) FROM blocks WHERE digest IS NOT NULL");
+		int64_t total = 0;
+		if(statement.step()) statement.value(0, total);
+		statement.finalize();
+
 		// Publish everything into DHT periodically
-		int offset = 0;
+		int64_t count = 0;
+		int64_t last = std::numeric_limits<int64_t>::max();
 		while(true)
 		{
 			if(Network::Instance->overlay()->connectionsCount() == 0)
@@ -422,8 +497,6 @@ void Store::run(void)
 				return;
 			}
 
-			Database::Statement statement;
-
 			// Delete some old non-permanent values
 			statement = mDatabase->prepare("DELETE FROM map WHERE rowid IN (SELECT rowid FROM map WHERE time <= ?2 AND type != ?1 LIMIT ?3)");
 			statement.bind(1, static_cast<int>(Permanent));
@@ -431,25 +504,36 @@ void Store::run(void)
 			statement.bind(3, batch);
 			statement.execute();
 
-			// Select DHT values
-			statement = mDatabase->prepare("SELECT digest FROM blocks WHERE digest IS NOT NULL ORDER BY id DESC LIMIT ?1 OFFSET ?2");
-			statement.bind(1, batch);
-			statement.bind(2, offset);
+			// Select DHT values, paginated on id
+			statement = mDatabase->prepare("SELECT id, digest FROM blocks WHERE id < ?1 AND digest IS NOT NULL ORDER BY id DESC LIMIT ?2");
+			statement.bind(1, last);
+			statement.bind(2, batch);
 
-			List<BinaryString> result;
-			statement.fetchColumn(0, result);
+			Set<BinaryString> result;
+			while(statement.step())
+			{
+				BinaryString digest;
+				statement.value(0, last);
+				statement.value(1, digest);
+				result.insert(digest);
+			}
 			statement.finalize();
 
 			if(result.empty()) break;
-			offset+= result.size();
+			count+= result.size();
 
-			for(List<BinaryString>::iterator it = result.begin(); it != result.end(); ++it)
-				Network::Instance->storeValue(*it, node);
+			Network::Instance->storeValues(result, node);
 
-			std::this_thread::sleep_for(delay);
+			// Spread remaining batches evenly until deadline
+			const int64_t left = std::max(total - count, int64_t(0));
+			const clock::time_point now = clock::now();
+			if(left > 0 && now < deadline)
+				std::this_thread::sleep_for((deadline - now)*(double(std::min(left, int64_t(batch)))/left));
 		}
 
-		LogDebug("Store::run", "Finished, " + String::number(offset) + " values published");
+		const double elapsed = std::chrono::duration_cast<seconds>(clock::now() - start).count();
+		LogDebug("Store::run", "Finished, " + String::number(count) + " values published in " + String::number(elapsed, 1) + "s ("
+			+ String::number(elapsed > 0. ? double(count)/elapsed : 0., 1) + " keys/s)");
 	}
 	catch(const std::exception &e)
 	{
@@ -498,6 +582,8 @@ bool Store::Sink::push(Fountain::Combination &incoming)
 	File file(mPath, File::Write);
 	mSize = mSink.dump(file);
 	file.close();
+
+	Cache::Instance->insert(mPath);
 	return true;
 }
 
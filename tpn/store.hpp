@@ -29,6 +29,7 @@
 #include "pla/file.hpp"
 #include "pla/time.hpp"
 #include "pla/map.hpp"
+#include "pla/hashmap.hpp"
 #include "pla/list.hpp"
 #include "pla/set.hpp"
 #include "pla/binarystring.hpp"
@@ -42,6 +43,14 @@ public:
 	static Store *Instance;
 	static BinaryString Hash(const String &str);
 
+	struct BlockLocation
+	{
+		BinaryString digest;
+		String filename;
+		int64_t offset;
+		int64_t size;
+	};
+
 	Store(void);
 	~Store(void);
 
@@ -54,6 +63,7 @@ public:
 	bool waitBlock(const BinaryString &digest, duration timeout);
 	File *getBlock(const BinaryString &digest, int64_t &size);
 	void notifyBlock(const BinaryString &digest, const String &filename, int64_t offset, int64_t size);
+	void notifyBlocks(const List<BlockLocation> &blocks);	// one transaction and one DHT batch
 	void notifyFileErasure(const String &filename);
 
 	void hintBlock(const BinaryString &digest, const BinaryString &hint);
@@ -100,12 +110,16 @@ private:
 		mutable std::mutex mMutex;
 	};
 
+	static const int BatchTransactionSize = 16;	// rows per batch transaction, keeps the write lock short
+
 	Database *mDatabase;
-	Map<BinaryString,sptr<Sink> > mSinks;
+	Database *mBatchDatabase;	// dedicated connection for batched transactions
+	HashMap<Digest, sptr<Sink> > mSinks;
 	bool mRunning;
 
 	mutable std::mutex mMutex;
 	mutable std::condition_variable mCondition;
+	std::mutex mBatchMutex;	// protects mBatchDatabase
 };
 
 }